@@ -0,0 +1,279 @@
+#include "DecodeScheduler.h"
+
+#include <algorithm>
+
+#include "HAL/PlatformProcess.h"
+
+#include "MyRunnable.h"
+
+// how long idle workers wait for work before checking if they should stop
+// anyway. stopping the workers wakes them up, so this is only a fallback
+static constexpr std::chrono::seconds WAIT_TIME{1};
+// the smallest weight a stream can have, so that every stream makes progress
+static constexpr float MIN_WEIGHT = 0.01f;
+
+// which scheduler (and which of its workers) the current thread is, so that
+// parallel_for() knows which deque to put the slices on
+static thread_local const FDecodeScheduler *current_scheduler = nullptr;
+static thread_local int current_worker = -1;
+
+FDecodeScheduler::FDecodeScheduler(int num_workers)
+{
+  num_workers = FMath::Max(num_workers, 1);
+  for (int i = 0; i <= num_workers; i++) {
+    slice_deques_.push_back(std::make_unique<SliceDeque>());
+  }
+  for (int i = 0; i < num_workers; i++) {
+    workers_.push_back(new FMyRunnable([this, i]() { return run_once(i); },
+                                       [this]() {
+                                         {
+                                           std::lock_guard<std::mutex> lock(mutex_);
+                                           stopping_ = true;
+                                         }
+                                         work_available_.notify_all();
+                                       }));
+  }
+}
+
+FDecodeScheduler::~FDecodeScheduler()
+{
+  for (auto worker : workers_) {
+    worker->Stop();
+  }
+  for (auto worker : workers_) {
+    delete worker;
+  }
+  workers_.clear();
+  if (!streams_.empty()) {
+    UE_LOG(LogTemp, Warning, TEXT("Decode scheduler: stopped with %d streams still registered"),
+           static_cast<int32>(streams_.size()));
+  }
+}
+
+int32 FDecodeScheduler::add_stream(float weight)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  int32 id = next_stream_id_++;
+  auto stream = std::make_unique<Stream>();
+  stream->Weight = FMath::Max(weight, MIN_WEIGHT);
+  stream->VirtualTime = virtual_time_;
+  streams_[id] = std::move(stream);
+  return id;
+}
+
+void FDecodeScheduler::remove_stream(int32 stream)
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  auto it = streams_.find(stream);
+  if (it == streams_.end()) {
+    return;
+  }
+  // drop what's queued and wait for the task that's running, if any
+  auto &removed = *it->second;
+  removed.Tasks.clear();
+  work_available_.wait(lock, [&removed]() { return !removed.Running; });
+  streams_.erase(stream);
+}
+
+bool FDecodeScheduler::submit(int32 stream, task_t task)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = streams_.find(stream);
+    if (it == streams_.end()) {
+      return false;
+    }
+    auto &target = *it->second;
+    if (target.Tasks.empty() && !target.Running) {
+      // it was idle, so it picks up from the others rather than from where
+      // it left off
+      target.VirtualTime = std::max(target.VirtualTime, virtual_time_);
+    }
+    target.Tasks.push_back({std::move(task), Clock::now()});
+  }
+  work_available_.notify_one();
+  return true;
+}
+
+void FDecodeScheduler::parallel_for(int num_slices, const slice_t &slice)
+{
+  if (num_slices <= 1) {
+    if (num_slices == 1) {
+      slice(0);
+      slices_.fetch_add(1, std::memory_order_relaxed);
+    }
+    return;
+  }
+  // a worker puts the slices on its own deque, anyone else on the shared one
+  int deque_index = current_scheduler == this ? current_worker : static_cast<int>(workers_.size());
+  SliceGroup group;
+  group.Function = &slice;
+  group.Remaining = num_slices - 1;
+  {
+    auto &deque = *slice_deques_[deque_index];
+    std::lock_guard<std::mutex> lock(deque.Mutex);
+    for (int i = num_slices - 1; i > 0; i--) {
+      deque.Slices.push_back({&group, i});
+    }
+  }
+  slices_queued_.fetch_add(num_slices - 1);
+  {
+    // so that a worker which just found nothing to do doesn't miss them
+    std::lock_guard<std::mutex> lock(mutex_);
+  }
+  work_available_.notify_all();
+
+  // run the first slice, then the rest, in order, until the other workers
+  // have stolen them all
+  slice(0);
+  slices_.fetch_add(1, std::memory_order_relaxed);
+  Slice next;
+  while (group.Remaining.load(std::memory_order_acquire) > 0 && pop_slice(deque_index, false, next)) {
+    run_slice(next);
+  }
+  // then help with anyone's slices until the stolen ones are done
+  while (group.Remaining.load(std::memory_order_acquire) > 0) {
+    if (!try_run_slice(deque_index)) {
+      FPlatformProcess::Yield();
+    }
+  }
+}
+
+FDecodeScheduler::StreamStats FDecodeScheduler::get_stream_stats(int32 stream) const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = streams_.find(stream);
+  if (it == streams_.end()) {
+    return {};
+  }
+  auto stats = it->second->Stats;
+  stats.Queued = static_cast<int32>(it->second->Tasks.size());
+  return stats;
+}
+
+FDecodeScheduler::Stats FDecodeScheduler::get_stats() const
+{
+  Stats stats;
+  stats.Workers = static_cast<int32>(workers_.size());
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats.Streams = static_cast<int32>(streams_.size());
+  }
+  stats.Tasks = tasks_.load(std::memory_order_relaxed);
+  stats.Slices = slices_.load(std::memory_order_relaxed);
+  stats.SlicesStolen = slices_stolen_.load(std::memory_order_relaxed);
+  return stats;
+}
+
+bool FDecodeScheduler::run_once(int worker)
+{
+  current_scheduler = this;
+  current_worker = worker;
+  // slices first, since they hold up a frame which is already being decoded
+  if (try_run_slice(worker)) {
+    return false;
+  }
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  // the stream with the least decode time for its weight goes next, unless
+  // it's already running a task
+  Stream *next = nullptr;
+  for (auto &[id, stream] : streams_) {
+    if (!stream->Running && !stream->Tasks.empty() && (!next || stream->VirtualTime < next->VirtualTime)) {
+      next = stream.get();
+    }
+  }
+  if (!next) {
+    work_available_.wait_for(lock, WAIT_TIME, [this]() { return stopping_ || has_work(); });
+    return false;
+  }
+  auto task = std::move(next->Tasks.front());
+  next->Tasks.pop_front();
+  next->Running = true;
+  virtual_time_ = std::max(virtual_time_, next->VirtualTime);
+  lock.unlock();
+
+  auto start_time = Clock::now();
+  task.Function();
+  auto end_time = Clock::now();
+
+  lock.lock();
+  // the stream can't have been removed while its task was running
+  auto queue_wait_us = std::chrono::duration_cast<std::chrono::microseconds>(start_time - task.SubmitTime).count();
+  auto run_time = end_time - start_time;
+  auto &stats = next->Stats;
+  stats.Tasks++;
+  stats.QueueWaitUs += queue_wait_us;
+  stats.MaxQueueWaitUs = std::max<uint64>(stats.MaxQueueWaitUs, queue_wait_us);
+  stats.RunTimeUs += std::chrono::duration_cast<std::chrono::microseconds>(run_time).count();
+  next->VirtualTime += std::chrono::duration<double>(run_time).count() / next->Weight;
+  next->Running = false;
+  lock.unlock();
+  tasks_.fetch_add(1, std::memory_order_relaxed);
+  // its next task can run now, and remove_stream() may be waiting for it
+  work_available_.notify_all();
+
+  // don't want to stop the thread
+  return false;
+}
+
+bool FDecodeScheduler::has_work() const
+{
+  if (slices_queued_.load() > 0) {
+    return true;
+  }
+  for (auto &[id, stream] : streams_) {
+    if (!stream->Running && !stream->Tasks.empty()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool FDecodeScheduler::try_run_slice(int deque_index)
+{
+  if (slices_queued_.load() == 0) {
+    return false;
+  }
+  Slice slice;
+  // newest first from its own deque, then the oldest of someone else's
+  if (pop_slice(deque_index, false, slice)) {
+    run_slice(slice);
+    return true;
+  }
+  int num_deques = static_cast<int>(slice_deques_.size());
+  for (int i = 1; i < num_deques; i++) {
+    if (pop_slice((deque_index + i) % num_deques, true, slice)) {
+      slices_stolen_.fetch_add(1, std::memory_order_relaxed);
+      run_slice(slice);
+      return true;
+    }
+  }
+  return false;
+}
+
+bool FDecodeScheduler::pop_slice(int deque_index, bool steal, Slice &slice)
+{
+  auto &deque = *slice_deques_[deque_index];
+  std::lock_guard<std::mutex> lock(deque.Mutex);
+  if (deque.Slices.empty()) {
+    return false;
+  }
+  if (steal) {
+    slice = deque.Slices.front();
+    deque.Slices.pop_front();
+  } else {
+    slice = deque.Slices.back();
+    deque.Slices.pop_back();
+  }
+  slices_queued_.fetch_sub(1);
+  return true;
+}
+
+void FDecodeScheduler::run_slice(const Slice &slice)
+{
+  (*slice.Group->Function)(slice.Index);
+  slices_.fetch_add(1, std::memory_order_relaxed);
+  // the group may be gone as soon as its last slice is done
+  slice.Group->Remaining.fetch_sub(1, std::memory_order_release);
+}
@@ -0,0 +1,174 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "CoreMinimal.h"
+
+class FMyRunnable;
+
+/**
+ * @brief A fixed pool of decode workers shared by every stream.
+ *
+ * @details Streams submit their frames as tasks. Each stream's tasks run one
+ *          at a time and in order (so a stream can keep using one decoder),
+ *          and whenever a worker is free it takes the next task of the stream
+ *          which has had the least decode time relative to its weight, so
+ *          busy streams share the workers fairly and a quiet stream never
+ *          waits behind a busy one's backlog.
+ *
+ *          A task splits its frame into slices (e.g. restart intervals) with
+ *          parallel_for(). The slices go on the worker's own deque, which it
+ *          works through newest first, while idle workers steal the oldest
+ *          ones from it. So a stream decoding a big frame borrows the workers
+ *          the other streams aren't using, and gives them back as soon as the
+ *          frame is done.
+ */
+class FDecodeScheduler
+{
+public:
+  typedef std::function<void(void)> task_t;
+  typedef std::function<void(int)> slice_t;
+
+  struct StreamStats
+  {
+    uint64 Tasks = 0;          // tasks run
+    uint64 QueueWaitUs = 0;    // time the tasks waited for a worker, in total
+    uint64 MaxQueueWaitUs = 0; // longest time a task waited for a worker
+    uint64 RunTimeUs = 0;      // time the tasks took to run, in total
+    int32 Queued = 0;          // tasks waiting for a worker
+  };
+
+  struct Stats
+  {
+    int32 Workers = 0;       // number of worker threads
+    int32 Streams = 0;       // number of streams registered
+    uint64 Tasks = 0;        // tasks run, of every stream
+    uint64 Slices = 0;       // slices run
+    uint64 SlicesStolen = 0; // slices run by a thread other than the one that split them off
+  };
+
+  /**
+   * @brief Start the workers.
+   * @param num_workers The number of worker threads, e.g. the number of cores.
+   */
+  explicit FDecodeScheduler(int num_workers);
+
+  // Stop the workers. Every stream should have been removed by now.
+  ~FDecodeScheduler();
+
+  /**
+   * @brief Register a stream.
+   * @param weight The stream's share of the workers when they are busy,
+   *        relative to the other streams' weights.
+   * @return The id of the stream.
+   */
+  int32 add_stream(float weight);
+
+  /**
+   * @brief Unregister a stream, dropping its queued tasks. Once this returns,
+   *        none of its tasks are running or will run, so whatever they use
+   *        may be destroyed. Must not be called from one of its tasks.
+   * @param stream The id add_stream() returned.
+   */
+  void remove_stream(int32 stream);
+
+  /**
+   * @brief Queue a task to run on a worker after the stream's earlier tasks.
+   * @param stream The id add_stream() returned.
+   * @param task The task.
+   * @return False if the stream isn't registered.
+   */
+  bool submit(int32 stream, task_t task);
+
+  /**
+   * @brief Run slice(0) to slice(num_slices - 1), spread over the workers,
+   *        and return once they've all run. Can be called from any thread;
+   *        the calling thread runs slices too.
+   * @param num_slices The number of slices.
+   * @param slice The function which runs one slice.
+   */
+  void parallel_for(int num_slices, const slice_t &slice);
+
+  StreamStats get_stream_stats(int32 stream) const;
+
+  Stats get_stats() const;
+
+protected:
+  using Clock = std::chrono::steady_clock;
+
+  struct Task
+  {
+    task_t Function;
+    Clock::time_point SubmitTime;
+  };
+
+  struct Stream
+  {
+    float Weight = 1.0f;
+    // decode time (in seconds) divided by the weight; the stream with the
+    // least goes next
+    double VirtualTime = 0;
+    std::deque<Task> Tasks;
+    bool Running = false;
+    StreamStats Stats;
+  };
+
+  // the slices of one parallel_for(), which the caller waits on
+  struct SliceGroup
+  {
+    const slice_t *Function;
+    std::atomic<int> Remaining;
+  };
+
+  struct Slice
+  {
+    SliceGroup *Group;
+    int Index;
+  };
+
+  // a worker's slices, which the worker pops from the back and the others
+  // steal from the front
+  struct SliceDeque
+  {
+    std::mutex Mutex;
+    std::deque<Slice> Slices;
+  };
+
+  bool run_once(int worker);
+
+  bool has_work() const;
+
+  bool try_run_slice(int deque_index);
+
+  bool pop_slice(int deque_index, bool steal, Slice &slice);
+
+  void run_slice(const Slice &slice);
+
+  // guards the streams, and is what idle workers wait on
+  mutable std::mutex mutex_;
+  std::condition_variable work_available_;
+  std::unordered_map<int32, std::unique_ptr<Stream>> streams_;
+  int32 next_stream_id_ = 0;
+  // the virtual time of the last task started, which a stream that was idle
+  // starts from so that it doesn't get to catch up on the time it was idle
+  double virtual_time_ = 0;
+  bool stopping_ = false;
+
+  // one deque per worker, and one for slices split off on other threads
+  std::vector<std::unique_ptr<SliceDeque>> slice_deques_;
+  std::atomic<int> slices_queued_{0};
+
+  std::vector<FMyRunnable *> workers_;
+
+  std::atomic<uint64> tasks_{0};
+  std::atomic<uint64> slices_{0};
+  std::atomic<uint64> slices_stolen_{0};
+};
@@ -3,9 +3,10 @@
 #pragma region Main Thread Code
 // This code will be run on the thread that invoked this thread (i.e. game thread)
 
-FMyRunnable::FMyRunnable(FMyRunnable::callback_t callback)
+FMyRunnable::FMyRunnable(FMyRunnable::callback_t callback, FMyRunnable::wake_t wake)
   : bRunThread(true)
   , Callback(callback)
+  , Wake(wake)
 {
   // Link to the thread that created this object
   Thread = FRunnableThread::Create(this, TEXT("FMyRunnable"));
@@ -15,8 +16,10 @@ FMyRunnable::~FMyRunnable()
 {
   if (Thread != NULL)
   {
-    // blocking call until thread has completed
-    Thread->Kill();
+    // wake the thread up and wait for it to finish its current callback,
+    // rather than relying on Kill to get it out of a blocking call
+    Stop();
+    Thread->WaitForCompletion();
     delete Thread;
   }
 }
@@ -24,6 +27,12 @@ FMyRunnable::~FMyRunnable()
 void FMyRunnable::Stop()
 {
   bRunThread = false;
+  // the thread may be finishing right now, so whatever wake uses has to be
+  // kept alive until the runnable is deleted (see the header)
+  if (Wake)
+  {
+    Wake();
+  }
 }
 
 #pragma endregion
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <atomic>
 #include <functional>
 
 #include "CoreMinimal.h"
@@ -9,8 +10,15 @@ class FMyRunnable : public FRunnable
 {
 public:
   typedef std::function<bool(void)> callback_t;
+  typedef std::function<void(void)> wake_t;
 
-  FMyRunnable(callback_t callback);
+  // callback is run over and over until it returns true or the runnable is
+  // stopped. if it blocks waiting for work, wake should make it return (e.g.
+  // by triggering the event or waking the socket it waits on), so that Stop()
+  // takes effect right away. wake may be called after the thread has
+  // finished, so whatever it uses must outlive the runnable: destroy it only
+  // after deleting the runnable (which waits for the thread)
+  FMyRunnable(callback_t callback, wake_t wake = nullptr);
 
   virtual ~FMyRunnable() override;
 
@@ -20,7 +28,8 @@ public:
   virtual void Stop() override;
 
 private:
-  bool bRunThread = true;
+  std::atomic<bool> bRunThread = true;
   callback_t Callback = nullptr;
+  wake_t Wake = nullptr;
   FRunnableThread *Thread = nullptr;
 };
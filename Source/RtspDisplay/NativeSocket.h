@@ -0,0 +1,157 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include "NetworkReactor.h"
+
+#if RTSP_USE_NATIVE_SOCKETS
+
+#if PLATFORM_WINDOWS
+#include "Windows/AllowWindowsPlatformTypes.h"
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include "Windows/HideWindowsPlatformTypes.h"
+#else
+#include <arpa/inet.h>
+#include <cerrno>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+/**
+ * @brief The few calls on native sockets which differ between BSD sockets
+ *        and Winsock, for the sockets the network reactor waits on.
+ *
+ * @details The rest of the calls (bind(), connect(), send(), recv(), ...) are
+ *          the same on both, as long as their buffers are passed as char
+ *          pointers and their sizes as ints.
+ */
+namespace NativeSocket
+{
+#if PLATFORM_WINDOWS
+static constexpr FReactorSocket INVALID = INVALID_SOCKET;
+static constexpr int SHUTDOWN_BOTH = SD_BOTH;
+// Windows doesn't raise SIGPIPE
+static constexpr int SEND_FLAGS = 0;
+#else
+static constexpr FReactorSocket INVALID = -1;
+static constexpr int SHUTDOWN_BOTH = SHUT_RDWR;
+#ifdef MSG_NOSIGNAL
+// don't raise SIGPIPE when sending to a connection the server closed
+static constexpr int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+// Apple platforms have SO_NOSIGPIPE instead, which open() sets
+static constexpr int SEND_FLAGS = 0;
+#endif
+#endif
+
+// The error of the last call which failed.
+inline int last_error()
+{
+#if PLATFORM_WINDOWS
+  return WSAGetLastError();
+#else
+  return errno;
+#endif
+}
+
+// True if the error is only that a non-blocking call would have blocked (or,
+// for connect(), is still in progress).
+inline bool would_block(int error)
+{
+#if PLATFORM_WINDOWS
+  return error == WSAEWOULDBLOCK || error == WSAEINPROGRESS || error == WSAEINTR;
+#else
+  return error == EAGAIN || error == EWOULDBLOCK || error == EINPROGRESS || error == EINTR;
+#endif
+}
+
+/**
+ * @brief Create a non-blocking IPv4 socket, which isn't inherited by child
+ *        processes.
+ * @param type SOCK_STREAM or SOCK_DGRAM.
+ * @return The socket, or INVALID if it couldn't be created (see last_error()).
+ */
+inline FReactorSocket open(int type)
+{
+#if PLATFORM_WINDOWS
+  FReactorSocket new_socket = ::WSASocketW(AF_INET, type, 0, nullptr, 0, WSA_FLAG_NO_HANDLE_INHERIT);
+  u_long non_blocking = 1;
+  if (new_socket != INVALID && ::ioctlsocket(new_socket, FIONBIO, &non_blocking) != 0) {
+    ::closesocket(new_socket);
+    return INVALID;
+  }
+  return new_socket;
+#elif PLATFORM_LINUX || PLATFORM_ANDROID
+  return ::socket(AF_INET, type | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+#else
+  FReactorSocket new_socket = ::socket(AF_INET, type, 0);
+  if (new_socket == INVALID) {
+    return INVALID;
+  }
+  if (::fcntl(new_socket, F_SETFL, ::fcntl(new_socket, F_GETFL) | O_NONBLOCK) < 0 ||
+      ::fcntl(new_socket, F_SETFD, FD_CLOEXEC) < 0) {
+    ::close(new_socket);
+    return INVALID;
+  }
+#ifdef SO_NOSIGPIPE
+  int no_sigpipe = 1;
+  ::setsockopt(new_socket, SOL_SOCKET, SO_NOSIGPIPE, &no_sigpipe, sizeof(no_sigpipe));
+#endif
+  return new_socket;
+#endif
+}
+
+inline void close(FReactorSocket socket)
+{
+#if PLATFORM_WINDOWS
+  ::closesocket(socket);
+#else
+  ::close(socket);
+#endif
+}
+
+/**
+ * @brief Receive a datagram, without waiting for one.
+ * @param socket The UDP socket.
+ * @param buffer The buffer to receive into.
+ * @param size The size of the buffer. The rest of a bigger datagram is
+ *        discarded.
+ * @return The number of bytes received (the size of the buffer if the
+ *         datagram was bigger), or -1 if none was pending (or on error).
+ */
+inline int receive_datagram(FReactorSocket socket, void *buffer, int size)
+{
+  int bytes_received = static_cast<int>(::recv(socket, static_cast<char *>(buffer), size, 0));
+#if PLATFORM_WINDOWS
+  // Windows fails to receive a datagram which is too big for the buffer,
+  // though it still fills the buffer with the start of it
+  if (bytes_received < 0 && WSAGetLastError() == WSAEMSGSIZE) {
+    bytes_received = size;
+  }
+#endif
+  return bytes_received;
+}
+
+/**
+ * @brief Wait until any of the sockets is ready.
+ * @param fds The sockets and the events to wait for. Their revents are set.
+ * @param count The number of sockets.
+ * @param timeout_ms How long to wait, or -1 to wait forever.
+ * @return The number of sockets which are ready, 0 if none were in time, or
+ *         -1 on error.
+ */
+inline int poll(pollfd *fds, int count, int timeout_ms)
+{
+#if PLATFORM_WINDOWS
+  return ::WSAPoll(fds, static_cast<ULONG>(count), timeout_ms);
+#else
+  return ::poll(fds, static_cast<nfds_t>(count), timeout_ms);
+#endif
+}
+} // namespace NativeSocket
+
+#endif
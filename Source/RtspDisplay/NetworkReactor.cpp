@@ -0,0 +1,410 @@
+#include "NetworkReactor.h"
+
+#include <vector>
+
+#include "HAL/Event.h"
+#include "HAL/PlatformProcess.h"
+#include "HAL/PlatformTime.h"
+
+#include "MyRunnable.h"
+
+#if RTSP_USE_EPOLL
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#elif RTSP_USE_POLL
+#include "NativeSocket.h"
+#else
+#include "Sockets.h"
+#endif
+
+// the most events dispatched per wakeup, the rest are picked up on the next
+static constexpr int MAX_EVENTS = 64;
+// how long the thread waits for events before checking if it should stop
+// anyway. stopping the thread wakes it up, so this is only a fallback
+static constexpr int WAIT_TIME_MS = 1000;
+// the id the wake up eventfd is registered with
+static constexpr uint64 WAKE_ID = ~0ull;
+
+#if RTSP_USE_EPOLL
+static uint32 to_epoll_events(uint32 events)
+{
+  return ((events & FNetworkReactor::Read) ? EPOLLIN : 0) | ((events & FNetworkReactor::Write) ? EPOLLOUT : 0);
+}
+#elif RTSP_USE_POLL
+static short to_poll_events(uint32 events)
+{
+  return static_cast<short>(((events & FNetworkReactor::Read) ? POLLIN : 0) |
+                            ((events & FNetworkReactor::Write) ? POLLOUT : 0));
+}
+
+// make a UDP socket on the loopback interface which is connected to itself,
+// so that whatever is sent to it can be received from it
+static FReactorSocket create_wake_socket()
+{
+  FReactorSocket wake_socket = NativeSocket::open(SOCK_DGRAM);
+  if (wake_socket == NativeSocket::INVALID) {
+    return NativeSocket::INVALID;
+  }
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = 0;
+  socklen_t addr_size = sizeof(addr);
+  if (::bind(wake_socket, reinterpret_cast<sockaddr *>(&addr), addr_size) != 0 ||
+      ::getsockname(wake_socket, reinterpret_cast<sockaddr *>(&addr), &addr_size) != 0 ||
+      ::connect(wake_socket, reinterpret_cast<sockaddr *>(&addr), addr_size) != 0) {
+    NativeSocket::close(wake_socket);
+    return NativeSocket::INVALID;
+  }
+  return wake_socket;
+}
+#endif
+
+FNetworkReactor::FNetworkReactor()
+{
+#if RTSP_USE_EPOLL
+  epoll_fd_ = ::epoll_create1(EPOLL_CLOEXEC);
+  wake_fd_ = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (epoll_fd_ < 0 || wake_fd_ < 0) {
+    UE_LOG(LogTemp, Error, TEXT("Network reactor: failed to create epoll set, errno = %d"), errno);
+    return;
+  }
+  epoll_event event = {};
+  event.events = EPOLLIN;
+  event.data.u64 = WAKE_ID;
+  ::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &event);
+#elif RTSP_USE_POLL
+  wake_socket_ = create_wake_socket();
+  if (wake_socket_ == NativeSocket::INVALID) {
+    UE_LOG(LogTemp, Error, TEXT("Network reactor: failed to create wake up socket, error = %d"),
+           NativeSocket::last_error());
+    return;
+  }
+#else
+  wake_event_ = FPlatformProcess::GetSynchEventFromPool(false);
+#endif
+  thread_ = new FMyRunnable([this]() { return run_once(); }, [this]() { wake(); });
+}
+
+FNetworkReactor::~FNetworkReactor()
+{
+  if (thread_) {
+    thread_->Stop();
+    delete thread_;
+    thread_ = nullptr;
+  }
+  if (!entries_.empty()) {
+    UE_LOG(LogTemp, Warning, TEXT("Network reactor: stopped with %d sockets still registered"),
+           static_cast<int32>(entries_.size()));
+  }
+#if RTSP_USE_EPOLL
+  if (epoll_fd_ >= 0) {
+    ::close(epoll_fd_);
+    epoll_fd_ = -1;
+  }
+  if (wake_fd_ >= 0) {
+    ::close(wake_fd_);
+    wake_fd_ = -1;
+  }
+#elif RTSP_USE_POLL
+  if (wake_socket_ != NativeSocket::INVALID) {
+    NativeSocket::close(wake_socket_);
+    wake_socket_ = NativeSocket::INVALID;
+  }
+#else
+  if (wake_event_) {
+    FPlatformProcess::ReturnSynchEventToPool(wake_event_);
+    wake_event_ = nullptr;
+  }
+#endif
+}
+
+bool FNetworkReactor::is_valid() const
+{
+  return thread_ != nullptr;
+}
+
+int32 FNetworkReactor::add(FReactorSocket socket, uint32 events, handler_t handler)
+{
+  if (!is_valid()) {
+    return -1;
+  }
+  std::lock_guard<std::recursive_mutex> lock(mutex_);
+  int32 id = next_id_++;
+#if RTSP_USE_EPOLL
+  // level triggered, so a handler which stops reading early (e.g. to give
+  // the other sockets a turn) is called again on the next wakeup
+  epoll_event event = {};
+  event.events = to_epoll_events(events);
+  event.data.u64 = static_cast<uint64>(id);
+  if (::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, socket, &event) < 0) {
+    UE_LOG(LogTemp, Error, TEXT("Network reactor: failed to add socket, errno = %d"), errno);
+    return -1;
+  }
+#endif
+  entries_[id] = std::make_shared<Entry>(Entry{socket, events, std::move(handler)});
+  num_sockets_ = static_cast<int32>(entries_.size());
+#if !RTSP_USE_EPOLL
+  wake();
+#endif
+  return id;
+}
+
+void FNetworkReactor::modify(int32 id, uint32 events)
+{
+  std::lock_guard<std::recursive_mutex> lock(mutex_);
+  auto it = entries_.find(id);
+  if (it == entries_.end()) {
+    return;
+  }
+  it->second->Events = events;
+#if RTSP_USE_EPOLL
+  epoll_event event = {};
+  event.events = to_epoll_events(events);
+  event.data.u64 = static_cast<uint64>(id);
+  ::epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, it->second->Socket, &event);
+#else
+  wake();
+#endif
+}
+
+void FNetworkReactor::set_deadline(int32 id, double deadline)
+{
+  std::lock_guard<std::recursive_mutex> lock(mutex_);
+  auto it = entries_.find(id);
+  if (it == entries_.end()) {
+    return;
+  }
+  it->second->Deadline = deadline;
+  if (deadline > 0 && (next_deadline_ == 0 || deadline < next_deadline_)) {
+    next_deadline_ = deadline;
+    // so that the thread doesn't sleep past it
+    wake();
+  }
+}
+
+void FNetworkReactor::remove(int32 id)
+{
+  // waits for the handler if it's running (on another thread)
+  std::lock_guard<std::recursive_mutex> lock(mutex_);
+  auto it = entries_.find(id);
+  if (it == entries_.end()) {
+    return;
+  }
+#if RTSP_USE_EPOLL
+  ::epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, it->second->Socket, nullptr);
+#endif
+  // a handler removing itself is still running, so it is kept alive by
+  // dispatch() until it returns
+  entries_.erase(it);
+  num_sockets_ = static_cast<int32>(entries_.size());
+}
+
+FNetworkReactor::Stats FNetworkReactor::get_stats() const
+{
+  Stats stats;
+  stats.Wakeups = wakeups_.load(std::memory_order_relaxed);
+  stats.Events = events_.load(std::memory_order_relaxed);
+  stats.LoopTimeUs = loop_time_us_.load(std::memory_order_relaxed);
+  stats.MaxLoopTimeUs = max_loop_time_us_.load(std::memory_order_relaxed);
+  stats.Sockets = num_sockets_.load(std::memory_order_relaxed);
+  return stats;
+}
+
+void FNetworkReactor::dispatch(int32 id, uint32 events)
+{
+  std::lock_guard<std::recursive_mutex> lock(mutex_);
+  auto it = entries_.find(id);
+  if (it == entries_.end()) {
+    // removed since the wait returned
+    return;
+  }
+  auto entry = it->second;
+  events &= entry->Events | Timeout;
+  if (events == None) {
+    return;
+  }
+  events_.fetch_add(1, std::memory_order_relaxed);
+  entry->Handler(events);
+}
+
+void FNetworkReactor::dispatch_timeouts()
+{
+  std::lock_guard<std::recursive_mutex> lock(mutex_);
+  double now = FPlatformTime::Seconds();
+  if (next_deadline_ == 0 || now < next_deadline_) {
+    return;
+  }
+  // clear the deadlines which have passed before calling their handlers,
+  // which may set new ones
+  std::vector<int32> expired;
+  next_deadline_ = 0;
+  for (auto &[id, entry] : entries_) {
+    if (entry->Deadline == 0) {
+      continue;
+    }
+    if (entry->Deadline <= now) {
+      entry->Deadline = 0;
+      expired.push_back(id);
+    } else if (next_deadline_ == 0 || entry->Deadline < next_deadline_) {
+      next_deadline_ = entry->Deadline;
+    }
+  }
+  for (auto id : expired) {
+    dispatch(id, Timeout);
+  }
+}
+
+int FNetworkReactor::get_wait_time_ms() const
+{
+  std::lock_guard<std::recursive_mutex> lock(mutex_);
+  if (next_deadline_ == 0) {
+    return WAIT_TIME_MS;
+  }
+  double remaining_ms = (next_deadline_ - FPlatformTime::Seconds()) * 1000.0;
+  return FMath::Clamp(static_cast<int>(FMath::CeilToDouble(remaining_ms)), 0, WAIT_TIME_MS);
+}
+
+bool FNetworkReactor::run_once()
+{
+  int num_dispatched = 0;
+  double start_time = 0;
+#if RTSP_USE_EPOLL
+  epoll_event events[MAX_EVENTS];
+  int num_events = ::epoll_wait(epoll_fd_, events, MAX_EVENTS, get_wait_time_ms());
+  start_time = FPlatformTime::Seconds();
+  for (int i = 0; i < num_events; i++) {
+    if (events[i].data.u64 == WAKE_ID) {
+      uint64_t value = 0;
+      (void)::read(wake_fd_, &value, sizeof(value));
+      continue;
+    }
+    // errors and hangups are reported as whatever the handler waits for, so
+    // that it finds out with its next read or write
+    uint32 ready = 0;
+    if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+      ready |= Read;
+    }
+    if (events[i].events & (EPOLLOUT | EPOLLERR | EPOLLHUP)) {
+      ready |= Write;
+    }
+    dispatch(static_cast<int32>(events[i].data.u64), ready);
+    num_dispatched++;
+  }
+#elif RTSP_USE_POLL
+  // the set of sockets may have changed since the last wait, so gather it
+  // again. they're waited on even if their handler is removed before the wait
+  // returns, as dispatch() skips any which aren't registered any more
+  poll_fds_.resize(1);
+  poll_fds_[0].fd = wake_socket_;
+  poll_fds_[0].events = POLLIN;
+  poll_ids_.clear();
+  {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    for (auto &[id, entry] : entries_) {
+      short events = to_poll_events(entry->Events);
+      if (events == 0) {
+        continue;
+      }
+      pollfd poll_fd = {};
+      poll_fd.fd = entry->Socket;
+      poll_fd.events = events;
+      poll_fds_.push_back(poll_fd);
+      poll_ids_.push_back(id);
+    }
+  }
+  for (auto &poll_fd : poll_fds_) {
+    poll_fd.revents = 0;
+  }
+  int num_events = NativeSocket::poll(poll_fds_.data(), static_cast<int>(poll_fds_.size()), get_wait_time_ms());
+  start_time = FPlatformTime::Seconds();
+  if (num_events < 0 && !NativeSocket::would_block(NativeSocket::last_error())) {
+    // e.g. a socket which was closed after it was removed, so don't spin on
+    // it; the set is gathered again next time
+    FPlatformProcess::Sleep(0.001f);
+  }
+  if (num_events > 0 && poll_fds_[0].revents != 0) {
+    // drain the wake ups
+    char buffer[64];
+    while (::recv(wake_socket_, buffer, static_cast<int>(sizeof(buffer)), 0) > 0) {
+    }
+  }
+  for (size_t i = 1; num_events > 0 && i < poll_fds_.size(); i++) {
+    short revents = poll_fds_[i].revents;
+    if (revents == 0) {
+      continue;
+    }
+    // errors and hangups are reported as whatever the handler waits for, so
+    // that it finds out with its next read or write
+    uint32 ready = 0;
+    if (revents & (POLLIN | POLLERR | POLLHUP | POLLNVAL)) {
+      ready |= Read;
+    }
+    if (revents & (POLLOUT | POLLERR | POLLHUP | POLLNVAL)) {
+      ready |= Write;
+    }
+    dispatch(poll_ids_[i - 1], ready);
+    num_dispatched++;
+  }
+#else
+  // FSockets can't be waited on together, so poll each of them
+  std::vector<std::pair<int32, std::shared_ptr<Entry>>> entries;
+  {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    entries.assign(entries_.begin(), entries_.end());
+  }
+  start_time = FPlatformTime::Seconds();
+  for (auto &[id, entry] : entries) {
+    uint32 ready = 0;
+    if ((entry->Events & Read) && entry->Socket->Wait(ESocketWaitConditions::WaitForRead, FTimespan::Zero())) {
+      ready |= Read;
+    }
+    if ((entry->Events & Write) && entry->Socket->Wait(ESocketWaitConditions::WaitForWrite, FTimespan::Zero())) {
+      ready |= Write;
+    }
+    if (ready != None) {
+      dispatch(id, ready);
+      num_dispatched++;
+    }
+  }
+  if (num_dispatched == 0) {
+    dispatch_timeouts();
+    // only a millisecond at most, as the sockets can't wake the thread up
+    wake_event_->Wait(FTimespan::FromMilliseconds(FMath::Min(get_wait_time_ms(), 1)));
+    return false;
+  }
+#endif
+  dispatch_timeouts();
+  if (num_dispatched > 0) {
+    uint64 loop_time_us = static_cast<uint64>((FPlatformTime::Seconds() - start_time) * 1e6);
+    wakeups_.fetch_add(1, std::memory_order_relaxed);
+    loop_time_us_.fetch_add(loop_time_us, std::memory_order_relaxed);
+    if (loop_time_us > max_loop_time_us_.load(std::memory_order_relaxed)) {
+      max_loop_time_us_.store(loop_time_us, std::memory_order_relaxed);
+    }
+  }
+
+  // don't want to stop the thread
+  return false;
+}
+
+void FNetworkReactor::wake()
+{
+#if RTSP_USE_EPOLL
+  if (wake_fd_ >= 0) {
+    uint64_t value = 1;
+    (void)::write(wake_fd_, &value, sizeof(value));
+  }
+#elif RTSP_USE_POLL
+  if (wake_socket_ != NativeSocket::INVALID) {
+    // if the socket's buffer is full, the thread is already being woken up
+    char value = 1;
+    (void)::send(wake_socket_, &value, 1, 0);
+  }
+#else
+  if (wake_event_) {
+    wake_event_->Trigger();
+  }
+#endif
+}
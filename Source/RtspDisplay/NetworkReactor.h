@@ -0,0 +1,184 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "CoreMinimal.h"
+
+#if PLATFORM_LINUX || PLATFORM_ANDROID
+#define RTSP_USE_EPOLL 1
+#else
+#define RTSP_USE_EPOLL 0
+#endif
+
+// the other platforms with BSD sockets wait on them with poll() (WSAPoll()
+// on Windows)
+#if !RTSP_USE_EPOLL && (PLATFORM_WINDOWS || PLATFORM_MAC || PLATFORM_IOS)
+#define RTSP_USE_POLL 1
+#else
+#define RTSP_USE_POLL 0
+#endif
+
+#define RTSP_USE_NATIVE_SOCKETS (RTSP_USE_EPOLL || RTSP_USE_POLL)
+
+class FEvent;
+class FMyRunnable;
+class FSocket;
+struct pollfd;
+
+#if RTSP_USE_NATIVE_SOCKETS && PLATFORM_WINDOWS
+// the reactor waits on native sockets, which are a SOCKET on Windows
+typedef UPTRINT FReactorSocket;
+#elif RTSP_USE_NATIVE_SOCKETS
+// the reactor waits on native sockets
+typedef int FReactorSocket;
+#else
+typedef FSocket *FReactorSocket;
+#endif
+
+/**
+ * @brief One network thread which waits on any number of sockets at once and
+ *        calls the handler of each socket that is ready.
+ *
+ * @details The sockets are native sockets where there are any. On Linux
+ *          (and Android) they are waited on together in one epoll set, along
+ *          with an eventfd which wakes the thread up (e.g. to stop). On
+ *          Windows and Apple platforms they are waited on together with
+ *          poll() (WSAPoll() on Windows), along with a loopback UDP socket
+ *          which a byte is sent to to wake the thread up. FSockets can't be
+ *          waited on together, so on any other platform the thread checks
+ *          each of them in turn, and when none of them are ready waits on an
+ *          event until the next deadline, for a millisecond at most. Either
+ *          way the number of threads stays the same however many sockets
+ *          there are.
+ *
+ *          The handlers run on the reactor thread, one at a time, so they must
+ *          never block: they should only do non-blocking I/O and hand any
+ *          real work to other threads. A handler which is waiting for
+ *          something to happen by a certain time (e.g. a response to a
+ *          request) sets a deadline, and is called with Timeout if the
+ *          deadline passes first.
+ */
+class FNetworkReactor
+{
+public:
+  // the readiness a handler is called for
+  enum EEvents : uint32
+  {
+    None = 0,
+    Read = 1 << 0,
+    Write = 1 << 1,
+    // the socket's deadline (see set_deadline()) has passed
+    Timeout = 1 << 2,
+  };
+
+  // called on the reactor thread with the events the socket is ready for
+  typedef std::function<void(uint32 events)> handler_t;
+
+  struct Stats
+  {
+    uint64 Wakeups = 0;       // times the thread woke up with events to dispatch
+    uint64 Events = 0;        // socket events dispatched
+    uint64 LoopTimeUs = 0;    // time spent dispatching the events, in total
+    uint64 MaxLoopTimeUs = 0; // longest time spent dispatching the events of one wakeup
+    int32 Sockets = 0;        // sockets currently registered
+  };
+
+  // Start the reactor thread.
+  FNetworkReactor();
+
+  // Stop the reactor thread. Every socket should have been removed by now.
+  ~FNetworkReactor();
+
+  // True if the reactor thread is running.
+  bool is_valid() const;
+
+  /**
+   * @brief Start waiting on a socket.
+   * @param socket The socket, which must stay open until it is removed.
+   * @param events The events (EEvents) to call the handler for.
+   * @param handler Called on the reactor thread when the socket is ready.
+   * @return An id for the socket, or -1 if it couldn't be added.
+   */
+  int32 add(FReactorSocket socket, uint32 events, handler_t handler);
+
+  /**
+   * @brief Change the events a socket's handler is called for.
+   * @param id The id add() returned.
+   * @param events The events (EEvents) to call the handler for.
+   */
+  void modify(int32 id, uint32 events);
+
+  /**
+   * @brief Stop waiting on a socket. Once this returns, its handler isn't
+   *        running and won't be called again, so whatever it uses may be
+   *        destroyed. May be called from the socket's own handler.
+   * @param id The id add() returned.
+   */
+  void remove(int32 id);
+
+  /**
+   * @brief Call a socket's handler with Timeout once a deadline passes,
+   *        whatever events it is waiting for. The deadline is cleared when it
+   *        passes, so it only fires once.
+   * @param id The id add() returned.
+   * @param deadline The deadline, in FPlatformTime::Seconds(), or 0 for none.
+   */
+  void set_deadline(int32 id, double deadline);
+
+  Stats get_stats() const;
+
+protected:
+  struct Entry
+  {
+    FReactorSocket Socket;
+    uint32 Events;
+    handler_t Handler;
+    double Deadline = 0;
+  };
+
+  bool run_once();
+
+  void dispatch(int32 id, uint32 events);
+
+  void dispatch_timeouts();
+
+  int get_wait_time_ms() const;
+
+  void wake();
+
+  // guards the entries, and is held while a handler runs so that remove()
+  // waits for it. recursive so that handlers can modify or remove themselves
+  mutable std::recursive_mutex mutex_;
+  std::unordered_map<int32, std::shared_ptr<Entry>> entries_;
+  int32 next_id_ = 0;
+  // the earliest deadline of the entries, or 0 for none, so that they only
+  // have to be checked once it has passed
+  double next_deadline_ = 0;
+
+#if RTSP_USE_EPOLL
+  int epoll_fd_ = -1;
+  int wake_fd_ = -1;
+#elif RTSP_USE_POLL
+  // a UDP socket connected to itself, which wake() sends a byte to
+  FReactorSocket wake_socket_ = static_cast<FReactorSocket>(-1); // NativeSocket::INVALID
+  // the sockets being waited on, with the wake socket first, and the ids of
+  // the rest. only used by the reactor thread
+  std::vector<pollfd> poll_fds_;
+  std::vector<int32> poll_ids_;
+#else
+  FEvent *wake_event_ = nullptr;
+#endif
+
+  FMyRunnable *thread_ = nullptr;
+
+  std::atomic<uint64> wakeups_{0};
+  std::atomic<uint64> events_{0};
+  std::atomic<uint64> loop_time_us_{0};
+  std::atomic<uint64> max_loop_time_us_{0};
+  std::atomic<int32> num_sockets_{0};
+};
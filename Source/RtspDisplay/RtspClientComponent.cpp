@@ -1,19 +1,72 @@
 #include "RtspClientComponent.h"
 
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
 #include "Async/Async.h"
-#include "Common/TcpSocketBuilder.h"
-#include "Common/UdpSocketBuilder.h"
+#include "Engine/Texture2D.h"
 #include "GenericPlatform/GenericPlatformHttp.h"
 #include "IImageWrapper.h"
 #include "IImageWrapperModule.h"
 #include "Interfaces/IPv4/IPv4Address.h"
-#include "Sockets.h"
-#include "SocketSubsystem.h"
-#include "SocketTypes.h"
+#include "RenderingThread.h"
+#include "RHI.h"
+#include "TextureResource.h"
 
 #include "MyRunnable.h"
+#include "RtspDecodeSubsystem.h"
+#include "RtspNetworkSubsystem.h"
+#include "TcpConnection.h"
+#include "UdpBatchReceiver.h"
+
+#include "jpeg_reassembler.hpp"
+
+// kernel receive buffer sizes for the rtp and rtcp sockets
+static constexpr int RTP_RECEIVE_BUFFER_SIZE = 4 * 1024 * 1024;
+static constexpr int RTCP_RECEIVE_BUFFER_SIZE = 64 * 1024;
+// how much of the rtsp responses is received at once
+static constexpr int RTSP_RECEIVE_SIZE = 4 * 1024;
+// how long the pipeline threads wait for work before checking if they should
+// stop anyway. stopping a thread wakes it up, so this is only a fallback
+static const FTimespan RECEIVE_WAIT_TIME = FTimespan::FromSeconds(1);
+// how many batches of rtp packets a stream receives each time its socket is
+// ready, so that one busy stream can't hold up the others on the network
+// thread. the rest are received on its next wakeup
+static constexpr int MAX_RTP_BATCHES_PER_EVENT = 4;
+// how many decoded images may wait for their target display time
+static constexpr size_t MAX_SCHEDULED_IMAGES = 3;
+// how many images' worth of staging buffers there are: the one being decoded
+// into, the one published to the game thread, those waiting to be shown,
+// those whose upload the render thread hasn't gotten to yet, and the decoder
+// benchmark's scratch image
+static constexpr size_t STAGING_POOL_IMAGES = MAX_SCHEDULED_IMAGES + 5;
+
+// the scale (as a divisor of the frame size) the native decoder decodes at
+static int get_decoder_scale(ERtspDecodeScale decode_scale) {
+  switch (decode_scale) {
+  case ERtspDecodeScale::Half:
+    return 2;
+  case ERtspDecodeScale::Quarter:
+    return 4;
+  case ERtspDecodeScale::Eighth:
+    return 8;
+  case ERtspDecodeScale::Full:
+  default:
+    return 1;
+  }
+}
 
-#include "jpeg_frame.hpp"
+// make a texture for displaying decoded images (or one of their planes),
+// which is then updated in place with UpdateTextureRegions
+static UTexture2D *create_texture(int width, int height, EPixelFormat format, bool srgb, TextureFilter filter) {
+  auto texture = UTexture2D::CreateTransient(width, height, format);
+  texture->SRGB = srgb;
+  texture->Filter = filter;
+  texture->NeverStream = true;
+  texture->UpdateResource();
+  return texture;
+}
 
 URtspClientComponent::URtspClientComponent() {
   PrimaryComponentTick.bCanEverTick = true;
@@ -31,44 +84,121 @@ void URtspClientComponent::EndPlay(const EEndPlayReason::Type EndPlayReason) {
 void URtspClientComponent::TickComponent(float DeltaTime, enum ELevelTick TickType,
                                          FActorComponentTickFunction *ThisTickFunction) {
   Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
-  // if there's not a new frame, return
-  if (!image_data_ready_) {
+  update_decode_settings();
+  if (!image_buffer_) {
     return;
   }
-  // if we've got a new frame, let's get it
-  std::vector<uint8_t> data;
-  size_t width = 0;
-  size_t height = 0;
-  {
-    // copy the latest frame, which was set by the worker thread
-    std::unique_lock<std::mutex> lock(image_mutex_);
-    data.assign(image_data_.begin(), image_data_.end());
-    image_data_ready_ = false;
-    width = image_width_;
-    height = image_height_;
-  }
-
-  UE_LOG(LogTemp, Log, TEXT("URtspClientComponent::TickComponent: Got a new frame, size = %d"), data.size());
-
-  // now convert the jpeg frame into a texture and broadcast it
-  // create a texture
-  auto texture = UTexture2D::CreateTransient(width, height, PF_B8G8R8A8);
-  // lock the texture
-  uint8 *mip_data = static_cast<uint8 *>(texture->GetPlatformData()->Mips[0].BulkData.Lock(LOCK_READ_WRITE));
-  // copy the jpeg data into the texture
-  std::copy(data.data(), data.data() + data.size(), mip_data);
-  // unlock the texture
-  texture->GetPlatformData()->Mips[0].BulkData.Unlock();
-  // update the texture
-  texture->UpdateResource();
-  // broadcast the texture
-  OnFrameReceived.Broadcast(texture);
+  // take the newest image the decoder has published; any it published before
+  // it were overwritten, since they'd only be shown for no time at all
+  bool updated = image_buffer_->update();
+  if (!presentation_scheduler_) {
+    // no playout delay, so show it right away
+    if (updated) {
+      present_image(std::move(image_buffer_->front()));
+    }
+    return;
+  }
+  // otherwise hold it until its target display time, and show whichever
+  // image is due on this tick
+  using Clock = espp::PresentationScheduler<DecodedImage>::Clock;
+  if (updated) {
+    auto &image = image_buffer_->front();
+    uint32_t rtp_timestamp = image.rtp_timestamp;
+    auto ready_time = image.ready_time;
+    presentation_scheduler_->push(std::move(image), rtp_timestamp, ready_time);
+  }
+  auto tick_interval = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<float>(DeltaTime));
+  if (auto image = presentation_scheduler_->pop(Clock::now(), tick_interval)) {
+    present_image(std::move(*image));
+  }
 }
 
-std::string URtspClientComponent::send_request(const std::string& method, const std::string& path,
-                                     const std::unordered_map<std::string, std::string>& extra_headers,
-                                     std::error_code& ec) {
-  // send the request
+void URtspClientComponent::present_image(DecodedImage image) {
+  UE_LOG(LogTemp, Log, TEXT("URtspClientComponent::TickComponent: Got a new frame, size = %d"),
+         image.data.size() + image.cb.size() + image.cr.size());
+
+  // hand its staging buffers to the render thread to upload to the textures,
+  // and broadcast them. the pixels aren't touched on the game thread
+  bool planar = image.planar;
+  update_textures(image);
+  upload_image(std::move(image));
+  if (mark_startup(STARTUP_FIRST_PRESENT)) {
+    UE_LOG(LogTemp, Display,
+           TEXT("First frame shown %.1f ms after connecting: connect %.1f ms, describe %.1f ms, setup %.1f ms, "
+                "play %.1f ms, first packet %.1f ms, first frame %.1f ms, decode %.1f ms, present %.1f ms"),
+           get_startup_ms(STARTUP_BEGIN, STARTUP_FIRST_PRESENT), get_startup_ms(STARTUP_CONNECTED),
+           get_startup_ms(STARTUP_DESCRIBED), get_startup_ms(STARTUP_SET_UP), get_startup_ms(STARTUP_PLAYING),
+           get_startup_ms(STARTUP_FIRST_PACKET), get_startup_ms(STARTUP_FIRST_FRAME),
+           get_startup_ms(STARTUP_FIRST_DECODE), get_startup_ms(STARTUP_FIRST_PRESENT));
+  }
+  if (planar) {
+    OnPlanarFrameReceived.Broadcast(textures_[0], textures_[1], textures_[2]);
+  } else {
+    OnFrameReceived.Broadcast(textures_[0]);
+  }
+}
+
+void URtspClientComponent::update_textures(const DecodedImage &image) {
+  auto matches = [](UTexture2D *texture, int width, int height, EPixelFormat format) {
+    return texture && texture->GetSizeX() == width && texture->GetSizeY() == height &&
+           texture->GetPixelFormat() == format;
+  };
+  if (image.planar) {
+    if (textures_.Num() == 3 && matches(textures_[0], image.width, image.height, PF_G8) &&
+        matches(textures_[1], image.chroma_width, image.chroma_height, PF_G8)) {
+      return;
+    }
+    // the material converts the planes to RGB, so they are sampled as they
+    // are (not as sRGB), and the chroma is sampled without filtering to match
+    // JpegDecoder::convert_planes_to_bgra
+    textures_ = {
+        create_texture(image.width, image.height, PF_G8, false, TF_Default),
+        create_texture(image.chroma_width, image.chroma_height, PF_G8, false, TF_Nearest),
+        create_texture(image.chroma_width, image.chroma_height, PF_G8, false, TF_Nearest),
+    };
+  } else {
+    if (textures_.Num() == 1 && matches(textures_[0], image.width, image.height, PF_B8G8R8A8)) {
+      return;
+    }
+    textures_ = {create_texture(image.width, image.height, PF_B8G8R8A8, true, TF_Default)};
+  }
+  textures_created_ += textures_.Num();
+  UE_LOG(LogTemp, Log, TEXT("Created %d texture(s) for %d x %d frames"), textures_.Num(), image.width,
+         image.height);
+}
+
+void URtspClientComponent::upload_image(DecodedImage image) {
+  std::array<FTextureResource *, 3> resources{};
+  for (int i = 0; i < textures_.Num(); i++) {
+    resources[i] = textures_[i]->GetResource();
+  }
+  // the image moves into the render command, which uploads its planes
+  // straight from the staging buffers the decoder wrote them to. a texture
+  // that is replaced in the meantime only releases its resource after this
+  // command has run
+  ENQUEUE_RENDER_COMMAND(UploadRtspImage)
+  ([resources, image = std::move(image)](FRHICommandListImmediate &RHICmdList) {
+    auto upload = [](FTextureResource *resource, const espp::PacketBuffer &plane, int width, int height,
+                     int bytes_per_pixel) {
+      if (resource && resource->TextureRHI && plane) {
+        RHIUpdateTexture2D(resource->TextureRHI, 0, FUpdateTextureRegion2D(0, 0, 0, 0, width, height),
+                           width * bytes_per_pixel, plane.data());
+      }
+    };
+    if (image.planar) {
+      upload(resources[0], image.data, image.width, image.height, 1);
+      upload(resources[1], image.cb, image.chroma_width, image.chroma_height, 1);
+      upload(resources[2], image.cr, image.chroma_width, image.chroma_height, 1);
+    } else {
+      upload(resources[0], image.data, image.width, image.height, 4);
+    }
+    // the staging buffers go back to the pool for the decoder to reuse when
+    // the command is destroyed, right after it runs
+  });
+}
+
+std::string URtspClientComponent::make_request(const std::string &method, const std::string &path,
+                                               const std::unordered_map<std::string, std::string> &extra_headers) {
   std::string request = method + " " + path + " RTSP/1.0\r\n";
   request += "CSeq: " + std::to_string(cseq_) + "\r\n";
   if (session_id_.size() > 0) {
@@ -80,43 +210,27 @@ std::string URtspClientComponent::send_request(const std::string& method, const
   request += "User-Agent: rtsp-client\r\n";
   request += "Accept: application/sdp\r\n";
   request += "\r\n";
-  std::string response;
-
-  uint8_t buffer[1024];
-  int bytes_sent = 0;
-  int bytes_received = 0;
-  bool did_send = rtsp_socket_->Send((uint8_t *)request.c_str(), request.size(), bytes_sent);
-  if (!did_send) {
-    ec = std::make_error_code(std::errc::io_error);
-    UE_LOG(LogTemp, Error, TEXT("Failed to send request"));
-    return {};
-  }
-  if (bytes_sent <= 0) {
-    ec = std::make_error_code(std::errc::io_error);
-    UE_LOG(LogTemp, Error, TEXT("Failed to send request, bytes_sent = %d"), bytes_sent);
-    return {};
-  }
-  rtsp_socket_->Recv(buffer, sizeof(buffer), bytes_received, ESocketReceiveFlags::None);
-  if (bytes_received <= 0) {
-    ec = std::make_error_code(std::errc::io_error);
-    UE_LOG(LogTemp, Error, TEXT("Failed to receive response"));
-    return {};
-  }
-  response.assign(buffer, buffer + bytes_received);
-
-  // TODO: how to keep receiving until we get the full response?
-  // if (response.find("\r\n\r\n") != std::string::npos) {
-  //   break;
-  // }
-
-  // parse the response
-  UE_LOG(LogTemp, Log, TEXT("Response:\n%s"), *FString(response.c_str()));
-  if (!parse_response(response)) {
-    ec = std::make_error_code(std::errc::io_error);
-    UE_LOG(LogTemp, Error, TEXT("Failed to parse response"));
-    return {};
+  return request;
+}
+
+double URtspClientComponent::get_request_deadline() const {
+  return FPlatformTime::Seconds() + FMath::Max(RequestTimeoutMs, 1) / 1000.0;
+}
+
+bool URtspClientComponent::queue_request(ControlRequest request) {
+  if (rtsp_reactor_id_ < 0 || rtsp_closed_) {
+    UE_LOG(LogTemp, Error, TEXT("Cannot send %s request: not connected"), *FString(request.method.c_str()));
+    return false;
   }
-  return response;
+  request.deadline = get_request_deadline();
+  {
+    std::lock_guard<std::mutex> lock(control_mutex_);
+    control_requests_.push_back(std::move(request));
+  }
+  // the network thread sends it once the socket is writable (which it is
+  // unless the server has stopped reading), after the requests before it
+  reactor_->modify(rtsp_reactor_id_, FNetworkReactor::Read | FNetworkReactor::Write);
+  return true;
 }
 
 bool URtspClientComponent::connect() {
@@ -136,16 +250,13 @@ bool URtspClientComponent::connect_to_uri(FString uri) {
 }
 
 bool URtspClientComponent::connect_to_address(FString address, int port, FString path) {
-  if (IsConnected) {
+  if (IsConnected || rtsp_connection_) {
     UE_LOG(LogTemp, Warning, TEXT("Already connected, disconnecting first"));
     disconnect();
   }
 
   UE_LOG(LogTemp, Log, TEXT("Connecting to RTSP server at %s:%d%s"), *address, port, *path);
 
-  FString socket_name = FString::Printf(TEXT("RTSP Socket %s:%d"), *address, port);
-  rtsp_socket_ = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->CreateSocket(NAME_Stream, address, false);
-
   // save the rtsp address and port
   Address = address;
   Port = port;
@@ -160,60 +271,86 @@ bool URtspClientComponent::connect_to_address(FString address, int port, FString
     return false;
   }
 
-  rtsp_addr_ = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->CreateInternetAddr();
-  bool valid = false;
-  rtsp_addr_->SetIp(ip.Value);
-  rtsp_addr_->SetPort(port);
+  // every stream's sockets are handled by the one network thread
+  reactor_ = URtspNetworkSubsystem::get_engine_reactor();
+  if (!reactor_) {
+    UE_LOG(LogTemp, Error, TEXT("No RTSP network thread to connect with"));
+    return false;
+  }
 
-  // make a thread to receive rtp packets using the rtp_socket
-  connect_thread_ = new FMyRunnable(std::bind(&URtspClientComponent::connect_thread_func, this));
+  // start connecting without waiting for it. the network thread finishes
+  // connecting and sends the OPTIONS request once the socket is writable
+  rtsp_connection_ = std::make_unique<FTcpConnection>();
+  if (!rtsp_connection_->connect(ip.Value, port)) {
+    UE_LOG(LogTemp, Error, TEXT("Failed to connect to RTSP server"));
+    rtsp_connection_.reset();
+    return false;
+  }
+  rtsp_socket_connected_ = false;
+  requests_in_flight_.clear();
+  rtsp_reader_.reset();
+  session_id_.clear();
+  hint_width_ = 0;
+  hint_height_ = 0;
+  hint_frame_size_ = 0;
+  for (auto &startup_time : startup_times_) {
+    startup_time = 0;
+  }
+  mark_startup(STARTUP_BEGIN);
+  // the OPTIONS request is sent first, and its deadline is the deadline for
+  // connecting too
+  double deadline = get_request_deadline();
+  {
+    std::lock_guard<std::mutex> lock(control_mutex_);
+    control_requests_.clear();
+    control_requests_.push_back({"OPTIONS", "*", {}, deadline});
+  }
+  // the handler uses the id, so only wait for the socket once it's set
+  rtsp_closed_ = false;
+  int32 reactor_id = reactor_->add(rtsp_connection_->get_reactor_socket(), FNetworkReactor::None,
+                                   [this](uint32 events) { handle_rtsp_socket(events); });
+  if (reactor_id < 0) {
+    rtsp_connection_.reset();
+    return false;
+  }
+  rtsp_reactor_id_ = reactor_id;
+  reactor_->set_deadline(reactor_id, deadline);
+  reactor_->modify(reactor_id, FNetworkReactor::Write);
 
   return true;
 }
 
 void URtspClientComponent::disconnect() {
   UE_LOG(LogTemp, Log, TEXT("Disconnecting from RTSP server"));
-  // make sure we stop the connect thread if it's still runnning (and didn't
-  // connect)
-  if (connect_thread_) {
-    connect_thread_->Stop();
-    delete connect_thread_;
-    connect_thread_ = nullptr;
+  // make sure the network thread is done with the connection, and drop the
+  // requests it hasn't sent
+  remove_from_reactor(rtsp_reactor_id_);
+  {
+    std::lock_guard<std::mutex> lock(control_mutex_);
+    control_requests_.clear();
   }
+  requests_in_flight_.clear();
+  // stop the threads and sockets. open_stream() starts them before the
+  // server has answered, so they may be running even if it never did
+  stop_rtp_rtcp();
   if (!IsConnected) {
     UE_LOG(LogTemp, Warning, TEXT("Not connected, nothing to disconnect"));
+    rtsp_connection_.reset();
     return;
   }
-  // try to send the teardown request, but don't care if it fails
-  teardown();
+  // try to send the teardown request, but don't wait for its response or
+  // care if it fails
+  if (rtsp_connection_) {
+    std::string request = make_request("TEARDOWN", path_, {});
+    rtsp_connection_->send((const uint8_t *)request.c_str(), request.size(), FTimespan::Zero());
+  }
   IsConnected = false;
   IsPlaying = false;
   // stop the main socket
   UE_LOG(LogTemp, Log, TEXT("Stopping RTSP socket"));
-  if (rtsp_socket_) {
-    rtsp_socket_->Close();
-    delete rtsp_socket_;
-    rtsp_socket_ = nullptr;
-  }
-  // stop the threads
-  UE_LOG(LogTemp, Log, TEXT("Stopping RTP/RTCP threads"));
-  if (rtp_thread_) {
-    rtp_thread_->Stop();
-    delete rtp_thread_;
-  }
-  if (rtcp_thread_) {
-    rtcp_thread_->Stop();
-    delete rtcp_thread_;
-  }
-  // stop the sockets
-  UE_LOG(LogTemp, Log, TEXT("Stopping RTP/RTCP sockets"));
-  if (rtp_socket_) {
-    rtp_socket_->Close();
-    delete rtp_socket_;
-  }
-  if (rtcp_socket_) {
-    rtcp_socket_->Close();
-    delete rtcp_socket_;
+  if (rtsp_connection_) {
+    rtsp_connection_->shutdown();
+    rtsp_connection_.reset();
   }
   // Broadcast to the listeners
   OnDisconnected.Broadcast();
@@ -224,12 +361,250 @@ bool URtspClientComponent::describe() {
     UE_LOG(LogTemp, Error, TEXT("Cannot describe: not connected"));
     return false;
   }
-  std::error_code ec;
-  // send the describe request
-  auto response = send_request("DESCRIBE", path_, {}, ec);
-  if (ec) {
+  UE_LOG(LogTemp, Log, TEXT("Describing RTSP session"));
+  return queue_request({"DESCRIBE", path_});
+}
+
+bool URtspClientComponent::setup(int rtp_port, int rtcp_port) {
+  if (!IsConnected) {
+    UE_LOG(LogTemp, Error, TEXT("Cannot setup: not connected"));
+    return false;
+  }
+  UE_LOG(LogTemp, Log, TEXT("Setting up RTSP session on ports %d-%d"), rtp_port, rtcp_port);
+  // the pipeline is made (and the ports are bound) before the request is
+  // sent, so that it's ready for the first packet
+  if (!start_pipeline(rtp_port, rtcp_port)) {
+    return false;
+  }
+  std::unordered_map<std::string, std::string> extra_headers = {
+      {"Transport", "RTP/AVP;unicast;client_port=" + std::to_string(rtp_port) + "-" + std::to_string(rtcp_port)}};
+  return queue_request({"SETUP", path_, std::move(extra_headers)});
+}
+
+bool URtspClientComponent::open_stream(FString uri, int rtp_port, int rtcp_port) {
+  if (!connect_to_uri(uri)) {
+    return false;
+  }
+  UE_LOG(LogTemp, Log, TEXT("Opening RTSP stream on ports %d-%d"), rtp_port, rtcp_port);
+  // the network thread is already connecting, but nothing reaches the
+  // pipeline until the server is playing
+  if (!start_pipeline(rtp_port, rtcp_port)) {
+    disconnect();
+    return false;
+  }
+  fast_start_rtp_port_ = rtp_port;
+  fast_start_rtcp_port_ = rtcp_port;
+  // the server answers the pipelined requests in order, so DESCRIBE goes out
+  // right behind OPTIONS. SETUP and PLAY follow from its response
+  ControlRequest describe_request{"DESCRIBE", path_};
+  describe_request.pipelined = true;
+  describe_request.fast_start = true;
+  return queue_request(std::move(describe_request));
+}
+
+bool URtspClientComponent::start_pipeline(int rtp_port, int rtcp_port) {
+  // every stream's frames are decoded by the shared decode workers
+  decode_scheduler_ = URtspDecodeSubsystem::get_engine_scheduler();
+  if (!decode_scheduler_) {
+    UE_LOG(LogTemp, Error, TEXT("No RTSP decode workers to decode with"));
+    return false;
+  }
+  // make sure a previous session's receivers are gone before the packet
+  // pool they borrow from is (re)allocated
+  stop_rtp_rtcp();
+  size_t pool_size = FMath::Max(PacketPoolSize, 1);
+  size_t packet_size = FMath::Max(MaxPacketSize, 64);
+  if (!packet_pool_ || packet_pool_->get_stats().capacity != pool_size ||
+      packet_pool_->get_buffer_size() != packet_size) {
+    packet_pool_ = std::make_unique<espp::PacketBufferPool>(pool_size, packet_size);
+  }
+  // and start a new sequence of packets
+  reorder_buffer_ = std::make_unique<espp::ReorderBuffer<espp::PacketBuffer>>(
+      FMath::Max(ReorderBufferDepth, 1), std::chrono::milliseconds(FMath::Max(ReorderMaxDelayMs, 0)));
+  sequence_unwrapper_.reset();
+  reassembler_ = std::make_unique<espp::JpegReassembler>(FMath::Max(MaxFramesInFlight, 1));
+  packet_queue_ = std::make_unique<espp::SpscQueue<ReceivedPacket>>(pool_size);
+  using FrameMailbox = espp::FrameMailbox<espp::JpegFrame>;
+  FrameMailbox::Policy frame_drop_policy = FrameMailbox::Policy::DROP_OLDEST;
+  switch (FrameDropPolicy) {
+  case ERtspFrameDropPolicy::DropOldest:
+    frame_drop_policy = FrameMailbox::Policy::DROP_OLDEST;
+    break;
+  case ERtspFrameDropPolicy::DropNewest:
+    frame_drop_policy = FrameMailbox::Policy::DROP_NEWEST;
+    break;
+  case ERtspFrameDropPolicy::QueueN:
+    frame_drop_policy = FrameMailbox::Policy::QUEUE;
+    break;
+  }
+  size_t frame_queue_size = FMath::Max(FrameQueueSize, 1);
+  frame_mailbox_ = std::make_unique<FrameMailbox>(frame_drop_policy, frame_queue_size);
+  // room for every frame that can be queued plus the one being decoded
+  free_frame_queue_ = std::make_unique<espp::SpscQueue<std::unique_ptr<espp::JpegFrame>>>(frame_queue_size + 1);
+  if (PlayoutDelayMs > 0) {
+    presentation_scheduler_ = std::make_unique<espp::PresentationScheduler<DecodedImage>>(
+        std::chrono::milliseconds(PlayoutDelayMs), MAX_SCHEDULED_IMAGES);
+  }
+  image_buffer_ = std::make_unique<espp::TripleBuffer<DecodedImage>>();
+  packets_available_ = FPlatformProcess::GetSynchEventFromPool(false);
+  packet_queue_drops_ = 0;
+  streaming_decode_ = StreamingDecode;
+  update_decode_settings();
+  streaming_timestamp_.reset();
+  streaming_rows_ = 0;
+  if (!jpeg_decoder_) {
+    jpeg_decoder_ = std::make_unique<espp::JpegDecoder>();
+  }
+  // decode the slices of a frame (its restart intervals, and bands of rows of
+  // the conversion) on the decode workers too, which steal them when idle
+  auto scheduler = decode_scheduler_;
+  jpeg_decoder_->set_parallel_for([scheduler](int num_tasks, const std::function<void(int)> &task) {
+    scheduler->parallel_for(num_tasks, task);
+  });
+  {
+    std::unique_lock<std::mutex> lock(stats_mutex_);
+    rtp_stats_ = FRtspClientStats();
+  }
+  // size the new pipeline for the stream if it has already been described
+  hint_pending_ = hint_frame_size_ > 0;
+
+  // without its receivers the stream would play into nothing
+  if (!init_rtp(rtp_port) || !init_rtcp(rtcp_port)) {
+    stop_rtp_rtcp();
+    return false;
+  }
+  return true;
+}
+
+void URtspClientComponent::update_decode_settings() {
+  decoder_backend_ = DecoderBackend;
+  decode_scale_ = get_decoder_scale(DecodeScale);
+  planar_output_ = OutputFormat == ERtspOutputFormat::YUVPlanar;
+}
+
+bool URtspClientComponent::play() {
+  if (!IsConnected) {
+    UE_LOG(LogTemp, Error, TEXT("Cannot play: not connected"));
+    return false;
+  }
+  UE_LOG(LogTemp, Log, TEXT("Playing RTSP session"));
+  return queue_request({"PLAY", path_});
+}
+
+bool URtspClientComponent::pause() {
+  if (!IsConnected) {
+    UE_LOG(LogTemp, Error, TEXT("Cannot pause: not connected"));
+    return false;
+  }
+  UE_LOG(LogTemp, Log, TEXT("Pausing RTSP session"));
+  return queue_request({"PAUSE", path_});
+}
+
+bool URtspClientComponent::teardown() {
+  if (!IsConnected) {
+    UE_LOG(LogTemp, Error, TEXT("Cannot teardown: not connected"));
+    return false;
+  }
+  UE_LOG(LogTemp, Log, TEXT("Tearing down RTSP session"));
+  return queue_request({"TEARDOWN", path_});
+}
+
+void URtspClientComponent::update_rtp_stats() {
+  const auto &reorder_stats = reorder_buffer_->get_stats();
+  std::unique_lock<std::mutex> lock(stats_mutex_);
+  rtp_stats_.ReorderDepth = static_cast<int32>(reorder_stats.depth);
+  rtp_stats_.ReorderMaxDepth = static_cast<int32>(reorder_stats.max_depth);
+  rtp_stats_.ReorderMaxDistance = static_cast<int32>(reorder_stats.max_reorder_distance);
+  rtp_stats_.RtpPacketsReordered = static_cast<int32>(reorder_stats.reordered);
+  rtp_stats_.RtpPacketsLate = static_cast<int32>(reorder_stats.late_drops + reorder_stats.duplicate_drops);
+  rtp_stats_.RtpPacketsLost = static_cast<int32>(reorder_stats.skipped);
+  const auto &reassembly_stats = reassembler_->get_stats();
+  rtp_stats_.FramesInFlight = static_cast<int32>(reassembly_stats.frames_in_flight);
+  rtp_stats_.FramesCompleted = static_cast<int32>(reassembly_stats.frames_completed);
+  rtp_stats_.FramesIncomplete = static_cast<int32>(reassembly_stats.frames_evicted);
+  rtp_stats_.RtpPacketsLate += static_cast<int32>(reassembly_stats.packets_late);
+}
+
+void URtspClientComponent::benchmark_decoders(int iterations) {
+  // the next decode task runs it on its frame, so that the benchmark
+  // doesn't race with the decoding
+  benchmark_iterations_ = FMath::Max(iterations, 1);
+}
+
+FRtspClientStats URtspClientComponent::get_stats() const {
+  FRtspClientStats stats;
+  {
+    // the stats which are owned by the reassembly thread and decode tasks
+    std::unique_lock<std::mutex> lock(stats_mutex_);
+    stats = rtp_stats_;
+  }
+  if (packet_pool_) {
+    auto pool_stats = packet_pool_->get_stats();
+    stats.PacketPoolCapacity = static_cast<int32>(pool_stats.capacity);
+    stats.PacketPoolInUse = static_cast<int32>(pool_stats.in_use);
+    stats.PacketPoolHighWaterMark = static_cast<int32>(pool_stats.high_water_mark);
+    stats.PacketPoolExhaustedCount = static_cast<int32>(pool_stats.exhausted_count);
+  }
+  if (packet_queue_) {
+    stats.PacketQueueDepth = static_cast<int32>(packet_queue_->size());
+    stats.PacketQueueMaxDepth = static_cast<int32>(packet_queue_->max_size());
+    auto mailbox_stats = frame_mailbox_->get_stats();
+    stats.FrameQueueDepth = static_cast<int32>(frame_mailbox_->size());
+    stats.FrameQueueMaxDepth = static_cast<int32>(frame_mailbox_->max_size());
+    stats.FrameQueueDrops = static_cast<int32>(mailbox_stats.rejected);
+    stats.FramesReplaced = static_cast<int32>(mailbox_stats.replaced);
+    stats.ImagesSkipped = static_cast<int32>(image_buffer_->get_overwritten());
+  }
+  if (presentation_scheduler_) {
+    const auto &presentation_stats = presentation_scheduler_->get_stats();
+    stats.ImagesSkipped += static_cast<int32>(presentation_stats.frames_skipped);
+    stats.PresentationJitterMs = presentation_stats.jitter_ms;
+    stats.FramesPresentedEarly = static_cast<int32>(presentation_stats.frames_early);
+    stats.FramesPresentedLate = static_cast<int32>(presentation_stats.frames_late);
+    stats.ClockDriftPpm = presentation_stats.drift_ppm;
+  }
+  if (decode_stream_ >= 0) {
+    auto decode_stats = decode_scheduler_->get_stream_stats(decode_stream_);
+    if (decode_stats.Tasks > 0) {
+      stats.AverageDecodeTimeMs = decode_stats.RunTimeUs / 1000.0f / decode_stats.Tasks;
+      stats.DecodeQueueWaitMs = decode_stats.QueueWaitUs / 1000.0f / decode_stats.Tasks;
+    }
+    stats.DecodeQueueMaxWaitMs = decode_stats.MaxQueueWaitUs / 1000.0f;
+  }
+  stats.TimeToFirstFrameMs = get_startup_ms(STARTUP_BEGIN, STARTUP_FIRST_PRESENT);
+  stats.StartupConnectMs = get_startup_ms(STARTUP_CONNECTED);
+  stats.StartupDescribeMs = get_startup_ms(STARTUP_DESCRIBED);
+  stats.StartupSetupMs = get_startup_ms(STARTUP_SET_UP);
+  stats.StartupPlayMs = get_startup_ms(STARTUP_PLAYING);
+  stats.StartupFirstPacketMs = get_startup_ms(STARTUP_FIRST_PACKET);
+  stats.StartupFirstFrameMs = get_startup_ms(STARTUP_FIRST_FRAME);
+  stats.StartupDecodeMs = get_startup_ms(STARTUP_FIRST_DECODE);
+  stats.StartupPresentMs = get_startup_ms(STARTUP_FIRST_PRESENT);
+  stats.PacketQueueDrops = packet_queue_drops_;
+  stats.TexturesCreated = textures_created_;
+  if (rtp_receiver_) {
+    auto receiver_stats = rtp_receiver_->get_stats();
+    stats.RtpPacketsReceived = static_cast<int32>(receiver_stats.Packets);
+    stats.RtpPacketsTruncated = static_cast<int32>(receiver_stats.Truncated);
+    stats.RtpPacketsPerSyscall = rtp_receiver_->get_packets_per_syscall();
+  }
+  return stats;
+}
+
+bool URtspClientComponent::parse_response(const espp::RtspResponseReader::Response &response) {
+  // the reader has already parsed the status line and headers
+  if (response.status_code != 200) {
+    UE_LOG(LogTemp, Error, TEXT("Invalid response code: %d"), response.status_code);
     return false;
   }
+  // save the session id if present
+  if (!response.session.empty()) {
+    session_id_ = std::string(response.session);
+  }
+  return true;
+}
+
+bool URtspClientComponent::parse_sdp(const std::string &response) {
   // sdp response is of the form:
   //     std::regex sdp_regex("m=video (\\d+) RTP/AVP (\\d+)");
   // parse the sdp response and get the video port without using regex
@@ -266,307 +641,886 @@ bool URtspClientComponent::describe() {
   auto payload_type = sdp.substr(payload_type_start + 1, sdp.size() - payload_type_start - 1);
   video_payload_type_ = std::stoi(payload_type);
   UE_LOG(LogTemp, Log, TEXT("Video payload type: %d"), video_payload_type_);
-  return true;
-}
 
-bool URtspClientComponent::setup(int rtp_port, int rtcp_port) {
-  if (!IsConnected) {
-    UE_LOG(LogTemp, Error, TEXT("Cannot setup: not connected"));
-    return false;
+  // the size of the frames, if the server says, so that the pipeline can be
+  // sized for them before they arrive. e.g. "a=framesize:26 640-480" or
+  // "a=x-dimensions:640,480", with "a=framerate:30" and "b=AS:<kbps>"
+  auto find_attribute = [&response](const char *attribute) -> const char * {
+    auto start = response.find(attribute);
+    return start == std::string::npos ? nullptr : response.c_str() + start + std::strlen(attribute);
+  };
+  char *end = nullptr;
+  int width = 0;
+  int height = 0;
+  if (auto framesize = find_attribute("a=framesize:")) {
+    // skip the payload type
+    std::strtol(framesize, &end, 10);
+    width = std::strtol(end, &end, 10);
+    height = *end == '-' ? std::strtol(end + 1, &end, 10) : 0;
+  } else if (auto dimensions = find_attribute("a=x-dimensions:")) {
+    width = std::strtol(dimensions, &end, 10);
+    height = *end == ',' ? std::strtol(end + 1, &end, 10) : 0;
   }
-  UE_LOG(LogTemp, Log, TEXT("Setting up RTSP session on ports %d-%d"), rtp_port, rtcp_port);
-  std::error_code ec;
-  // send the setup request
-  std::unordered_map<std::string, std::string> extra_headers = {
-      {"Transport", "RTP/AVP;unicast;client_port=" + std::to_string(rtp_port) + "-" + std::to_string(rtcp_port)}};
-  auto response = send_request("SETUP", path_, extra_headers, ec);
-  if (ec) {
-    UE_LOG(LogTemp, Error, TEXT("Failed to setup"));
-    return false;
+  auto framerate = find_attribute("a=framerate:");
+  double frames_per_second = framerate ? std::strtod(framerate, nullptr) : 0;
+  auto bandwidth = find_attribute("b=AS:");
+  double kilobits_per_second = bandwidth ? std::strtod(bandwidth, nullptr) : 0;
+  int frame_size = 0;
+  if (kilobits_per_second > 0 && frames_per_second > 0) {
+    frame_size = static_cast<int>(kilobits_per_second * 1000 / 8 / frames_per_second);
+  } else if (width > 0 && height > 0) {
+    // about 2 bits per pixel, which covers most qualities
+    frame_size = width * height / 4;
   }
-
-  init_rtp(rtp_port);
-  init_rtcp(rtcp_port);
-
+  if (width > 0 && height > 0) {
+    hint_width_ = width;
+    hint_height_ = height;
+    UE_LOG(LogTemp, Log, TEXT("Video size: %d x %d, about %d B per frame"), width, height, frame_size);
+  }
+  hint_frame_size_ = frame_size;
   return true;
 }
 
-bool URtspClientComponent::play() {
-  if (!IsConnected) {
-    UE_LOG(LogTemp, Error, TEXT("Cannot play: not connected"));
+bool URtspClientComponent::init_rtp(size_t rtp_port) {
+  FString socket_name = FString::Printf(TEXT("RTP Socket %d"), rtp_port);
+  // the kernel buffer has to be able to absorb a whole frame's burst of
+  // packets while the rtp thread is busy
+  rtp_receiver_ = std::make_unique<FUdpBatchReceiver>(socket_name, rtp_port, RTP_RECEIVE_BUFFER_SIZE, *packet_pool_);
+  if (!rtp_receiver_->is_valid()) {
+    UE_LOG(LogTemp, Error, TEXT("Failed to create RTP socket on port %d"), rtp_port);
+    rtp_receiver_.reset();
     return false;
   }
-  UE_LOG(LogTemp, Log, TEXT("Playing RTSP session"));
-  std::error_code ec;
-  // send the play request
-  auto response = send_request("PLAY", path_, {}, ec);
-  IsPlaying = ec ? false : true;
-  if (IsPlaying) {
-    OnPlay.Broadcast();
+  UE_LOG(LogTemp, Log, TEXT("RTP port: %d"), rtp_port);
+  // start each stage of the pipeline after the receive stage, starting from
+  // the end so that every stage is running before anything is sent to it.
+  // the frames are decoded on the shared decode workers, or with streaming
+  // decode on the reassembly thread
+  if (!streaming_decode_) {
+    decode_stream_ = decode_scheduler_->add_stream(DecodePriority);
   }
-  return !ec;
+  reassembly_thread_ = new FMyRunnable(std::bind(&URtspClientComponent::reassembly_thread_func, this),
+                                       [this]() { packets_available_->Trigger(); });
+  // the network thread receives the rtp packets whenever the socket is ready
+  rtp_reactor_id_ = reactor_->add(rtp_receiver_->get_reactor_socket(), FNetworkReactor::Read,
+                                  [this](uint32 events) { handle_rtp_socket(events); });
+  return rtp_reactor_id_ >= 0;
 }
 
-bool URtspClientComponent::pause() {
-  if (!IsConnected) {
-    UE_LOG(LogTemp, Error, TEXT("Cannot pause: not connected"));
+bool URtspClientComponent::init_rtcp(size_t rtcp_port) {
+  FString socket_name = FString::Printf(TEXT("RTCP Socket %d"), rtcp_port);
+  rtcp_receiver_ = std::make_unique<FUdpBatchReceiver>(socket_name, rtcp_port, RTCP_RECEIVE_BUFFER_SIZE, *packet_pool_);
+  if (!rtcp_receiver_->is_valid()) {
+    UE_LOG(LogTemp, Error, TEXT("Failed to create RTCP socket on port %d"), rtcp_port);
+    rtcp_receiver_.reset();
     return false;
   }
-  UE_LOG(LogTemp, Log, TEXT("Pausing RTSP session"));
-  std::error_code ec;
-  // send the pause request
-  auto response = send_request("PAUSE", path_, {}, ec);
-  IsPlaying = ec ? true : false;
-  if (!IsPlaying) {
-    OnPause.Broadcast();
+  UE_LOG(LogTemp, Log, TEXT("RTCP port: %d"), rtcp_port);
+  // the network thread receives the rtcp packets whenever the socket is ready
+  rtcp_reactor_id_ = reactor_->add(rtcp_receiver_->get_reactor_socket(), FNetworkReactor::Read,
+                                   [this](uint32 events) { handle_rtcp_socket(events); });
+  return rtcp_reactor_id_ >= 0;
+}
+
+void URtspClientComponent::stop_rtp_rtcp() {
+  // stop receiving before the receivers are destroyed, then stop the threads
+  // in pipeline order so that no stage is stopped while the one before it is
+  // still feeding it
+  UE_LOG(LogTemp, Log, TEXT("Stopping RTP/RTCP threads"));
+  remove_from_reactor(rtp_reactor_id_);
+  remove_from_reactor(rtcp_reactor_id_);
+  if (reassembly_thread_) {
+    reassembly_thread_->Stop();
+    delete reassembly_thread_;
+    reassembly_thread_ = nullptr;
+  }
+  if (decode_stream_ >= 0) {
+    // drops the frames still waiting for a worker, and waits for the one
+    // being decoded
+    decode_scheduler_->remove_stream(decode_stream_);
+    decode_stream_ = -1;
+  }
+  UE_LOG(LogTemp, Log, TEXT("Stopping RTP/RTCP sockets"));
+  rtp_receiver_.reset();
+  rtcp_receiver_.reset();
+  // drop any packets, frames and images still in the pipeline
+  packet_queue_.reset();
+  reorder_buffer_.reset();
+  reassembler_.reset();
+  frame_mailbox_.reset();
+  free_frame_queue_.reset();
+  // images still waiting to be uploaded keep the staging pool alive
+  presentation_scheduler_.reset();
+  image_buffer_.reset();
+  staging_pool_.reset();
+  if (packets_available_) {
+    FPlatformProcess::ReturnSynchEventToPool(packets_available_);
+    packets_available_ = nullptr;
   }
-  return !ec;
 }
 
-bool URtspClientComponent::teardown() {
-  if (!IsConnected) {
-    UE_LOG(LogTemp, Error, TEXT("Cannot teardown: not connected"));
-    return false;
+void URtspClientComponent::remove_from_reactor(std::atomic<int32> &reactor_id) {
+  // called on the game thread. once removed, the handler isn't running and
+  // won't be called again
+  int32 id = reactor_id.exchange(-1);
+  if (id >= 0 && reactor_) {
+    reactor_->remove(id);
   }
-  UE_LOG(LogTemp, Log, TEXT("Tearing down RTSP session"));
-  std::error_code ec;
-  // send the teardown request
-  auto response = send_request("TEARDOWN", path_, {}, ec);
-  IsPlaying = false;
-  return !ec;
 }
 
-bool URtspClientComponent::parse_response(const std::string &response) {
-  if (response.empty()) {
-    UE_LOG(LogTemp, Error, TEXT("Empty response"));
-    return false;
+void URtspClientComponent::handle_rtsp_socket(uint32 events) {
+  // called on the network thread: first when the socket is writable once the
+  // connection is made (or has failed), then whenever a response arrives, a
+  // request is queued, or the deadline of a request passes
+  if (rtsp_closed_) {
+    // e.g. a request was queued just as it was closed
+    reactor_->modify(rtsp_reactor_id_, FNetworkReactor::None);
+    return;
+  }
+  if (!rtsp_socket_connected_ && (events & (FNetworkReactor::Read | FNetworkReactor::Write))) {
+    if (!rtsp_connection_->finish_connect()) {
+      close_rtsp_connection(TEXT("Could not connect"));
+      return;
+    }
+    UE_LOG(LogTemp, Log, TEXT("RTSP socket connected"));
+    rtsp_socket_connected_ = true;
+    mark_startup(STARTUP_CONNECTED);
+  }
+  if ((events & FNetworkReactor::Read) && !receive_responses()) {
+    return;
+  }
+  fail_expired_requests();
+  if (rtsp_closed_) {
+    // the connection timed out
+    return;
+  }
+  if (rtsp_socket_connected_ && !send_requests()) {
+    return;
   }
 
-  auto response_start = response.find("RTSP/1.0 ");
-  if (response_start == std::string::npos) {
-    UE_LOG(LogTemp, Error, TEXT("Invalid response"));
-    return false;
+  // wait for the connection to be made, or for the responses, until the
+  // earliest deadline of the requests
+  double deadline = 0;
+  auto earliest = [&deadline](const ControlRequest &request) {
+    if (deadline == 0 || request.deadline < deadline) {
+      deadline = request.deadline;
+    }
+  };
+  std::for_each(requests_in_flight_.begin(), requests_in_flight_.end(), earliest);
+  {
+    std::lock_guard<std::mutex> lock(control_mutex_);
+    std::for_each(control_requests_.begin(), control_requests_.end(), earliest);
   }
-  // parse the status code and message
-  auto response_end = response.find("\r\n", response_start);
-  if (response_end == std::string::npos) {
-    UE_LOG(LogTemp, Error, TEXT("Incomplete response"));
-    return false;
+  reactor_->set_deadline(rtsp_reactor_id_, deadline);
+  reactor_->modify(rtsp_reactor_id_, rtsp_socket_connected_ ? FNetworkReactor::Read : FNetworkReactor::Write);
+}
+
+bool URtspClientComponent::send_requests() {
+  // send the queued requests in order: each once the one before it is
+  // answered, or right away if it may be pipelined
+  while (true) {
+    ControlRequest request;
+    {
+      std::lock_guard<std::mutex> lock(control_mutex_);
+      if (control_requests_.empty() || (!requests_in_flight_.empty() && !control_requests_.front().pipelined)) {
+        return true;
+      }
+      request = std::move(control_requests_.front());
+      control_requests_.pop_front();
+    }
+    // the session and cseq are only known here, once the requests before it
+    // are answered
+    request.cseq = cseq_;
+    std::string text = make_request(request.method, request.path, request.extra_headers);
+    cseq_++;
+    // the requests are small and only a few are sent at once, so they fit in
+    // the socket's send buffer
+    if (!rtsp_connection_->send((const uint8_t *)text.c_str(), text.size(), FTimespan::Zero())) {
+      fail_request(request, TEXT("Could not send the request"));
+      close_rtsp_connection(TEXT("Could not send a request"));
+      return false;
+    }
+    requests_in_flight_.push_back(std::move(request));
   }
-  auto response_code = response.substr(response_start + 9, response_end - response_start - 9);
-  if (response_code != "200 OK") {
-    UE_LOG(LogTemp, Error, TEXT("Invalid response code: %s"), *FString(response_code.c_str()));
-    return false;
+}
+
+bool URtspClientComponent::receive_responses() {
+  // receive whatever has arrived straight into the reader's buffer, which
+  // grows to hold a response however big it is
+  while (true) {
+    uint8_t *buffer = rtsp_reader_.prepare(RTSP_RECEIVE_SIZE);
+    int bytes_received = rtsp_connection_->receive(buffer, RTSP_RECEIVE_SIZE, FTimespan::Zero());
+    if (bytes_received == 0) {
+      break;
+    }
+    if (bytes_received < 0) {
+      close_rtsp_connection(TEXT("The server closed the connection"));
+      return false;
+    }
+    rtsp_reader_.commit(bytes_received);
   }
-  // parse the session id if present
-  auto session_start = response.find("Session: ");
-  if (session_start != std::string::npos) {
-    session_id_ = response.substr(session_start + 9, response.find("\r\n", session_start) - session_start - 9);
+  // handle every complete response: the headers, and the body if there is
+  // one (e.g. the sdp). the rest of a partial one stays in the reader
+  while (auto response = rtsp_reader_.next()) {
+    handle_response(*response);
+    if (rtsp_closed_) {
+      return false;
+    }
+  }
+  if (rtsp_reader_.has_error()) {
+    close_rtsp_connection(TEXT("Received an invalid response"));
+    return false;
   }
-  // increment the cseq
-  cseq_++;
   return true;
 }
 
-void URtspClientComponent::init_rtp(size_t rtp_port) {
-  if (rtp_socket_) {
-    rtp_socket_->Close();
-    delete rtp_socket_;
+void URtspClientComponent::handle_response(const espp::RtspResponseReader::Response &response) {
+  UE_LOG(LogTemp, Log, TEXT("Response:\n%s"), *FString(static_cast<int32>(response.text.size()), response.text.data()));
+  // the responses come in the order the requests were sent, so a response
+  // without a cseq is taken to be for the oldest request in flight
+  int cseq = response.cseq;
+  auto in_flight = requests_in_flight_.begin();
+  if (cseq >= 0) {
+    in_flight = std::find_if(requests_in_flight_.begin(), requests_in_flight_.end(),
+                             [cseq](const ControlRequest &request) { return request.cseq == cseq; });
   }
-  FString socket_name = FString::Printf(TEXT("RTP Socket %d"), rtp_port);
-  rtp_socket_ = FUdpSocketBuilder(*socket_name)
-                    .AsReusable()
-                    .BoundToPort(rtp_port)
-                    .WithReceiveBufferSize(6 * 1024)
-                    .WithSendBufferSize(6 * 1024)
-                    .Build();
-  UE_LOG(LogTemp, Log, TEXT("RTP port: %d"), rtp_port);
-  // make a thread to receive rtp packets using the rtp_socket
-  rtp_thread_ = new FMyRunnable(std::bind(&URtspClientComponent::rtp_thread_func, this));
+  if (in_flight == requests_in_flight_.end()) {
+    // e.g. the response to a request that timed out
+    UE_LOG(LogTemp, Warning, TEXT("Ignoring response with CSeq %d, which isn't for a request in flight"), cseq);
+    return;
+  }
+  auto request = std::move(*in_flight);
+  requests_in_flight_.erase(in_flight);
+  if (!parse_response(response)) {
+    fail_request(request, FString(static_cast<int32>(response.status_line.size()), response.status_line.data()));
+    return;
+  }
+  finish_request(request, response);
 }
 
-void URtspClientComponent::init_rtcp(size_t rtcp_port) {
-  if (rtcp_socket_) {
-    rtcp_socket_->Close();
-    delete rtcp_socket_;
+void URtspClientComponent::finish_request(const ControlRequest &request,
+                                          const espp::RtspResponseReader::Response &response) {
+  // the state the listeners see is updated on the game thread, along with
+  // broadcasting to them
+  if (request.method == "OPTIONS") {
+    run_on_game_thread([this]() {
+      // unless it was disconnected in the meantime
+      if (rtsp_reactor_id_ >= 0 && !rtsp_closed_) {
+        IsConnected = true;
+        OnConnected.Broadcast();
+      }
+    });
+  } else if (request.method == "DESCRIBE") {
+    if (!parse_sdp(std::string(response.body))) {
+      fail_request(request, TEXT("Invalid SDP"));
+      return;
+    }
+    mark_startup(STARTUP_DESCRIBED);
+    if (request.fast_start) {
+      // set up the session right away, ahead of anything queued since
+      ControlRequest setup_request{"SETUP", path_};
+      setup_request.extra_headers["Transport"] = "RTP/AVP;unicast;client_port=" +
+                                                 std::to_string(fast_start_rtp_port_) + "-" +
+                                                 std::to_string(fast_start_rtcp_port_);
+      setup_request.deadline = get_request_deadline();
+      setup_request.fast_start = true;
+      std::lock_guard<std::mutex> lock(control_mutex_);
+      control_requests_.push_front(std::move(setup_request));
+    }
+    if (hint_frame_size_ > 0) {
+      // the reassembly thread sizes the pipeline for the stream before it
+      // handles the first packet
+      hint_pending_ = true;
+    }
+    run_on_game_thread([this]() { OnDescribed.Broadcast(true); });
+  } else if (request.method == "SETUP") {
+    mark_startup(STARTUP_SET_UP);
+    if (request.fast_start) {
+      // and play it as soon as there's a session to play
+      ControlRequest play_request{"PLAY", path_};
+      play_request.deadline = get_request_deadline();
+      std::lock_guard<std::mutex> lock(control_mutex_);
+      control_requests_.push_front(std::move(play_request));
+    }
+    run_on_game_thread([this]() { OnSetupComplete.Broadcast(true); });
+  } else if (request.method == "PLAY") {
+    mark_startup(STARTUP_PLAYING);
+    run_on_game_thread([this]() {
+      IsPlaying = true;
+      OnPlay.Broadcast();
+    });
+  } else if (request.method == "PAUSE") {
+    run_on_game_thread([this]() {
+      IsPlaying = false;
+      OnPause.Broadcast();
+    });
+  } else if (request.method == "TEARDOWN") {
+    run_on_game_thread([this]() { IsPlaying = false; });
   }
-  FString socket_name = FString::Printf(TEXT("RTCP Socket %d"), rtcp_port);
-  rtcp_socket_ = FUdpSocketBuilder(*socket_name)
-    .AsReusable()
-    .BoundToPort(rtcp_port)
-    .WithReceiveBufferSize(6 * 1024)
-    .WithSendBufferSize(6 * 1024)
-    .Build();
-  UE_LOG(LogTemp, Log, TEXT("RTCP port: %d"), rtcp_port);
-  // make a thread to receive rtcp packets using the rtcp_socket
-  rtcp_thread_ = new FMyRunnable(std::bind(&URtspClientComponent::rtcp_thread_func, this));
 }
 
-bool URtspClientComponent::connect_thread_func() {
-  // now connect
-  if (!rtsp_socket_->Connect(*rtsp_addr_)) {
-    UE_LOG(LogTemp, Error, TEXT("Failed to connect to RTSP server"));
-    // go ahead and stop the thread early
-    return true;
+void URtspClientComponent::fail_request(const ControlRequest &request, const FString &reason) {
+  FString method(request.method.c_str());
+  UE_LOG(LogTemp, Error, TEXT("%s request failed: %s"), *method, *reason);
+  run_on_game_thread([this, method, reason]() {
+    if (method == TEXT("DESCRIBE")) {
+      OnDescribed.Broadcast(false);
+    } else if (method == TEXT("SETUP")) {
+      OnSetupComplete.Broadcast(false);
+    }
+    OnRequestFailed.Broadcast(method, reason);
+  });
+  if (request.method == "OPTIONS") {
+    // couldn't connect
+    close_rtsp_connection(reason);
   }
+}
 
-  auto conn_state = rtsp_socket_->GetConnectionState();
-  switch (conn_state) {
-  case ESocketConnectionState::SCS_NotConnected:
-    UE_LOG(LogTemp, Error, TEXT("RTSP socket not connected"));
-    // go ahead and stop the thread early
-    return true;
-  case ESocketConnectionState::SCS_Connected:
-    UE_LOG(LogTemp, Log, TEXT("RTSP socket connected"));
-    break;
-  case ESocketConnectionState::SCS_ConnectionError:
-    UE_LOG(LogTemp, Error, TEXT("RTSP socket connection error"));
-    // go ahead and stop the thread early
-    return true;
+void URtspClientComponent::fail_expired_requests() {
+  double now = FPlatformTime::Seconds();
+  std::vector<ControlRequest> expired;
+  auto take_expired = [now, &expired](std::deque<ControlRequest> &requests) {
+    for (auto it = requests.begin(); it != requests.end();) {
+      if (it->deadline <= now) {
+        expired.push_back(std::move(*it));
+        it = requests.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  };
+  // the response to a request in flight may still arrive, but it won't match
+  // any other request's cseq
+  take_expired(requests_in_flight_);
+  {
+    std::lock_guard<std::mutex> lock(control_mutex_);
+    take_expired(control_requests_);
   }
+  for (const auto &request : expired) {
+    fail_request(request, TEXT("Timed out"));
+  }
+}
 
-  // update the state
-  IsConnected = true;
-
-  // can only broadcast events from the game thread, so use async with lambda
-  AsyncTask(ENamedThreads::GameThread, [this]() {
-    // notify the listeners
-    OnConnected.Broadcast();
+void URtspClientComponent::close_rtsp_connection(const FString &reason) {
+  // called on the network thread when the connection can't be used any more:
+  // fail every request, and stop handling the socket
+  if (rtsp_closed_) {
+    return;
+  }
+  rtsp_closed_ = true;
+  reactor_->set_deadline(rtsp_reactor_id_, 0);
+  reactor_->modify(rtsp_reactor_id_, FNetworkReactor::None);
+  UE_LOG(LogTemp, Error, TEXT("RTSP connection closed: %s"), *reason);
+  std::vector<ControlRequest> requests(std::make_move_iterator(requests_in_flight_.begin()),
+                                       std::make_move_iterator(requests_in_flight_.end()));
+  requests_in_flight_.clear();
+  {
+    std::lock_guard<std::mutex> lock(control_mutex_);
+    for (auto &request : control_requests_) {
+      requests.push_back(std::move(request));
+    }
+    control_requests_.clear();
+  }
+  for (const auto &request : requests) {
+    fail_request(request, reason);
+  }
+  // the game thread removes the socket (waiting for this handler to return
+  // if it hasn't yet) and stops the stream, unless it has already moved on
+  // to another connection
+  run_on_game_thread([this]() {
+    if (rtsp_closed_ && rtsp_reactor_id_ >= 0) {
+      disconnect();
+    }
   });
+}
+
+bool URtspClientComponent::mark_startup(StartupPhase phase) {
+  // only the first time each phase is reached counts
+  double not_reached = 0;
+  return startup_times_[phase].compare_exchange_strong(not_reached, FPlatformTime::Seconds());
+}
 
-  // send the OPTIONS request
-  std::error_code ec;
-  send_request("OPTIONS", "*", {}, ec);
-  if (ec) {
-    UE_LOG(LogTemp, Error, TEXT("Failed to send OPTIONS request"));
+float URtspClientComponent::get_startup_ms(StartupPhase from, StartupPhase to) const {
+  double from_time = startup_times_[from];
+  double to_time = startup_times_[to];
+  if (from_time == 0 || to_time == 0) {
+    return 0.0f;
   }
+  return static_cast<float>(FMath::Max(to_time - from_time, 0.0) * 1000.0);
+}
 
-  // we're done, so stop the thread
-  return true;
+float URtspClientComponent::get_startup_ms(StartupPhase phase) const {
+  // the time since the phase before it
+  return phase > STARTUP_BEGIN ? get_startup_ms(static_cast<StartupPhase>(phase - 1), phase) : 0.0f;
+}
+
+void URtspClientComponent::run_on_game_thread(TUniqueFunction<void()> function) {
+  // can only broadcast events from the game thread, so use async with lambda.
+  // the component may be destroyed before it runs
+  TWeakObjectPtr<URtspClientComponent> weak_this(this);
+  AsyncTask(ENamedThreads::GameThread, [weak_this, function = MoveTemp(function)]() {
+    if (weak_this.IsValid()) {
+      function();
+    }
+  });
 }
 
-bool URtspClientComponent::rtp_thread_func() {
-  // receive the rtp packet
-  size_t max_packet_size = 65536;
-  uint8_t *data = new uint8_t[max_packet_size];
-  int32 bytes_read = 0;
-  rtp_socket_->Recv(data, max_packet_size, bytes_read, ESocketReceiveFlags::None);
-  if (bytes_read > 0) {
-    std::vector<uint8_t> packet(data, data + bytes_read);
-    handle_rtp_packet(packet);
+void URtspClientComponent::handle_rtp_socket(uint32 events) {
+  // called on the network thread when the socket is readable: receive the
+  // packets which are available (up to a few batches) into buffers borrowed
+  // from the pool
+  auto now = ReorderClock::now();
+  int total_packets = 0;
+  espp::PacketBuffer packets[FUdpBatchReceiver::MAX_BATCH_SIZE];
+  for (int batch = 0; batch < MAX_RTP_BATCHES_PER_EVENT; batch++) {
+    int num_packets = rtp_receiver_->receive(packets, UE_ARRAY_COUNT(packets), FTimespan::Zero());
+    // hand them to the reassembly thread. the network thread never waits for
+    // the later stages, so if they fall behind the packets are dropped here
+    // rather than in the kernel
+    for (int i = 0; i < num_packets; i++) {
+      if (!packet_queue_->try_push({std::move(packets[i]), now})) {
+        packet_queue_drops_++;
+      }
+    }
+    total_packets += num_packets;
+    if (num_packets < FUdpBatchReceiver::MAX_BATCH_SIZE) {
+      break;
+    }
+  }
+  if (total_packets > 0) {
+    mark_startup(STARTUP_FIRST_PACKET);
+    packets_available_->Trigger();
   }
-  delete[] data;
+}
 
-  // Sleep the thread for a bit
-  FPlatformProcess::Sleep(0.005f);
+bool URtspClientComponent::reassembly_thread_func() {
+  // wait for packets, but not past the point where the reorder buffer gives
+  // up on a missing packet
+  auto packet = packet_queue_->try_pop();
+  if (!packet) {
+    auto wait_time = RECEIVE_WAIT_TIME;
+    if (auto deadline = reorder_buffer_->get_next_deadline()) {
+      auto remaining = std::chrono::duration_cast<std::chrono::microseconds>(*deadline - ReorderClock::now());
+      wait_time = FMath::Min(wait_time, FTimespan::FromMicroseconds(FMath::Max<int64>(remaining.count(), 0)));
+    }
+    packets_available_->Wait(wait_time);
+    packet = packet_queue_->try_pop();
+  }
+  if (hint_pending_.exchange(false)) {
+    apply_stream_hint();
+  }
+  // reuse the frames the decode tasks are done with
+  while (auto frame = free_frame_queue_->try_pop()) {
+    reassembler_->recycle(std::move(*frame));
+  }
+  // put every packet that has arrived in order and reassemble them
+  for (; packet; packet = packet_queue_->try_pop()) {
+    handle_rtp_packet(std::move(packet->buffer), packet->arrival_time);
+  }
+  // release any packets that have waited long enough for a missing packet
+  reorder_buffer_->release_expired(ReorderClock::now(), [this](espp::PacketBuffer &&packet) {
+    reassemble_rtp_packet(std::move(packet));
+  });
+  update_rtp_stats();
 
   // don't want to stop the thread
   return false;
 }
 
-bool URtspClientComponent::rtcp_thread_func() {
-  // receive the rtcp packet
-  size_t max_packet_size = 65536;
-  uint8_t *data = new uint8_t[max_packet_size];
-  int32 bytes_read = 0;
-  rtcp_socket_->Recv(data, max_packet_size, bytes_read, ESocketReceiveFlags::None);
-  if (bytes_read > 0) {
-    std::vector<uint8_t> packet(data, data + bytes_read);
-    handle_rtcp_packet(packet);
+void URtspClientComponent::apply_stream_hint() {
+  // runs on the reassembly thread once the stream has been described: the
+  // first frames' buffers are allocated at the described size instead of
+  // growing as their packets arrive, and the decoder is prepared where the
+  // frames are decoded, before the first one is
+  reassembler_->set_size_hint(hint_frame_size_);
+  int width = hint_width_;
+  int height = hint_height_;
+  if (width <= 0 || height <= 0) {
+    return;
+  }
+  if (streaming_decode_) {
+    prepare_decoder(width, height);
+  } else {
+    decode_scheduler_->submit(decode_stream_, [this, width, height]() { prepare_decoder(width, height); });
+  }
+}
+
+void URtspClientComponent::prepare_decoder(int width, int height) {
+  // allocate the decoder's planes and the staging buffers for the stream's
+  // images now, so that decoding the first frame doesn't have to
+  bool planar = false;
+  int scale = 1;
+  if (decoder_backend_ == ERtspDecoderBackend::Native) {
+    scale = decode_scale_;
+    jpeg_decoder_->set_scale(scale);
+    jpeg_decoder_->reserve(width, height);
+    planar = planar_output_;
   }
-  delete[] data;
+  int image_width = (width + scale - 1) / scale;
+  int image_height = (height + scale - 1) / scale;
+  ensure_staging_pool(static_cast<size_t>(image_width) * image_height * (planar ? 1 : 4), planar);
+  UE_LOG(LogTemp, Log, TEXT("Prepared the decoder for %d x %d images"), image_width, image_height);
+}
 
-  // Sleep the thread for a bit
-  FPlatformProcess::Sleep(0.005f);
+void URtspClientComponent::decode_next_frame() {
+  // runs on a decode worker, after this stream's earlier frames are done
+  auto frame = frame_mailbox_->try_pop();
+  if (!frame) {
+    return;
+  }
+  int benchmark_iterations = benchmark_iterations_.exchange(0);
+  if (benchmark_iterations > 0) {
+    run_decoder_benchmark(*frame, benchmark_iterations);
+  }
+  double start_time = FPlatformTime::Seconds();
+  // decode straight into the back buffer, which the game thread never touches
+  bool decoded = decode_jpeg_frame(*frame, image_buffer_->back(), decoder_backend_);
+  float decode_time_ms = static_cast<float>((FPlatformTime::Seconds() - start_time) * 1000.0);
+  publish_image(*frame, decoded, decode_time_ms);
+  // hand the frame back to be reused
+  free_frame_queue_->try_push(std::move(frame));
+}
 
-  // don't want to stop the thread
-  return false;
+void URtspClientComponent::handle_rtcp_socket(uint32 events) {
+  // called on the network thread when the socket is readable
+  espp::PacketBuffer packets[8];
+  int num_packets = rtcp_receiver_->receive(packets, UE_ARRAY_COUNT(packets), FTimespan::Zero());
+  for (int i = 0; i < num_packets; i++) {
+    handle_rtcp_packet(std::move(packets[i]));
+  }
 }
 
-void URtspClientComponent::handle_rtp_packet(std::vector<uint8_t> &data) {
-  // parse the rtp packet
-  // jpeg frame that we are building
-  static std::unique_ptr<espp::JpegFrame> jpeg_frame;
+void URtspClientComponent::handle_rtp_packet(espp::PacketBuffer packet, ReorderClock::time_point arrival_time) {
+  UE_LOG(LogTemp, Log, TEXT("Got RTP packet of size: %d"), packet.size());
 
-  UE_LOG(LogTemp, Log, TEXT("Got RTP packet of size: %d"), data.size());
+  // parse the rtp packet in place, without copying it
+  espp::RtpJpegPacketView rtp_jpeg_packet(packet.view());
+  if (!rtp_jpeg_packet.is_valid()) {
+    UE_LOG(LogTemp, Warning, TEXT("Received malformed RTP/JPEG packet of size: %d"), packet.size());
+    return;
+  }
+  // put the packet in sequence order, releasing it (and any packets that were
+  // waiting for it) to be reassembled once everything before it has arrived
+  int64_t sequence_number = sequence_unwrapper_.unwrap(rtp_jpeg_packet.get_sequence_number());
+  bool queued = reorder_buffer_->push(sequence_number, std::move(packet), arrival_time,
+                                      [this](espp::PacketBuffer &&ordered_packet) {
+                                        reassemble_rtp_packet(std::move(ordered_packet));
+                                      });
+  if (!queued) {
+    UE_LOG(LogTemp, Verbose, TEXT("Dropped late or duplicate RTP packet, sequence number: %d"),
+           rtp_jpeg_packet.get_sequence_number());
+  }
+}
 
-  std::string_view packet(reinterpret_cast<char *>(data.data()), data.size());
-  // parse the rtp packet
-  espp::RtpJpegPacket rtp_jpeg_packet(packet);
-  auto frag_offset = rtp_jpeg_packet.get_offset();
-  if (frag_offset == 0) {
-    // first fragment
-    UE_LOG(LogTemp, Log, TEXT("Received first fragment, size: %d, sequence number: %d"),
-           rtp_jpeg_packet.get_data().size(), rtp_jpeg_packet.get_sequence_number());
+void URtspClientComponent::reassemble_rtp_packet(espp::PacketBuffer packet) {
+  // the packet was validated before it went into the reorder buffer. the
+  // buffer goes back to the pool when this returns, once its scan data has
+  // been copied into the frame
+  espp::RtpJpegPacketView rtp_jpeg_packet(packet.view());
+  UE_LOG(LogTemp, Log, TEXT("Received fragment, offset: %d, size: %d, sequence number: %d"),
+         rtp_jpeg_packet.get_offset(), rtp_jpeg_packet.get_data().size(), rtp_jpeg_packet.get_sequence_number());
+
+  // the frame is complete once the last packet (the one with the marker bit
+  // set) and every packet before it have been received
+  auto jpeg_frame = reassembler_->add_packet(rtp_jpeg_packet);
+  if (jpeg_frame) {
+    mark_startup(STARTUP_FIRST_FRAME);
+  }
+  if (streaming_decode_) {
     if (jpeg_frame) {
-      // we already have a frame, this is an error
-      UE_LOG(LogTemp, Warning, TEXT("Received first fragment but already have a frame"));
-      jpeg_frame.reset();
+      finish_jpeg_frame(*jpeg_frame);
+      reassembler_->recycle(std::move(jpeg_frame));
+    } else if (decoder_backend_ == ERtspDecoderBackend::Native) {
+      // decode what has arrived of the newest frame so far. packets of older
+      // frames are left for the full decode once they complete (if they do)
+      auto partial_frame = reassembler_->get_newest_frame();
+      if (partial_frame && partial_frame->get_timestamp() == rtp_jpeg_packet.get_timestamp()) {
+        decode_partial_jpeg_frame(*partial_frame);
+      }
     }
-    jpeg_frame = std::make_unique<espp::JpegFrame>(rtp_jpeg_packet);
-  } else if (jpeg_frame) {
-    UE_LOG(LogTemp, Log, TEXT("Received middle fragment, size: %d, sequence number: %d"),
-           rtp_jpeg_packet.get_data().size(), rtp_jpeg_packet.get_sequence_number());
-    // middle fragment
-    jpeg_frame->append(rtp_jpeg_packet);
-  } else {
-    // we don't have a frame to append to but we got a middle fragment
-    // this is an error
-    UE_LOG(LogTemp, Warning, TEXT("Received middle fragment without a frame"));
     return;
   }
+  if (!jpeg_frame) {
+    return;
+  }
+  // and then it is decoded on a decode worker. if the decoder is falling
+  // behind, the mailbox drops a frame according to the frame drop policy
+  auto dropped_frame = frame_mailbox_->push(std::move(jpeg_frame));
+  if (dropped_frame) {
+    UE_LOG(LogTemp, Verbose, TEXT("Decoder is falling behind, dropped frame with timestamp %u"),
+           dropped_frame->get_timestamp());
+    reassembler_->recycle(std::move(dropped_frame));
+    // the mailbox was full, so there is already a decode queued for every
+    // frame in it
+    return;
+  }
+  decode_scheduler_->submit(decode_stream_, [this]() { decode_next_frame(); });
+}
 
-  // check if this is the last packet of the frame (the last packet will have
-  // the marker bit set)
-  if (jpeg_frame && jpeg_frame->is_complete()) {
-    // get the jpeg data
-    auto jpeg_data = jpeg_frame->get_data();
-    UE_LOG(LogTemp, Log, TEXT("Received jpeg frame of size: %d B (%d x %d pixels)"),
-           jpeg_data.size(), jpeg_frame->get_width(), jpeg_frame->get_height());
+bool URtspClientComponent::decode_partial_jpeg_frame(const espp::JpegFrame &jpeg_frame) {
+  if (streaming_timestamp_ != jpeg_frame.get_timestamp()) {
+    // a new frame, so start a new image in the back buffer
+    streaming_timestamp_ = jpeg_frame.get_timestamp();
+    streaming_rows_ = 0;
+    jpeg_decoder_->set_scale(decode_scale_);
+    image_buffer_->back().planar = planar_output_;
+  }
+  if (!jpeg_decoder_->decode_partial(jpeg_frame)) {
+    return false;
+  }
+  if (!jpeg_frame.has_q_tables()) {
+    // nothing has been decoded yet
+    return true;
+  }
+  // convert the rows which have been decoded since the last packet. if there
+  // is no staging memory for them yet, the decoder keeps them until there is
+  auto &image = image_buffer_->back();
+  if (!prepare_decoded_image(image)) {
+    return false;
+  }
+  int decoded_rows = jpeg_decoder_->get_decoded_rows();
+  if (decoded_rows > streaming_rows_) {
+    convert_decoded_rows(image, streaming_rows_, decoded_rows - streaming_rows_);
+    streaming_rows_ = decoded_rows;
+  }
+  return true;
+}
 
-    IImageWrapperModule& ImageWrapperModule = FModuleManager::LoadModuleChecked<IImageWrapperModule>(FName("ImageWrapper"));
-    auto image_format = ImageWrapperModule.DetectImageFormat(jpeg_data.data(), jpeg_data.size());
-    if (image_format == EImageFormat::Invalid) {
-      UE_LOG(LogTemp, Error, TEXT("Failed to detect image format"));
-      return;
+void URtspClientComponent::finish_jpeg_frame(const espp::JpegFrame &jpeg_frame) {
+  double start_time = FPlatformTime::Seconds();
+  bool decoded = false;
+  // read the copy once, so that both halves of the choice see the same
+  // backend. if it changed since the frame's first packets, a frame which
+  // wasn't partially decoded is decoded from its start by decode_partial
+  ERtspDecoderBackend backend = decoder_backend_;
+  if (backend == ERtspDecoderBackend::Native) {
+    // only the rest of the frame is left to decode
+    decoded = decode_partial_jpeg_frame(jpeg_frame) && streaming_rows_ == jpeg_decoder_->get_height();
+    if (!decoded) {
+      UE_LOG(LogTemp, Error, TEXT("Failed to decode jpeg frame (type %d)"), jpeg_frame.get_type());
     }
+  } else {
+    decoded = decode_jpeg_frame(jpeg_frame, image_buffer_->back(), backend);
+  }
+  streaming_timestamp_.reset();
+  float decode_time_ms = static_cast<float>((FPlatformTime::Seconds() - start_time) * 1000.0);
+  publish_image(jpeg_frame, decoded, decode_time_ms);
+  // the benchmark reuses the decoder, so run it once the frame is published
+  int benchmark_iterations = benchmark_iterations_.exchange(0);
+  if (benchmark_iterations > 0) {
+    run_decoder_benchmark(jpeg_frame, benchmark_iterations);
+  }
+}
 
-    TSharedPtr<IImageWrapper> ImageWrapper = ImageWrapperModule.CreateImageWrapper(image_format);
-    if (!ImageWrapper.IsValid()) {
-      UE_LOG(LogTemp, Error, TEXT("Failed to create image wrapper"));
-      return;
+void URtspClientComponent::publish_image(const espp::JpegFrame &jpeg_frame, bool decoded, float decode_time_ms) {
+  UE_LOG(LogTemp, Verbose, TEXT("Received jpeg frame of size: %d B (%d x %d pixels)"),
+         jpeg_frame.get_scan_data().size(), jpeg_frame.get_width(), jpeg_frame.get_height());
+  auto marker_to_ready = std::chrono::steady_clock::now() - jpeg_frame.get_completion_time();
+  {
+    std::unique_lock<std::mutex> lock(stats_mutex_);
+    if (decoded) {
+      rtp_stats_.FramesDecoded++;
+      rtp_stats_.DecodeTimeMs = decode_time_ms;
+      rtp_stats_.MarkerToReadyMs = std::chrono::duration<float, std::milli>(marker_to_ready).count();
+    } else {
+      rtp_stats_.DecodeErrors++;
     }
-
-    // decompress the jpeg data
-    if (!ImageWrapper->SetCompressed(jpeg_data.data(), jpeg_data.size())) {
-      UE_LOG(LogTemp, Error, TEXT("Failed to set compressed data"));
-      return;
+    if (staging_pool_) {
+      auto pool_stats = staging_pool_->get_stats();
+      rtp_stats_.StagingBuffersInUse = static_cast<int32>(pool_stats.in_use);
+      rtp_stats_.StagingPoolExhaustedCount = static_cast<int32>(pool_stats.exhausted_count);
     }
-    // Get the decompressed data
-    TArray<uint8> UncompressedBGRA;
-    if (!ImageWrapper->GetRaw(ERGBFormat::BGRA, 8, UncompressedBGRA)) {
-      UE_LOG(LogTemp, Error, TEXT("Failed to get raw data"));
-      return;
+  }
+  if (decoded) {
+    auto &image = image_buffer_->back();
+    image.rtp_timestamp = jpeg_frame.get_timestamp();
+    image.ready_time = std::chrono::steady_clock::now();
+    image_width_ = image.width;
+    image_height_ = image.height;
+    mark_startup(STARTUP_FIRST_DECODE);
+    // the game thread picks it up on its next tick
+    image_buffer_->publish();
+  }
+}
+
+bool URtspClientComponent::decode_jpeg_frame(const espp::JpegFrame &jpeg_frame, DecodedImage &image,
+                                             ERtspDecoderBackend backend) {
+  switch (backend) {
+  case ERtspDecoderBackend::Native:
+    return decode_jpeg_frame_native(jpeg_frame, image);
+  case ERtspDecoderBackend::ImageWrapper:
+  default:
+    return decode_jpeg_frame_image_wrapper(jpeg_frame, image);
+  }
+}
+
+bool URtspClientComponent::decode_jpeg_frame_native(const espp::JpegFrame &jpeg_frame, DecodedImage &image) {
+  // decode straight from the scan data and quantization tables, no header
+  // needed
+  jpeg_decoder_->set_scale(decode_scale_);
+  if (!jpeg_decoder_->decode(jpeg_frame)) {
+    UE_LOG(LogTemp, Error, TEXT("Failed to decode jpeg frame (type %d)"), jpeg_frame.get_type());
+    return false;
+  }
+  image.planar = planar_output_;
+  if (!prepare_decoded_image(image)) {
+    return false;
+  }
+  convert_decoded_rows(image, 0, image.height);
+  return true;
+}
+
+bool URtspClientComponent::prepare_decoded_image(DecodedImage &image) {
+  // size the image for the decoder's current frame
+  if (image.planar) {
+    return allocate_image(image, jpeg_decoder_->get_width(), jpeg_decoder_->get_height(),
+                          jpeg_decoder_->get_chroma_width(), jpeg_decoder_->get_chroma_height());
+  }
+  return allocate_image(image, jpeg_decoder_->get_width(), jpeg_decoder_->get_height(), 0, 0);
+}
+
+bool URtspClientComponent::allocate_image(DecodedImage &image, int width, int height, int chroma_width,
+                                          int chroma_height) {
+  size_t plane_size = static_cast<size_t>(width) * height * (image.planar ? 1 : 4);
+  size_t chroma_size = static_cast<size_t>(chroma_width) * chroma_height;
+  ensure_staging_pool(plane_size, image.planar);
+  if (image.pool != staging_pool_) {
+    // give the buffers back before letting go of the pool they came from
+    image.data.reset();
+    image.cb.reset();
+    image.cr.reset();
+    image.pool = staging_pool_;
+  }
+  // an image keeps its buffers from one frame to the next until it's
+  // uploaded, e.g. while a streaming decode fills it in
+  auto acquire = [this](espp::PacketBuffer &buffer, size_t size) {
+    if (!buffer) {
+      buffer = staging_pool_->acquire();
     }
-    size_t width = ImageWrapper->GetWidth();
-    size_t height = ImageWrapper->GetHeight();
-    auto rgb_data = UncompressedBGRA.GetData();
-    auto rgb_data_size = UncompressedBGRA.Num();
+    buffer.set_size(size);
+    return static_cast<bool>(buffer);
+  };
+  bool acquired = acquire(image.data, plane_size);
+  if (image.planar) {
+    acquired = acquire(image.cb, chroma_size) && acquire(image.cr, chroma_size) && acquired;
+  } else {
+    image.cb.reset();
+    image.cr.reset();
+  }
+  image.width = width;
+  image.height = height;
+  image.chroma_width = chroma_width;
+  image.chroma_height = chroma_height;
+  if (!acquired) {
+    UE_LOG(LogTemp, Warning, TEXT("No free staging buffer to decode into, the render thread is falling behind"));
+  }
+  return acquired;
+}
 
-    std::unique_lock<std::mutex> lock(image_mutex_);
-    image_data_.clear();
-    image_data_.reserve(rgb_data_size);
-    image_data_.assign(rgb_data, rgb_data + rgb_data_size);
-    image_width_ = jpeg_frame->get_width();
-    image_height_ = jpeg_frame->get_height();
-    image_data_ready_ = true;
-    // now reset the jpeg_frame
-    jpeg_frame.reset();
+void URtspClientComponent::convert_decoded_rows(DecodedImage &image, int first_row, int num_rows) {
+  if (image.planar) {
+    jpeg_decoder_->copy_planes(image.data.data(), image.cb.data(), image.cr.data(), first_row, num_rows);
+  } else {
+    jpeg_decoder_->convert_to_bgra(image.data.data(), static_cast<size_t>(image.width) * 4, first_row, num_rows);
   }
 }
 
-void URtspClientComponent::handle_rtcp_packet(std::vector<uint8_t> &data) {
-  UE_LOG(LogTemp, Log, TEXT("Got RTCP packet of size: %d"), data.size());
+void URtspClientComponent::ensure_staging_pool(size_t plane_size, bool planar) {
+  size_t num_buffers = STAGING_POOL_IMAGES * (planar ? 3 : 1);
+  if (!staging_pool_ || staging_pool_->get_buffer_size() != plane_size ||
+      staging_pool_->get_stats().capacity != num_buffers) {
+    // every buffer is big enough for the largest plane. buffers still held by
+    // images of the old size keep the old pool alive until they come back
+    staging_pool_ = std::make_shared<espp::PacketBufferPool>(num_buffers, plane_size);
+  }
+}
+
+bool URtspClientComponent::decode_jpeg_frame_image_wrapper(const espp::JpegFrame &jpeg_frame, DecodedImage &image) {
+  TArray<uint8> UncompressedBGRA;
+  int width = 0;
+  int height = 0;
+  if (!decompress_jpeg_frame_image_wrapper(jpeg_frame, UncompressedBGRA, width, height)) {
+    return false;
+  }
+  // it decodes into its own buffer, so copy the pixels into staging memory
+  image.planar = false;
+  if (!allocate_image(image, width, height, 0, 0)) {
+    return false;
+  }
+  FMemory::Memcpy(image.data.data(), UncompressedBGRA.GetData(),
+                  FMath::Min<size_t>(image.data.size(), UncompressedBGRA.Num()));
+  return true;
+}
+
+bool URtspClientComponent::decompress_jpeg_frame_image_wrapper(const espp::JpegFrame &jpeg_frame,
+                                                               TArray<uint8> &UncompressedBGRA, int &width,
+                                                               int &height) {
+  // get the jpeg data, with its synthesized header
+  auto jpeg_data = jpeg_frame.get_data();
+
+  IImageWrapperModule& ImageWrapperModule = FModuleManager::LoadModuleChecked<IImageWrapperModule>(FName("ImageWrapper"));
+  auto image_format = ImageWrapperModule.DetectImageFormat(jpeg_data.data(), jpeg_data.size());
+  if (image_format == EImageFormat::Invalid) {
+    UE_LOG(LogTemp, Error, TEXT("Failed to detect image format"));
+    return false;
+  }
+
+  TSharedPtr<IImageWrapper> ImageWrapper = ImageWrapperModule.CreateImageWrapper(image_format);
+  if (!ImageWrapper.IsValid()) {
+    UE_LOG(LogTemp, Error, TEXT("Failed to create image wrapper"));
+    return false;
+  }
+
+  // decompress the jpeg data
+  if (!ImageWrapper->SetCompressed(jpeg_data.data(), jpeg_data.size())) {
+    UE_LOG(LogTemp, Error, TEXT("Failed to set compressed data"));
+    return false;
+  }
+  // Get the decompressed data
+  if (!ImageWrapper->GetRaw(ERGBFormat::BGRA, 8, UncompressedBGRA)) {
+    UE_LOG(LogTemp, Error, TEXT("Failed to get raw data"));
+    return false;
+  }
+  width = ImageWrapper->GetWidth();
+  height = ImageWrapper->GetHeight();
+  return true;
+}
+
+void URtspClientComponent::run_decoder_benchmark(const espp::JpegFrame &jpeg_frame, int iterations) {
+  // decode the same frame over and over with each backend, to the same
+  // output (full size BGRA) in local buffers, so that the two are compared
+  // like for like and the staging pool isn't touched
+  auto time_decode = [&](auto &&decode) {
+    double start_time = FPlatformTime::Seconds();
+    for (int i = 0; i < iterations; i++) {
+      if (!decode()) {
+        return -1.0f;
+      }
+    }
+    return static_cast<float>((FPlatformTime::Seconds() - start_time) * 1000.0 / iterations);
+  };
+  // full size, like IImageWrapper, then back to the stream's scale
+  int scale = jpeg_decoder_->get_scale();
+  jpeg_decoder_->set_scale(1);
+  std::vector<uint8_t> native_bgra;
+  float native_ms = time_decode([&]() { return jpeg_decoder_->decode(jpeg_frame, native_bgra); });
+  jpeg_decoder_->set_scale(scale);
+  TArray<uint8> image_wrapper_bgra;
+  int width = 0;
+  int height = 0;
+  float image_wrapper_ms = time_decode(
+      [&]() { return decompress_jpeg_frame_image_wrapper(jpeg_frame, image_wrapper_bgra, width, height); });
+  UE_LOG(LogTemp, Display,
+         TEXT("Decoder benchmark (%d x %d, %d B, %d iterations): native (%s kernels) %.3f ms, IImageWrapper %.3f ms"),
+         jpeg_frame.get_width(), jpeg_frame.get_height(), jpeg_frame.get_scan_data().size(), iterations,
+         ANSI_TO_TCHAR(jpeg_decoder_->get_kernels().name), native_ms, image_wrapper_ms);
+  std::unique_lock<std::mutex> lock(stats_mutex_);
+  rtp_stats_.BenchmarkNativeDecodeMs = native_ms;
+  rtp_stats_.BenchmarkImageWrapperDecodeMs = image_wrapper_ms;
+}
+
+void URtspClientComponent::handle_rtcp_packet(espp::PacketBuffer packet) {
+  UE_LOG(LogTemp, Log, TEXT("Got RTCP packet of size: %d"), packet.size());
   // parse the rtcp packet
   // send the packet to the decoder
 }
@@ -1,20 +1,38 @@
 #pragma once
 
+#include <array>
 #include <atomic>
+#include <chrono>
+#include <deque>
 #include <memory>
 #include <mutex>
+#include <optional>
 #include <string>
-#include <system_error>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 
 #include "CoreMinimal.h"
 #include "Components/ActorComponent.h"
-#include "IPAddress.h"
+
+#include "DecodeScheduler.h"
+#include "NetworkReactor.h"
+#include "TcpConnection.h"
+#include "UdpBatchReceiver.h"
+#include "frame_mailbox.hpp"
+#include "jpeg_decoder.hpp"
+#include "jpeg_reassembler.hpp"
+#include "packet_buffer_pool.hpp"
+#include "presentation_scheduler.hpp"
+#include "reorder_buffer.hpp"
+#include "rtsp_response_reader.hpp"
+#include "spsc_queue.hpp"
+#include "triple_buffer.hpp"
+
 #include "RtspClientComponent.generated.h"
 
+class FEvent;
 class FMyRunnable;
-class FSocket;
 class UTexture2D;
 
 // Blueprints can bind to this to update the UI
@@ -22,7 +40,304 @@ DECLARE_DYNAMIC_MULTICAST_DELEGATE(FOnConnected);
 DECLARE_DYNAMIC_MULTICAST_DELEGATE(FOnDisconnected);
 DECLARE_DYNAMIC_MULTICAST_DELEGATE(FOnPlay);
 DECLARE_DYNAMIC_MULTICAST_DELEGATE(FOnPause);
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnDescribed, bool, Success);
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnSetupComplete, bool, Success);
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_TwoParams(FOnRequestFailed, const FString&, Method, const FString&, Reason);
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnFrameReceived, UTexture2D*, Texture);
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_ThreeParams(FOnPlanarFrameReceived, UTexture2D*, YTexture, UTexture2D*, CbTexture,
+                                               UTexture2D*, CrTexture);
+
+/**
+ * @brief What a URtspClientComponent does with a complete frame when the
+ *        decoder is still busy with earlier frames.
+ */
+UENUM(BlueprintType)
+enum class ERtspFrameDropPolicy : uint8
+{
+  // Keep only the newest frame: it replaces a frame that is still waiting to
+  // be decoded, so the displayed latency stays bounded.
+  DropOldest UMETA(DisplayName = "Drop Oldest"),
+  // Keep the frame that is already waiting and drop the new one.
+  DropNewest UMETA(DisplayName = "Drop Newest"),
+  // Queue up to FrameQueueSize frames and drop new frames once it is full.
+  QueueN UMETA(DisplayName = "Queue N"),
+};
+
+/**
+ * @brief How a URtspClientComponent decodes the JPEG frames.
+ */
+UENUM(BlueprintType)
+enum class ERtspDecoderBackend : uint8
+{
+  // The built-in decoder specialized for RTP/JPEG (RFC 2435) streams, which
+  // decodes the scan data directly without a JPEG header.
+  Native UMETA(DisplayName = "Native"),
+  // Unreal Engine's IImageWrapper, which decodes the frame with a synthesized
+  // JPEG header.
+  ImageWrapper UMETA(DisplayName = "Image Wrapper"),
+};
+
+/**
+ * @brief The images a URtspClientComponent publishes for each frame.
+ */
+UENUM(BlueprintType)
+enum class ERtspOutputFormat : uint8
+{
+  // One PF_B8G8R8A8 texture, converted to BGRA on the CPU. Published with
+  // OnFrameReceived.
+  BGRA UMETA(DisplayName = "BGRA"),
+  // Three PF_G8 textures with the Y, Cb and Cr planes of the frame, to be
+  // converted to RGB in the material (see M_Display_YUV in the README).
+  // Published with OnPlanarFrameReceived. Only the Native decoder backend
+  // can output planes; with the ImageWrapper backend the frames are BGRA.
+  YUVPlanar UMETA(DisplayName = "YUV Planar"),
+};
+
+/**
+ * @brief The size a URtspClientComponent decodes the JPEG frames at,
+ *        relative to their full size.
+ */
+UENUM(BlueprintType)
+enum class ERtspDecodeScale : uint8
+{
+  Full UMETA(DisplayName = "1/1"),
+  Half UMETA(DisplayName = "1/2"),
+  Quarter UMETA(DisplayName = "1/4"),
+  Eighth UMETA(DisplayName = "1/8"),
+};
+
+/**
+ * @brief Runtime statistics of a URtspClientComponent's stream.
+ */
+USTRUCT(BlueprintType)
+struct RTSPDISPLAY_API FRtspClientStats
+{
+  GENERATED_BODY()
+
+  // Number of buffers in the packet buffer pool
+  UPROPERTY(BlueprintReadOnly, Category = "RTSP|Stats")
+  int32 PacketPoolCapacity = 0;
+
+  // Number of packet buffers currently in use
+  UPROPERTY(BlueprintReadOnly, Category = "RTSP|Stats")
+  int32 PacketPoolInUse = 0;
+
+  // Largest number of packet buffers that have been in use at once
+  UPROPERTY(BlueprintReadOnly, Category = "RTSP|Stats")
+  int32 PacketPoolHighWaterMark = 0;
+
+  // Number of packets dropped because the packet buffer pool was empty
+  UPROPERTY(BlueprintReadOnly, Category = "RTSP|Stats")
+  int32 PacketPoolExhaustedCount = 0;
+
+  // Number of RTP packets received
+  UPROPERTY(BlueprintReadOnly, Category = "RTSP|Stats")
+  int32 RtpPacketsReceived = 0;
+
+  // Number of RTP packets that were larger than MaxPacketSize
+  UPROPERTY(BlueprintReadOnly, Category = "RTSP|Stats")
+  int32 RtpPacketsTruncated = 0;
+
+  // Average number of RTP packets read per receive system call
+  UPROPERTY(BlueprintReadOnly, Category = "RTSP|Stats")
+  float RtpPacketsPerSyscall = 0.0f;
+
+  // Number of RTP packets currently waiting in the reorder buffer
+  UPROPERTY(BlueprintReadOnly, Category = "RTSP|Stats")
+  int32 ReorderDepth = 0;
+
+  // Largest number of RTP packets that have waited in the reorder buffer
+  UPROPERTY(BlueprintReadOnly, Category = "RTSP|Stats")
+  int32 ReorderMaxDepth = 0;
+
+  // Furthest (in sequence numbers) an RTP packet has arrived out of order
+  UPROPERTY(BlueprintReadOnly, Category = "RTSP|Stats")
+  int32 ReorderMaxDistance = 0;
+
+  // Number of RTP packets that arrived out of order
+  UPROPERTY(BlueprintReadOnly, Category = "RTSP|Stats")
+  int32 RtpPacketsReordered = 0;
+
+  // Number of RTP packets dropped because they arrived too late (or twice)
+  UPROPERTY(BlueprintReadOnly, Category = "RTSP|Stats")
+  int32 RtpPacketsLate = 0;
+
+  // Number of RTP packets that never arrived before their deadline
+  UPROPERTY(BlueprintReadOnly, Category = "RTSP|Stats")
+  int32 RtpPacketsLost = 0;
+
+  // Number of received RTP packets waiting to be reassembled
+  UPROPERTY(BlueprintReadOnly, Category = "RTSP|Stats")
+  int32 PacketQueueDepth = 0;
+
+  // Largest number of received RTP packets that have waited to be reassembled
+  UPROPERTY(BlueprintReadOnly, Category = "RTSP|Stats")
+  int32 PacketQueueMaxDepth = 0;
+
+  // Number of RTP packets dropped because the reassembly stage fell behind
+  UPROPERTY(BlueprintReadOnly, Category = "RTSP|Stats")
+  int32 PacketQueueDrops = 0;
+
+  // Number of JPEG frames currently being reassembled
+  UPROPERTY(BlueprintReadOnly, Category = "RTSP|Stats")
+  int32 FramesInFlight = 0;
+
+  // Number of JPEG frames that were completely received
+  UPROPERTY(BlueprintReadOnly, Category = "RTSP|Stats")
+  int32 FramesCompleted = 0;
+
+  // Number of JPEG frames dropped because they had missing packets
+  UPROPERTY(BlueprintReadOnly, Category = "RTSP|Stats")
+  int32 FramesIncomplete = 0;
+
+  // Number of complete JPEG frames waiting to be decoded
+  UPROPERTY(BlueprintReadOnly, Category = "RTSP|Stats")
+  int32 FrameQueueDepth = 0;
+
+  // Largest number of complete JPEG frames that have waited to be decoded
+  UPROPERTY(BlueprintReadOnly, Category = "RTSP|Stats")
+  int32 FrameQueueMaxDepth = 0;
+
+  // Number of complete JPEG frames dropped because the decode stage fell behind
+  UPROPERTY(BlueprintReadOnly, Category = "RTSP|Stats")
+  int32 FrameQueueDrops = 0;
+
+  // Number of complete JPEG frames that were replaced by a newer frame before
+  // they were decoded (with the DropOldest policy)
+  UPROPERTY(BlueprintReadOnly, Category = "RTSP|Stats")
+  int32 FramesReplaced = 0;
+
+  // Number of JPEG frames that were decoded
+  UPROPERTY(BlueprintReadOnly, Category = "RTSP|Stats")
+  int32 FramesDecoded = 0;
+
+  // Number of JPEG frames that failed to decode
+  UPROPERTY(BlueprintReadOnly, Category = "RTSP|Stats")
+  int32 DecodeErrors = 0;
+
+  // Time (in milliseconds) it took to decode the last frame. With
+  // StreamingDecode, only the part of the decode left once the frame was
+  // complete
+  UPROPERTY(BlueprintReadOnly, Category = "RTSP|Stats")
+  float DecodeTimeMs = 0.0f;
+
+  // Average time (in milliseconds) a decode worker spent on each frame,
+  // including the slices of it other workers decoded in parallel
+  UPROPERTY(BlueprintReadOnly, Category = "RTSP|Stats")
+  float AverageDecodeTimeMs = 0.0f;
+
+  // Average time (in milliseconds) the complete frames waited for a decode
+  // worker. Goes up when the workers are busy with other streams, or with
+  // this stream's earlier frames
+  UPROPERTY(BlueprintReadOnly, Category = "RTSP|Stats")
+  float DecodeQueueWaitMs = 0.0f;
+
+  // Longest time (in milliseconds) a complete frame waited for a decode
+  // worker
+  UPROPERTY(BlueprintReadOnly, Category = "RTSP|Stats")
+  float DecodeQueueMaxWaitMs = 0.0f;
+
+  // Time (in milliseconds) from the last packet of the last decoded frame
+  // arriving to its image being ready to publish
+  UPROPERTY(BlueprintReadOnly, Category = "RTSP|Stats")
+  float MarkerToReadyMs = 0.0f;
+
+  // Average time (in milliseconds) per frame of the native decoder in the
+  // last benchmark_decoders() run
+  UPROPERTY(BlueprintReadOnly, Category = "RTSP|Stats")
+  float BenchmarkNativeDecodeMs = 0.0f;
+
+  // Average time (in milliseconds) per frame of the IImageWrapper decoder in
+  // the last benchmark_decoders() run
+  UPROPERTY(BlueprintReadOnly, Category = "RTSP|Stats")
+  float BenchmarkImageWrapperDecodeMs = 0.0f;
+
+  // Number of decoded images which were replaced by a newer one before they
+  // were shown, e.g. because the stream's frame rate is higher than the
+  // game's
+  UPROPERTY(BlueprintReadOnly, Category = "RTSP|Stats")
+  int32 ImagesSkipped = 0;
+
+  // Number of textures created to display the frames. They are updated in
+  // place, so this only goes up when the size or format of the frames changes
+  UPROPERTY(BlueprintReadOnly, Category = "RTSP|Stats")
+  int32 TexturesCreated = 0;
+
+  // Number of staging buffers the images are decoded into which are in use,
+  // i.e. held by the decoder or waiting for (or in) an upload on the render
+  // thread
+  UPROPERTY(BlueprintReadOnly, Category = "RTSP|Stats")
+  int32 StagingBuffersInUse = 0;
+
+  // Number of times the decoder found no free staging buffer to decode into
+  // (because the render thread is falling behind) and dropped the frame,
+  // since the frames last changed size or format
+  UPROPERTY(BlueprintReadOnly, Category = "RTSP|Stats")
+  int32 StagingPoolExhaustedCount = 0;
+
+  // Mean difference (in milliseconds) between when the frames were shown and
+  // when they were scheduled to be, with a PlayoutDelayMs. About half a tick
+  // when the frames are paced well
+  UPROPERTY(BlueprintReadOnly, Category = "RTSP|Stats")
+  float PresentationJitterMs = 0.0f;
+
+  // Number of frames shown ahead of schedule because too many newer frames
+  // were waiting behind them
+  UPROPERTY(BlueprintReadOnly, Category = "RTSP|Stats")
+  int32 FramesPresentedEarly = 0;
+
+  // Number of frames which were only decoded after they were scheduled to be
+  // shown; if this keeps going up, the playout delay is too short for the
+  // stream's jitter
+  UPROPERTY(BlueprintReadOnly, Category = "RTSP|Stats")
+  int32 FramesPresentedLate = 0;
+
+  // Estimated drift (in parts per million) of the sender's clock relative to
+  // the local clock
+  UPROPERTY(BlueprintReadOnly, Category = "RTSP|Stats")
+  float ClockDriftPpm = 0.0f;
+
+  // Time (in milliseconds) from connecting to the first frame being shown,
+  // which the Startup stats break down into phases. 0 until it's shown
+  UPROPERTY(BlueprintReadOnly, Category = "RTSP|Stats")
+  float TimeToFirstFrameMs = 0.0f;
+
+  // Time (in milliseconds) to make the connection to the server
+  UPROPERTY(BlueprintReadOnly, Category = "RTSP|Stats")
+  float StartupConnectMs = 0.0f;
+
+  // Time (in milliseconds) from the connection being made to the DESCRIBE
+  // response
+  UPROPERTY(BlueprintReadOnly, Category = "RTSP|Stats")
+  float StartupDescribeMs = 0.0f;
+
+  // Time (in milliseconds) from the DESCRIBE response to the SETUP response
+  UPROPERTY(BlueprintReadOnly, Category = "RTSP|Stats")
+  float StartupSetupMs = 0.0f;
+
+  // Time (in milliseconds) from the SETUP response to the PLAY response
+  UPROPERTY(BlueprintReadOnly, Category = "RTSP|Stats")
+  float StartupPlayMs = 0.0f;
+
+  // Time (in milliseconds) from the PLAY response to the first RTP packet
+  // (0 if the packets arrived first)
+  UPROPERTY(BlueprintReadOnly, Category = "RTSP|Stats")
+  float StartupFirstPacketMs = 0.0f;
+
+  // Time (in milliseconds) from the first RTP packet to the first complete
+  // frame
+  UPROPERTY(BlueprintReadOnly, Category = "RTSP|Stats")
+  float StartupFirstFrameMs = 0.0f;
+
+  // Time (in milliseconds) from the first complete frame to it being decoded
+  UPROPERTY(BlueprintReadOnly, Category = "RTSP|Stats")
+  float StartupDecodeMs = 0.0f;
+
+  // Time (in milliseconds) from the first frame being decoded to it being
+  // shown
+  UPROPERTY(BlueprintReadOnly, Category = "RTSP|Stats")
+  float StartupPresentMs = 0.0f;
+};
 
 /**
  * @brief This class is used to connect to a RTSP server and receive the video
@@ -30,13 +345,23 @@ DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnFrameReceived, UTexture2D*, Textu
  *
  * @details This class is used to connect to a RTSP server and receive the video
  *          stream. It currently supports only MJPEG streams (which are simply a
- *          sequence of JPEG images). It uses a TCP socket (FSocket with
- *          ESocketType::SOCKTYPE_Streaming) to connect to the RTSP server send
- *          RTSP requests and receive RTSP responses. It uses a UDP socket
- *          (FSocket with ESocketType::SOCKTYPE_Datagram) to receive the RTP and
- *          RTCP packets, from which it extracts the JPEG images. It will
- *          convert the JPEG images to UTexture2D and broadcast them to the
- *          any registered listeners.
+ *          sequence of JPEG images). It uses a TCP socket (FTcpConnection) to
+ *          connect to the RTSP server send RTSP requests and receive RTSP
+ *          responses. It uses UDP sockets (FUdpBatchReceiver) to receive the
+ *          RTP and RTCP packets, from which it extracts the JPEG images. The
+ *          sockets of every component are waited on by the one network thread
+ *          of the URtspNetworkSubsystem. It will convert the JPEG images to
+ *          UTexture2D and broadcast them to the any registered listeners.
+ *
+ *          The RTSP requests (describe(), setup(), play(), pause() and
+ *          teardown()) are asynchronous: they are queued and return right
+ *          away, and the network thread sends them one at a time, in order,
+ *          and waits for their responses. The result of each request is
+ *          broadcast on the game thread (OnDescribed, OnSetupComplete, OnPlay,
+ *          OnPause, or OnRequestFailed if it failed or took longer than
+ *          RequestTimeoutMs), so the game thread never waits on the server.
+ *          open_stream() starts a stream in one go, with each request sent
+ *          by the network thread as soon as the server allows it.
  */
 UCLASS(ClassGroup = (Custom), meta = (BlueprintSpawnableComponent))
   class RTSPDISPLAY_API URtspClientComponent : public UActorComponent
@@ -61,24 +386,55 @@ public:
   UFUNCTION(BlueprintCallable, Category = "RTSP")
   bool connect_to_address(FString rtsp_address, int rtsp_port = 8554, FString path = TEXT("/mjpeg/1"));
 
+  // Connect to the RTSP server at the URI and start playing its stream as
+  // quickly as possible: DESCRIBE is sent along with OPTIONS, SETUP as soon
+  // as the DESCRIBE response arrives, and PLAY as soon as the SETUP response
+  // (with the session) arrives, without waiting on the game thread in
+  // between. The pipeline is ready before the requests are sent, and is
+  // sized for the stream described by the server. The usual events are
+  // broadcast along the way, and the TimeToFirstFrameMs and Startup stats
+  // break down how long it took. Returns false if it couldn't start.
+  UFUNCTION(BlueprintCallable, Category = "RTSP")
+  bool open_stream(FString uri, int rtp_port = 5000, int rtcp_port = 5001);
+
   UFUNCTION(BlueprintCallable, Category = "RTSP")
   void disconnect();
 
+  // Queue a DESCRIBE request. OnDescribed is broadcast with its result.
+  // Returns false if it couldn't be queued.
   UFUNCTION(BlueprintCallable, Category = "RTSP")
   bool describe();
 
+  // Start receiving on the RTP and RTCP ports and queue a SETUP request.
+  // OnSetupComplete is broadcast with its result. Returns false if it
+  // couldn't be queued.
   UFUNCTION(BlueprintCallable, Category = "RTSP")
   bool setup(int rtp_port = 5000, int rtcp_port = 5001);
 
+  // Queue a PLAY request. OnPlay is broadcast once the server is playing.
+  // Returns false if it couldn't be queued.
   UFUNCTION(BlueprintCallable, Category = "RTSP")
   bool play();
 
+  // Queue a PAUSE request. OnPause is broadcast once the server has paused.
+  // Returns false if it couldn't be queued.
   UFUNCTION(BlueprintCallable, Category = "RTSP")
   bool pause();
 
+  // Queue a TEARDOWN request. Returns false if it couldn't be queued.
   UFUNCTION(BlueprintCallable, Category = "RTSP")
   bool teardown();
 
+  // Get a snapshot of the runtime statistics of the stream.
+  UFUNCTION(BlueprintPure, Category = "RTSP")
+  FRtspClientStats get_stats() const;
+
+  // Decode the next received frame with every decoder backend, iterations
+  // times each, and report the average decode times in the log and in the
+  // Benchmark fields of the stats.
+  UFUNCTION(BlueprintCallable, Category = "RTSP")
+  void benchmark_decoders(int iterations = 100);
+
   UPROPERTY(BlueprintAssignable, Category = "RTSP")
   FOnConnected OnConnected;
 
@@ -88,12 +444,26 @@ public:
   UPROPERTY(BlueprintAssignable, Category = "RTSP")
   FOnPause OnPause;
 
+  UPROPERTY(BlueprintAssignable, Category = "RTSP")
+  FOnDescribed OnDescribed;
+
+  UPROPERTY(BlueprintAssignable, Category = "RTSP")
+  FOnSetupComplete OnSetupComplete;
+
+  // Broadcast when a request fails, with the request's method and why: the
+  // server's status line, or that it timed out or the connection was lost.
+  UPROPERTY(BlueprintAssignable, Category = "RTSP")
+  FOnRequestFailed OnRequestFailed;
+
   UPROPERTY(BlueprintAssignable, Category = "RTSP")
   FOnPlay OnPlay;
 
   UPROPERTY(BlueprintAssignable, Category = "RTSP")
   FOnFrameReceived OnFrameReceived;
 
+  UPROPERTY(BlueprintAssignable, Category = "RTSP")
+  FOnPlanarFrameReceived OnPlanarFrameReceived;
+
   UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "RTSP")
   FString Address;
 
@@ -103,6 +473,92 @@ public:
   UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "RTSP")
   FString Path = TEXT("/mjpeg/1");
 
+  // How long (in milliseconds) each RTSP request (including connecting) may
+  // take, from when it is made to when its response arrives, before it fails
+  // with OnRequestFailed. Applied to the requests made after it is changed.
+  UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "RTSP")
+  int32 RequestTimeoutMs = 5000;
+
+  // Number of buffers preallocated for receiving RTP/RTCP packets. Packets
+  // that arrive while every buffer is in use are dropped.
+  UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "RTSP")
+  int PacketPoolSize = 512;
+
+  // Size in bytes of each receive buffer. Datagrams larger than this are
+  // truncated, so it must be at least the largest RTP packet the server sends.
+  UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "RTSP")
+  int MaxPacketSize = 2048;
+
+  // Number of RTP sequence numbers the reorder buffer spans. Packets are
+  // reassembled in sequence order; a packet that arrives further ahead than
+  // this forces the buffer to give up on missing packets.
+  UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "RTSP")
+  int ReorderBufferDepth = 64;
+
+  // How long (in milliseconds) the reorder buffer waits for a missing RTP
+  // packet before skipping it.
+  UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "RTSP")
+  int ReorderMaxDelayMs = 20;
+
+  // Maximum number of frames this stream reassembles at once. When a packet
+  // for a new frame arrives and every slot is taken, the oldest incomplete
+  // frame is dropped.
+  UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "RTSP")
+  int MaxFramesInFlight = 4;
+
+  // What to do with a complete frame when the decoder is still busy. Applied
+  // on the next setup().
+  UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "RTSP")
+  ERtspFrameDropPolicy FrameDropPolicy = ERtspFrameDropPolicy::DropOldest;
+
+  // Number of complete frames that may wait to be decoded with the QueueN
+  // frame drop policy.
+  UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "RTSP")
+  int FrameQueueSize = 4;
+
+  // Which decoder turns the JPEG frames into images. May be changed while
+  // playing.
+  UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "RTSP")
+  ERtspDecoderBackend DecoderBackend = ERtspDecoderBackend::ImageWrapper;
+
+  // Decode each frame with the Native decoder while its packets are still
+  // arriving, on the reassembly thread, instead of on the decode workers once
+  // the frame is complete. Only the end of the frame is left to decode when
+  // its last packet arrives, but frames are never dropped for the decoder
+  // being busy, so the frame drop policy doesn't apply. Applied on the next
+  // setup().
+  UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "RTSP")
+  bool StreamingDecode = false;
+
+  // This stream's share of the decode workers, which every stream shares,
+  // relative to the other streams' when the workers are all busy: a stream
+  // with a priority of 2 gets twice the decode time of one with a priority
+  // of 1. Applied on the next setup().
+  UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "RTSP")
+  float DecodePriority = 1.0f;
+
+  // Size to decode the frames at, for displays which only cover a small part
+  // of the screen. The Native decoder backend decodes straight to the reduced
+  // size, which saves most of the decode work and shrinks the images and
+  // textures; the ImageWrapper backend always decodes at full size. May be
+  // changed while playing.
+  UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "RTSP")
+  ERtspDecodeScale DecodeScale = ERtspDecodeScale::Full;
+
+  // Whether the frames are published as BGRA textures or as Y, Cb and Cr
+  // plane textures, which are 2.67x (4:2:0) or 2x (4:2:2) smaller to upload.
+  // May be changed while playing.
+  UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "RTSP")
+  ERtspOutputFormat OutputFormat = ERtspOutputFormat::BGRA;
+
+  // How long (in milliseconds) to hold each frame before showing it, so that
+  // the frames are shown evenly paced by their RTP timestamps instead of
+  // whenever they happen to arrive. Should cover the stream's jitter; see the
+  // FramesPresentedLate stat. 0 shows each frame as soon as it is decoded,
+  // for the lowest latency. Applied on the next setup().
+  UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "RTSP")
+  int32 PlayoutDelayMs = 0;
+
   UPROPERTY(BlueprintReadOnly, Category = "RTSP")
   bool IsConnected = false;
 
@@ -111,46 +567,291 @@ public:
 
  protected:
 
-  std::string send_request(const std::string& method, const std::string& path,
-                           const std::unordered_map<std::string, std::string> &extra_headers, std::error_code &ec);
+  // an rtsp request waiting to be sent, or for its response
+  struct ControlRequest {
+    std::string method;
+    std::string path;
+    std::unordered_map<std::string, std::string> extra_headers;
+    // when it fails if its response hasn't arrived, in FPlatformTime::Seconds()
+    double deadline = 0;
+    // whether it may be sent before the responses to the requests before it
+    // have arrived
+    bool pipelined = false;
+    // whether it's part of open_stream(), which sends the next request as
+    // soon as it's answered
+    bool fast_start = false;
+    // assigned when it's sent
+    int cseq = 0;
+  };
+
+  // the points reached while starting a stream, to break down the time to
+  // the first frame
+  enum StartupPhase {
+    STARTUP_BEGIN,
+    STARTUP_CONNECTED,
+    STARTUP_DESCRIBED,
+    STARTUP_SET_UP,
+    STARTUP_PLAYING,
+    STARTUP_FIRST_PACKET,
+    STARTUP_FIRST_FRAME,
+    STARTUP_FIRST_DECODE,
+    STARTUP_FIRST_PRESENT,
+    NUM_STARTUP_PHASES,
+  };
+
+  std::string make_request(const std::string &method, const std::string &path,
+                           const std::unordered_map<std::string, std::string> &extra_headers);
+
+  double get_request_deadline() const;
+
+  bool queue_request(ControlRequest request);
+
+  bool parse_response(const espp::RtspResponseReader::Response &response);
+
+  bool parse_sdp(const std::string &response);
+
+  bool send_requests();
+
+  bool receive_responses();
+
+  void handle_response(const espp::RtspResponseReader::Response &response);
+
+  void finish_request(const ControlRequest &request, const espp::RtspResponseReader::Response &response);
+
+  void fail_request(const ControlRequest &request, const FString &reason);
+
+  void fail_expired_requests();
+
+  void close_rtsp_connection(const FString &reason);
+
+  void run_on_game_thread(TUniqueFunction<void()> function);
+
+  bool mark_startup(StartupPhase phase);
+
+  float get_startup_ms(StartupPhase from, StartupPhase to) const;
+
+  float get_startup_ms(StartupPhase phase) const;
+
+  bool start_pipeline(int rtp_port, int rtcp_port);
+
+  void update_decode_settings();
+
+  void apply_stream_hint();
+
+  void prepare_decoder(int width, int height);
+
+  bool init_rtp(size_t rtp_port);
+
+  bool init_rtcp(size_t rtcp_port);
+
+  void stop_rtp_rtcp();
+
+  void remove_from_reactor(std::atomic<int32> &reactor_id);
+
+  void handle_rtsp_socket(uint32 events);
+
+  void handle_rtp_socket(uint32 events);
+
+  void handle_rtcp_socket(uint32 events);
+
+  bool reassembly_thread_func();
+
+  void decode_next_frame();
+
+  using ReorderClock = espp::ReorderBuffer<espp::PacketBuffer>::Clock;
+
+  // an rtp packet on its way from the receive stage to the reassembly stage
+  struct ReceivedPacket {
+    espp::PacketBuffer buffer;
+    ReorderClock::time_point arrival_time;
+  };
+
+  // a decoded image on its way from the decode stage to the render thread:
+  // either BGRA, or the Y plane with the chroma planes alongside it. the
+  // planes are staging buffers borrowed from the pool they were decoded into,
+  // and go back to it when the image is destroyed. the pool is declared
+  // first so that it outlives them (so images are moved by construction, not
+  // assignment, which would drop the pool first)
+  struct DecodedImage {
+    std::shared_ptr<espp::PacketBufferPool> pool;
+    espp::PacketBuffer data;
+    espp::PacketBuffer cb;
+    espp::PacketBuffer cr;
+    int width = 0;
+    int height = 0;
+    int chroma_width = 0;
+    int chroma_height = 0;
+    bool planar = false;
+    // the RTP timestamp of the frame, and when it was decoded
+    uint32_t rtp_timestamp = 0;
+    std::chrono::steady_clock::time_point ready_time;
+  };
+
+  void handle_rtp_packet(espp::PacketBuffer packet, ReorderClock::time_point arrival_time);
+
+  void reassemble_rtp_packet(espp::PacketBuffer packet);
+
+  bool decode_partial_jpeg_frame(const espp::JpegFrame &jpeg_frame);
+
+  void finish_jpeg_frame(const espp::JpegFrame &jpeg_frame);
 
-  bool parse_response(const std::string &response_data);
+  void publish_image(const espp::JpegFrame &jpeg_frame, bool decoded, float decode_time_ms);
 
-  void init_rtp(size_t rtp_port);
+  bool decode_jpeg_frame(const espp::JpegFrame &jpeg_frame, DecodedImage &image, ERtspDecoderBackend backend);
 
-  void init_rtcp(size_t rtcp_port);
+  bool decode_jpeg_frame_native(const espp::JpegFrame &jpeg_frame, DecodedImage &image);
 
-  bool connect_thread_func();
+  bool prepare_decoded_image(DecodedImage &image);
 
-  bool rtp_thread_func();
+  bool allocate_image(DecodedImage &image, int width, int height, int chroma_width, int chroma_height);
 
-  bool rtcp_thread_func();
+  void ensure_staging_pool(size_t plane_size, bool planar);
 
-  void handle_rtp_packet(std::vector<uint8_t> &data);
+  void convert_decoded_rows(DecodedImage &image, int first_row, int num_rows);
 
-  void handle_rtcp_packet(std::vector<uint8_t> &data);
+  bool decode_jpeg_frame_image_wrapper(const espp::JpegFrame &jpeg_frame, DecodedImage &image);
 
-  FSocket *rtsp_socket_ = nullptr;
-  FSocket *rtp_socket_ = nullptr;
-  FSocket *rtcp_socket_ = nullptr;
+  bool decompress_jpeg_frame_image_wrapper(const espp::JpegFrame &jpeg_frame, TArray<uint8> &UncompressedBGRA,
+                                           int &width, int &height);
 
-  FMyRunnable *connect_thread_ = nullptr;
-  FMyRunnable *rtp_thread_ = nullptr;
-  FMyRunnable *rtcp_thread_ = nullptr;
+  void run_decoder_benchmark(const espp::JpegFrame &jpeg_frame, int iterations);
 
+  void present_image(DecodedImage image);
+
+  void update_textures(const DecodedImage &image);
+
+  void upload_image(DecodedImage image);
+
+  void update_rtp_stats();
+
+  void handle_rtcp_packet(espp::PacketBuffer packet);
+
+  std::unique_ptr<FTcpConnection> rtsp_connection_;
+  // the requests waiting to be sent, which the game thread queues and the
+  // network thread sends
+  std::mutex control_mutex_;
+  std::deque<ControlRequest> control_requests_;
+  // whether the connection is made, the requests waiting for their
+  // responses (in the order they were sent), and the reader the responses
+  // are received into. only used by the network thread
+  bool rtsp_socket_connected_ = false;
+  std::deque<ControlRequest> requests_in_flight_;
+  espp::RtspResponseReader rtsp_reader_;
+  // the ports open_stream() sets up the session on
+  int fast_start_rtp_port_ = 0;
+  int fast_start_rtcp_port_ = 0;
+
+  // when each startup phase was reached, in FPlatformTime::Seconds(), or 0
+  // if it hasn't been yet. each is set once, by the thread which reaches it
+  std::array<std::atomic<double>, NUM_STARTUP_PHASES> startup_times_{};
+
+  // buffers for the rtp and rtcp receivers, shared so the pool stats cover
+  // both. declared before the receivers so that it outlives them
+  std::unique_ptr<espp::PacketBufferPool> packet_pool_;
+
+  // orders the rtp packets by their extended sequence number before they
+  // are reassembled. only used by the reassembly thread
+  std::unique_ptr<espp::ReorderBuffer<espp::PacketBuffer>> reorder_buffer_;
+  espp::Unwrapper<uint16_t> sequence_unwrapper_;
+  // reassembles this stream's packets into frames. only used by the
+  // reassembly thread
+  std::unique_ptr<espp::JpegReassembler> reassembler_;
+
+  // the pipeline between the stages, each of which runs on its own thread:
+  // receive (the shared network thread) -> reassembly -> decode (the shared
+  // decode workers, one frame of this stream at a time) -> publish (game
+  // thread). the queues are single-producer single-consumer, the frame mailbox applies the frame drop
+  // policy, and the free queue hands the frames back upstream so their
+  // buffers are reused. the decoder writes each image straight into the back
+  // buffer of the image triple buffer, and the game thread shows its front
+  // buffer, so the images are never copied or queued
+  std::unique_ptr<espp::SpscQueue<ReceivedPacket>> packet_queue_;
+  std::unique_ptr<espp::FrameMailbox<espp::JpegFrame>> frame_mailbox_;
+  std::unique_ptr<espp::SpscQueue<std::unique_ptr<espp::JpegFrame>>> free_frame_queue_;
+  std::unique_ptr<espp::TripleBuffer<DecodedImage>> image_buffer_;
+  // wakes the reassembly thread when its queue has work
+  FEvent *packets_available_ = nullptr;
+  // the size of the stream's frames, from its sdp, which the network thread
+  // sets and the reassembly thread uses to size the reassembly buffers and
+  // prepare the decoder before the first frame arrives
+  std::atomic<int> hint_width_ = 0;
+  std::atomic<int> hint_height_ = 0;
+  std::atomic<int> hint_frame_size_ = 0;
+  std::atomic<bool> hint_pending_ = false;
+  std::atomic<int32> packet_queue_drops_ = 0;
+  // the native decoder and its planes. only used by this stream's decode
+  // tasks, or by the reassembly thread when decoding while the frames arrive
+  std::unique_ptr<espp::JpegDecoder> jpeg_decoder_;
+  // the staging memory the images are decoded into, which the render thread
+  // uploads the textures from and then hands back. remade when the size or
+  // format of the images changes; images still holding buffers of an older
+  // pool keep it alive. only used by the thread which decodes
+  std::shared_ptr<espp::PacketBufferPool> staging_pool_;
+  // with streaming decode there are no decode tasks: the reassembly thread
+  // decodes the newest frame as its packets arrive into the image back
+  // buffer, converting the rows as they are decoded, and publishes it itself
+  bool streaming_decode_ = false;
+  // DecoderBackend, DecodeScale and OutputFormat as the threads which decode
+  // read them, since the game thread may write the properties at any time.
+  // copied by the game thread in start_pipeline() and on every tick, so that
+  // changing them still applies while playing
+  std::atomic<ERtspDecoderBackend> decoder_backend_{ERtspDecoderBackend::ImageWrapper};
+  std::atomic<int> decode_scale_{1};
+  std::atomic<bool> planar_output_{false};
+  std::optional<uint32_t> streaming_timestamp_;
+  int streaming_rows_ = 0;
+  // number of iterations of the decoder benchmark to run on the next frame
+  std::atomic<int> benchmark_iterations_ = 0;
+
+  std::unique_ptr<FUdpBatchReceiver> rtp_receiver_;
+  std::unique_ptr<FUdpBatchReceiver> rtcp_receiver_;
+
+  // the network thread shared by every component, which calls the handlers
+  // of the rtsp, rtp and rtcp sockets when they are ready, and the ids of
+  // their registrations (-1 when not registered). only the game thread
+  // registers and removes them
+  FNetworkReactor *reactor_ = nullptr;
+  std::atomic<int32> rtsp_reactor_id_ = -1;
+  // set by the network thread when the rtsp connection can't be used any
+  // more. it stops handling the socket, but leaves removing it to the game
+  // thread, whose disconnect() then waits for the handler to return
+  std::atomic<bool> rtsp_closed_ = false;
+  std::atomic<int32> rtp_reactor_id_ = -1;
+  std::atomic<int32> rtcp_reactor_id_ = -1;
+
+  // the decode workers shared by every component, which run this stream's
+  // decode tasks, and the id of its registration (-1 when not registered)
+  FDecodeScheduler *decode_scheduler_ = nullptr;
+  int32 decode_stream_ = -1;
+
+  FMyRunnable *reassembly_thread_ = nullptr;
+
+  // the rtsp session. only used by the network thread while connected
   std::string path_;
   int cseq_ = 0;
   int video_port_ = 0;
   int video_payload_type_ = 0;
   std::string session_id_;
 
-  std::mutex image_mutex_;
-  std::vector<uint8_t> image_data_;
-  std::atomic<bool> image_data_ready_ = false;
   std::atomic<int> image_width_ = 0;
   std::atomic<int> image_height_ = 0;
 
-  TSharedPtr<FInternetAddr> rtsp_addr_;
+  // the textures the frames are shown with, created when the first frame (or
+  // a frame of a different size or format) arrives and then updated in place,
+  // so that the listeners always get the same textures: one BGRA texture, or
+  // the Y, Cb and Cr textures for planar output. only used by the game thread
+  UPROPERTY(Transient)
+  TArray<UTexture2D*> textures_;
+  std::atomic<int32> textures_created_ = 0;
+
+  // holds the images until their target display time when there is a
+  // playout delay. only used by the game thread
+  std::unique_ptr<espp::PresentationScheduler<DecodedImage>> presentation_scheduler_;
+
+  // stats owned by the reassembly thread and the decode tasks, copied out by
+  // get_stats()
+  mutable std::mutex stats_mutex_;
+  FRtspClientStats rtp_stats_;
 
  public:
 
@@ -0,0 +1,41 @@
+#include "RtspDecodeSubsystem.h"
+
+#include "Engine/Engine.h"
+#include "HAL/PlatformMisc.h"
+
+void URtspDecodeSubsystem::Initialize(FSubsystemCollectionBase &Collection) {
+  Super::Initialize(Collection);
+  // one worker per core; they only run while there are frames to decode
+  int num_workers = FPlatformMisc::NumberOfCores();
+  scheduler_ = std::make_unique<FDecodeScheduler>(num_workers);
+  UE_LOG(LogTemp, Log, TEXT("Started %d RTSP decode workers"), num_workers);
+}
+
+void URtspDecodeSubsystem::Deinitialize() {
+  // the components have disconnected (and removed their streams) by now
+  scheduler_.reset();
+  Super::Deinitialize();
+}
+
+FDecodeScheduler *URtspDecodeSubsystem::get_scheduler() const {
+  return scheduler_.get();
+}
+
+FDecodeScheduler *URtspDecodeSubsystem::get_engine_scheduler() {
+  auto subsystem = GEngine ? GEngine->GetEngineSubsystem<URtspDecodeSubsystem>() : nullptr;
+  return subsystem ? subsystem->get_scheduler() : nullptr;
+}
+
+FRtspDecodeStats URtspDecodeSubsystem::get_stats() const {
+  FRtspDecodeStats stats;
+  if (!scheduler_) {
+    return stats;
+  }
+  auto scheduler_stats = scheduler_->get_stats();
+  stats.Workers = scheduler_stats.Workers;
+  stats.Streams = scheduler_stats.Streams;
+  stats.Frames = static_cast<int32>(scheduler_stats.Tasks);
+  stats.Slices = static_cast<int32>(scheduler_stats.Slices);
+  stats.SlicesStolen = static_cast<int32>(scheduler_stats.SlicesStolen);
+  return stats;
+}
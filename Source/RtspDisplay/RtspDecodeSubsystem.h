@@ -0,0 +1,76 @@
+#pragma once
+
+#include <memory>
+
+#include "CoreMinimal.h"
+#include "Subsystems/EngineSubsystem.h"
+
+#include "DecodeScheduler.h"
+
+#include "RtspDecodeSubsystem.generated.h"
+
+/**
+ * @brief Runtime statistics of the decode workers shared by every
+ *        URtspClientComponent.
+ */
+USTRUCT(BlueprintType)
+struct RTSPDISPLAY_API FRtspDecodeStats
+{
+  GENERATED_BODY()
+
+  // Number of decode worker threads
+  UPROPERTY(BlueprintReadOnly, Category = "RTSP|Stats")
+  int32 Workers = 0;
+
+  // Number of streams sharing the decode workers
+  UPROPERTY(BlueprintReadOnly, Category = "RTSP|Stats")
+  int32 Streams = 0;
+
+  // Number of frames the decode workers have decoded, of every stream
+  UPROPERTY(BlueprintReadOnly, Category = "RTSP|Stats")
+  int32 Frames = 0;
+
+  // Number of slices (restart intervals and bands of rows) the frames were
+  // split into
+  UPROPERTY(BlueprintReadOnly, Category = "RTSP|Stats")
+  int32 Slices = 0;
+
+  // Number of slices stolen by a worker which was idle, i.e. decoded on a
+  // different worker than the rest of their frame
+  UPROPERTY(BlueprintReadOnly, Category = "RTSP|Stats")
+  int32 SlicesStolen = 0;
+};
+
+/**
+ * @brief Owns the decode workers which every URtspClientComponent decodes
+ *        its frames on, one per core, so that a busy stream can use the
+ *        cores the other streams aren't using.
+ *
+ * @details Each stream registers with the FDecodeScheduler, with its
+ *          DecodePriority as its weight, and submits its frames to it. The
+ *          frames are split into slices which the idle workers steal.
+ */
+UCLASS()
+class RTSPDISPLAY_API URtspDecodeSubsystem : public UEngineSubsystem
+{
+  GENERATED_BODY()
+public:
+
+  void Initialize(FSubsystemCollectionBase &Collection) override;
+  void Deinitialize() override;
+
+  // Get the scheduler to submit frames to.
+  FDecodeScheduler *get_scheduler() const;
+
+  // Get the scheduler of the engine's subsystem, or nullptr if there isn't
+  // one.
+  static FDecodeScheduler *get_engine_scheduler();
+
+  // Get a snapshot of the runtime statistics of the decode workers.
+  UFUNCTION(BlueprintPure, Category = "RTSP")
+  FRtspDecodeStats get_stats() const;
+
+ protected:
+
+  std::unique_ptr<FDecodeScheduler> scheduler_;
+};
@@ -0,0 +1,44 @@
+#include "RtspNetworkSubsystem.h"
+
+#include "Engine/Engine.h"
+
+void URtspNetworkSubsystem::Initialize(FSubsystemCollectionBase &Collection) {
+  Super::Initialize(Collection);
+  reactor_ = std::make_unique<FNetworkReactor>();
+  if (!reactor_->is_valid()) {
+    UE_LOG(LogTemp, Error, TEXT("Failed to start the RTSP network thread"));
+    reactor_.reset();
+  }
+}
+
+void URtspNetworkSubsystem::Deinitialize() {
+  // the components have disconnected (and removed their sockets) by now
+  reactor_.reset();
+  Super::Deinitialize();
+}
+
+FNetworkReactor *URtspNetworkSubsystem::get_reactor() const {
+  return reactor_.get();
+}
+
+FNetworkReactor *URtspNetworkSubsystem::get_engine_reactor() {
+  auto subsystem = GEngine ? GEngine->GetEngineSubsystem<URtspNetworkSubsystem>() : nullptr;
+  return subsystem ? subsystem->get_reactor() : nullptr;
+}
+
+FRtspNetworkStats URtspNetworkSubsystem::get_stats() const {
+  FRtspNetworkStats stats;
+  if (!reactor_) {
+    return stats;
+  }
+  auto reactor_stats = reactor_->get_stats();
+  stats.Sockets = reactor_stats.Sockets;
+  stats.Wakeups = static_cast<int32>(reactor_stats.Wakeups);
+  stats.Events = static_cast<int32>(reactor_stats.Events);
+  if (reactor_stats.Wakeups > 0) {
+    stats.EventsPerWakeup = static_cast<float>(reactor_stats.Events) / reactor_stats.Wakeups;
+    stats.LoopTimeUs = static_cast<float>(reactor_stats.LoopTimeUs) / reactor_stats.Wakeups;
+  }
+  stats.MaxLoopTimeUs = static_cast<float>(reactor_stats.MaxLoopTimeUs);
+  return stats;
+}
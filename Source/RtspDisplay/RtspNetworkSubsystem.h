@@ -0,0 +1,83 @@
+#pragma once
+
+#include <memory>
+
+#include "CoreMinimal.h"
+#include "Subsystems/EngineSubsystem.h"
+
+#include "NetworkReactor.h"
+
+#include "RtspNetworkSubsystem.generated.h"
+
+/**
+ * @brief Runtime statistics of the network thread shared by every
+ *        URtspClientComponent.
+ */
+USTRUCT(BlueprintType)
+struct RTSPDISPLAY_API FRtspNetworkStats
+{
+  GENERATED_BODY()
+
+  // Number of sockets (RTSP, RTP and RTCP, of every stream) the network
+  // thread is waiting on
+  UPROPERTY(BlueprintReadOnly, Category = "RTSP|Stats")
+  int32 Sockets = 0;
+
+  // Number of times the network thread woke up with sockets to handle
+  UPROPERTY(BlueprintReadOnly, Category = "RTSP|Stats")
+  int32 Wakeups = 0;
+
+  // Number of socket events the network thread has handled
+  UPROPERTY(BlueprintReadOnly, Category = "RTSP|Stats")
+  int32 Events = 0;
+
+  // Average number of socket events handled per wakeup. Goes up with the
+  // number of streams, as each wakeup serves more of them at once
+  UPROPERTY(BlueprintReadOnly, Category = "RTSP|Stats")
+  float EventsPerWakeup = 0.0f;
+
+  // Average time (in microseconds) the network thread spent handling the
+  // events of one wakeup
+  UPROPERTY(BlueprintReadOnly, Category = "RTSP|Stats")
+  float LoopTimeUs = 0.0f;
+
+  // Longest time (in microseconds) the network thread spent handling the
+  // events of one wakeup
+  UPROPERTY(BlueprintReadOnly, Category = "RTSP|Stats")
+  float MaxLoopTimeUs = 0.0f;
+};
+
+/**
+ * @brief Owns the network thread which every URtspClientComponent receives
+ *        on, so that the number of threads doesn't grow with the number of
+ *        streams.
+ *
+ * @details The RTSP, RTP and RTCP sockets of all the streams are registered
+ *          with one FNetworkReactor, which waits on them together and calls
+ *          the stream's handler for each socket that is ready. It lives as
+ *          long as the engine, so it's there for every world (and the
+ *          editor).
+ */
+UCLASS()
+class RTSPDISPLAY_API URtspNetworkSubsystem : public UEngineSubsystem
+{
+  GENERATED_BODY()
+public:
+
+  void Initialize(FSubsystemCollectionBase &Collection) override;
+  void Deinitialize() override;
+
+  // Get the reactor to register sockets with, or nullptr if it isn't running.
+  FNetworkReactor *get_reactor() const;
+
+  // Get the reactor of the engine's subsystem, or nullptr if there isn't one.
+  static FNetworkReactor *get_engine_reactor();
+
+  // Get a snapshot of the runtime statistics of the network thread.
+  UFUNCTION(BlueprintPure, Category = "RTSP")
+  FRtspNetworkStats get_stats() const;
+
+ protected:
+
+  std::unique_ptr<FNetworkReactor> reactor_;
+};
@@ -0,0 +1,194 @@
+#include "TcpConnection.h"
+
+#if RTSP_USE_NATIVE_SOCKETS
+#include "NativeSocket.h"
+#else
+#include "IPAddress.h"
+#include "Sockets.h"
+#include "SocketSubsystem.h"
+#endif
+
+FTcpConnection::FTcpConnection()
+{
+#if RTSP_USE_NATIVE_SOCKETS
+  socket_fd_ = NativeSocket::open(SOCK_STREAM);
+  if (socket_fd_ == NativeSocket::INVALID) {
+    UE_LOG(LogTemp, Error, TEXT("Failed to create RTSP socket, error = %d"), NativeSocket::last_error());
+  }
+#else
+  socket_ = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->CreateSocket(NAME_Stream, TEXT("RTSP Socket"), false);
+  if (socket_) {
+    socket_->SetNonBlocking(true);
+  } else {
+    UE_LOG(LogTemp, Error, TEXT("Failed to create RTSP socket"));
+  }
+#endif
+}
+
+FTcpConnection::~FTcpConnection()
+{
+#if RTSP_USE_NATIVE_SOCKETS
+  if (socket_fd_ != NativeSocket::INVALID) {
+    NativeSocket::close(socket_fd_);
+    socket_fd_ = NativeSocket::INVALID;
+  }
+#else
+  if (socket_) {
+    socket_->Close();
+    ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->DestroySocket(socket_);
+    socket_ = nullptr;
+  }
+#endif
+}
+
+bool FTcpConnection::is_valid() const
+{
+#if RTSP_USE_NATIVE_SOCKETS
+  return socket_fd_ != NativeSocket::INVALID;
+#else
+  return socket_ != nullptr;
+#endif
+}
+
+bool FTcpConnection::connect(uint32 ip, int port)
+{
+  if (!is_valid()) {
+    return false;
+  }
+#if RTSP_USE_NATIVE_SOCKETS
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(ip);
+  addr.sin_port = htons(port);
+  if (::connect(socket_fd_, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0) {
+    int error = NativeSocket::last_error();
+    if (!NativeSocket::would_block(error)) {
+      UE_LOG(LogTemp, Error, TEXT("Failed to connect RTSP socket, error = %d"), error);
+      return false;
+    }
+  }
+  return true;
+#else
+  auto addr = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->CreateInternetAddr();
+  addr->SetIp(ip);
+  addr->SetPort(port);
+  // a non-blocking socket reports success while the connection is in progress
+  return socket_->Connect(*addr);
+#endif
+}
+
+bool FTcpConnection::finish_connect()
+{
+  if (!is_valid()) {
+    return false;
+  }
+#if RTSP_USE_NATIVE_SOCKETS
+  int error = 0;
+  socklen_t error_size = sizeof(error);
+  if (::getsockopt(socket_fd_, SOL_SOCKET, SO_ERROR, reinterpret_cast<char *>(&error), &error_size) != 0 ||
+      error != 0) {
+    UE_LOG(LogTemp, Error, TEXT("RTSP socket connection error, error = %d"), error);
+    return false;
+  }
+  return true;
+#else
+  return socket_->GetConnectionState() == ESocketConnectionState::SCS_Connected;
+#endif
+}
+
+bool FTcpConnection::send(const uint8 *data, int size, FTimespan wait_time)
+{
+  if (!is_valid()) {
+    return false;
+  }
+  while (size > 0) {
+#if RTSP_USE_NATIVE_SOCKETS
+    int bytes_sent = static_cast<int>(
+        ::send(socket_fd_, reinterpret_cast<const char *>(data), size, NativeSocket::SEND_FLAGS));
+    if (bytes_sent < 0 && !NativeSocket::would_block(NativeSocket::last_error())) {
+      return false;
+    }
+    if (bytes_sent <= 0) {
+      pollfd poll_fd = {};
+      poll_fd.fd = socket_fd_;
+      poll_fd.events = POLLOUT;
+      if (NativeSocket::poll(&poll_fd, 1, static_cast<int>(wait_time.GetTotalMilliseconds())) <= 0) {
+        return false;
+      }
+      continue;
+    }
+#else
+    int32 bytes_sent = 0;
+    if (!socket_->Send(data, size, bytes_sent) &&
+        socket_->GetConnectionState() != ESocketConnectionState::SCS_Connected) {
+      return false;
+    }
+    if (bytes_sent <= 0) {
+      if (!socket_->Wait(ESocketWaitConditions::WaitForWrite, wait_time)) {
+        return false;
+      }
+      continue;
+    }
+#endif
+    data += bytes_sent;
+    size -= static_cast<int>(bytes_sent);
+  }
+  return true;
+}
+
+int FTcpConnection::receive(uint8 *buffer, int size, FTimespan wait_time)
+{
+  if (!is_valid()) {
+    return -1;
+  }
+#if RTSP_USE_NATIVE_SOCKETS
+  int bytes_received = static_cast<int>(::recv(socket_fd_, reinterpret_cast<char *>(buffer), size, 0));
+  if (bytes_received < 0 && NativeSocket::would_block(NativeSocket::last_error())) {
+    pollfd poll_fd = {};
+    poll_fd.fd = socket_fd_;
+    poll_fd.events = POLLIN;
+    if (NativeSocket::poll(&poll_fd, 1, static_cast<int>(wait_time.GetTotalMilliseconds())) <= 0) {
+      return 0;
+    }
+    bytes_received = static_cast<int>(::recv(socket_fd_, reinterpret_cast<char *>(buffer), size, 0));
+    if (bytes_received < 0 && NativeSocket::would_block(NativeSocket::last_error())) {
+      return 0;
+    }
+  }
+  // 0 is the server closing the connection
+  return bytes_received > 0 ? bytes_received : -1;
+#else
+  if (!socket_->Wait(ESocketWaitConditions::WaitForRead, wait_time)) {
+    return 0;
+  }
+  int32 bytes_received = 0;
+  bool received = socket_->Recv(buffer, size, bytes_received, ESocketReceiveFlags::None);
+  if (received && bytes_received > 0) {
+    return bytes_received;
+  }
+  // the socket was readable, so nothing to read is the server closing the
+  // connection
+  return socket_->GetConnectionState() == ESocketConnectionState::SCS_Connected && !received ? 0 : -1;
+#endif
+}
+
+void FTcpConnection::shutdown()
+{
+  if (!is_valid()) {
+    return;
+  }
+#if RTSP_USE_NATIVE_SOCKETS
+  ::shutdown(socket_fd_, NativeSocket::SHUTDOWN_BOTH);
+#else
+  socket_->Shutdown(ESocketShutdownMode::ReadWrite);
+#endif
+}
+
+FReactorSocket FTcpConnection::get_reactor_socket() const
+{
+#if RTSP_USE_NATIVE_SOCKETS
+  return socket_fd_;
+#else
+  return socket_;
+#endif
+}
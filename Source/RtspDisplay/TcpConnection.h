@@ -0,0 +1,78 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include "NetworkReactor.h"
+
+class FSocket;
+
+/**
+ * @brief A non-blocking TCP connection to an RTSP server.
+ *
+ * @details Connecting only starts the connection; it is made in the
+ *          background, and the socket becomes writable (see
+ *          get_reactor_socket()) once it's done, when finish_connect() tells
+ *          whether it succeeded. Where there are native sockets (see
+ *          RTSP_USE_NATIVE_SOCKETS) this is one, which the network reactor
+ *          can wait on; on other platforms it's an FSocket.
+ */
+class FTcpConnection
+{
+public:
+  // Create the (not yet connected) socket.
+  FTcpConnection();
+
+  ~FTcpConnection();
+
+  // True if the socket was created successfully.
+  bool is_valid() const;
+
+  /**
+   * @brief Start connecting to the server, without waiting for it.
+   * @param ip The IPv4 address of the server, in host byte order.
+   * @param port The port of the server.
+   * @return False if the connection failed right away.
+   */
+  bool connect(uint32 ip, int port);
+
+  /**
+   * @brief Check whether the connection was made, once the socket is
+   *        writable.
+   * @return True if the socket is connected.
+   */
+  bool finish_connect();
+
+  /**
+   * @brief Send all of the data, waiting up to wait_time for room in the
+   *        socket's send buffer whenever it is full.
+   * @param data The data to send.
+   * @param size The number of bytes to send.
+   * @param wait_time How long to wait for room in the send buffer.
+   * @return True if all of the data was sent.
+   */
+  bool send(const uint8 *data, int size, FTimespan wait_time);
+
+  /**
+   * @brief Wait up to wait_time for data, then receive what is available.
+   * @param buffer The buffer to receive into.
+   * @param size The size of the buffer.
+   * @param wait_time How long to wait for data.
+   * @return The number of bytes received, 0 if none arrived in time, or -1
+   *         if the connection was closed or failed.
+   */
+  int receive(uint8 *buffer, int size, FTimespan wait_time);
+
+  // Shut the connection down in both directions, e.g. to make the server
+  // see it close before the socket is destroyed.
+  void shutdown();
+
+  // The socket, to wait on with an FNetworkReactor.
+  FReactorSocket get_reactor_socket() const;
+
+protected:
+#if RTSP_USE_NATIVE_SOCKETS
+  FReactorSocket socket_fd_;
+#else
+  FSocket *socket_ = nullptr;
+#endif
+};
@@ -0,0 +1,143 @@
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <vector>
+
+#include "Math/RandomStream.h"
+
+#include "jpeg_decoder.hpp"
+#include "jpeg_kernels.hpp"
+
+// a 32 x 16, 4:2:0 baseline jpeg (with the standard huffman tables, as rtp
+// jpeg uses) of a noisy pattern, so that its blocks have plenty of ac
+// coefficients: its quantization tables (in zig-zag order) and scan data.
+// any such jpeg will do, since the test only compares the kernels with each
+// other. to make another, save an image with libjpeg (e.g. PIL's
+// image.save(file, "JPEG", quality=80, subsampling=2) without optimize or
+// progressive, so that the huffman tables are the standard ones) and copy
+// out the 64 bytes of each table of the DQT segment(s) and the bytes between
+// the end of the SOS segment and the EOI marker
+static const uint8_t FIXTURE_Q0[] = {
+    0x06, 0x04, 0x05, 0x06, 0x05, 0x04, 0x06, 0x06, 0x05, 0x06, 0x07, 0x07,
+    0x06, 0x08, 0x0a, 0x10, 0x0a, 0x0a, 0x09, 0x09, 0x0a, 0x14, 0x0e, 0x0f,
+    0x0c, 0x10, 0x17, 0x14, 0x18, 0x18, 0x17, 0x14, 0x16, 0x16, 0x1a, 0x1d,
+    0x25, 0x1f, 0x1a, 0x1b, 0x23, 0x1c, 0x16, 0x16, 0x20, 0x2c, 0x20, 0x23,
+    0x26, 0x27, 0x29, 0x2a, 0x29, 0x19, 0x1f, 0x2d, 0x30, 0x2d, 0x28, 0x30,
+    0x25, 0x28, 0x29, 0x28,
+};
+
+static const uint8_t FIXTURE_Q1[] = {
+    0x07, 0x07, 0x07, 0x0a, 0x08, 0x0a, 0x13, 0x0a, 0x0a, 0x13, 0x28, 0x1a,
+    0x16, 0x1a, 0x28, 0x28, 0x28, 0x28, 0x28, 0x28, 0x28, 0x28, 0x28, 0x28,
+    0x28, 0x28, 0x28, 0x28, 0x28, 0x28, 0x28, 0x28, 0x28, 0x28, 0x28, 0x28,
+    0x28, 0x28, 0x28, 0x28, 0x28, 0x28, 0x28, 0x28, 0x28, 0x28, 0x28, 0x28,
+    0x28, 0x28, 0x28, 0x28, 0x28, 0x28, 0x28, 0x28, 0x28, 0x28, 0x28, 0x28,
+    0x28, 0x28, 0x28, 0x28,
+};
+
+static const uint8_t FIXTURE_SCAN[] = {
+    0xa5, 0xe2, 0x4b, 0xdf, 0xf8, 0x59, 0x1a, 0x45, 0x9b, 0xcc, 0x0e, 0x9c,
+    0x34, 0xf1, 0xc0, 0xff, 0x00, 0x5d, 0xe6, 0x79, 0x9d, 0x7f, 0xbb, 0x8c,
+    0x6c, 0xf7, 0xce, 0x7f, 0x3d, 0xab, 0x8b, 0xcf, 0xf8, 0x4b, 0xfc, 0x31,
+    0x0b, 0xcc, 0xa6, 0xd3, 0xec, 0x80, 0xe0, 0x67, 0xcc, 0xdd, 0xbf, 0xf2,
+    0xc7, 0xdd, 0xf7, 0xeb, 0x5c, 0x97, 0x88, 0xaf, 0x7f, 0xe1, 0x22, 0xd1,
+    0xad, 0x1e, 0x51, 0xf6, 0x7f, 0xb3, 0x8e, 0x01, 0x3b, 0xf3, 0xbb, 0xf2,
+    0xc7, 0xdd, 0xad, 0xab, 0xab, 0xdf, 0xb5, 0x78, 0x66, 0x16, 0x94, 0x6c,
+    0xda, 0x0f, 0x43, 0x9e, 0xb8, 0xa5, 0x3e, 0x0a, 0xe5, 0x84, 0x23, 0x18,
+    0x72, 0xf2, 0xc9, 0xd9, 0x6f, 0xcb, 0x7d, 0xfd, 0x6f, 0xf8, 0x1d, 0xb8,
+    0xda, 0x1c, 0x98, 0x8a, 0xca, 0x0b, 0x97, 0x96, 0x96, 0x8b, 0x7e, 0x5b,
+    0xef, 0xaf, 0xda, 0xe6, 0xf3, 0xd8, 0xeb, 0x34, 0xeb, 0xdf, 0xed, 0x6f,
+    0x0e, 0x97, 0x9c, 0x79, 0x3e, 0x5e, 0x71, 0x83, 0xbb, 0x76, 0x7f, 0x2f,
+    0x4a, 0xe8, 0x3c, 0x31, 0xa8, 0x6d, 0xd2, 0xda, 0x59, 0x53, 0xee, 0xab,
+    0x2a, 0xf6, 0xf4, 0xe4, 0xfe, 0x35, 0xc5, 0xe9, 0xb7, 0xc3, 0x4e, 0xf0,
+    0xe1, 0x79, 0x41, 0x93, 0xcc, 0x04, 0x2f, 0x3b, 0x71, 0x8f, 0xff, 0x00,
+    0x5d, 0x68, 0xf8, 0x6f, 0x55, 0x7f, 0x0b, 0x59, 0x5c, 0x34, 0xe7, 0xed,
+    0x3f, 0x68, 0xde, 0x00, 0xff, 0x00, 0x57, 0xb4, 0x27, 0x6e, 0x87, 0xa8,
+    0x61, 0xd7, 0xb6, 0x3f, 0x0f, 0x32, 0xa7, 0x0e, 0xc7, 0x00, 0xa7, 0xee,
+    0x3b, 0x49, 0xe8, 0x95, 0xb7, 0x5a, 0xee, 0xf6, 0xb3, 0xfe, 0xbb, 0xfc,
+    0xf4, 0x70, 0x9e, 0xd2, 0xb6, 0x12, 0x30, 0x5f, 0xf2, 0xee, 0x56, 0x5f,
+    0x9e, 0xbf, 0xe6, 0x7f,
+};
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FJpegKernelsIdctTest, "RtspDisplay.JpegKernels.Idct",
+                                 EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FJpegKernelsIdctTest::RunTest(const FString &Parameters) {
+  // random blocks, from dc only to dense, through every supported idct
+  const auto &scalar = espp::JpegKernels::get_scalar();
+  FRandomStream random(563);
+  int16_t q_table[64];
+  for (auto &q : q_table) {
+    q = static_cast<int16_t>(random.RandRange(1, 40));
+  }
+  for (int block = 0; block < 1000; block++) {
+    int16_t coefficients[64] = {};
+    uint32_t row_mask = 0;
+    int num_coefficients = random.RandRange(1, 64);
+    coefficients[0] = static_cast<int16_t>(random.RandRange(-50, 50));
+    for (int i = 1; i < num_coefficients; i++) {
+      int index = random.RandRange(1, 63);
+      coefficients[index] = static_cast<int16_t>(random.RandRange(-50, 50));
+    }
+    for (int v = 0; v < 8; v++) {
+      for (int u = v == 0 ? 1 : 0; u < 8; u++) {
+        if (coefficients[v * 8 + u] != 0) {
+          row_mask |= 1 << v;
+        }
+      }
+    }
+    uint8_t expected[64];
+    scalar.idct(coefficients, q_table, row_mask, expected, 8);
+    for (auto kernels : espp::JpegKernels::get_supported()) {
+      uint8_t out[64];
+      kernels->idct(coefficients, q_table, row_mask, out, 8);
+      if (memcmp(out, expected, sizeof(out)) != 0) {
+        AddError(FString::Printf(TEXT("%s idct differs from the scalar one on block %d"), ANSI_TO_TCHAR(kernels->name),
+                                 block));
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FJpegKernelsDecodeTest, "RtspDisplay.JpegKernels.Decode",
+                                 EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FJpegKernelsDecodeTest::RunTest(const FString &Parameters) {
+  // the fixture, at every scale, with every supported set of kernels, has to
+  // give exactly what the scalar reference gives
+  std::string_view scan(reinterpret_cast<const char *>(FIXTURE_SCAN), sizeof(FIXTURE_SCAN));
+  std::string_view q0_table(reinterpret_cast<const char *>(FIXTURE_Q0), sizeof(FIXTURE_Q0));
+  std::string_view q1_table(reinterpret_cast<const char *>(FIXTURE_Q1), sizeof(FIXTURE_Q1));
+  for (int scale : {1, 2, 4, 8}) {
+    std::vector<uint8_t> expected;
+    for (auto kernels : espp::JpegKernels::get_supported()) {
+      espp::JpegDecoder decoder;
+      decoder.set_kernels(*kernels);
+      decoder.set_scale(scale);
+      if (!decoder.decode(scan, q0_table, q1_table, 32, 16, espp::JpegDecoder::Subsampling::YUV420)) {
+        AddError(FString::Printf(TEXT("%s kernels failed to decode the fixture at 1/%d"),
+                                 ANSI_TO_TCHAR(kernels->name), scale));
+        return false;
+      }
+      std::vector<uint8_t> bgra(static_cast<size_t>(decoder.get_width()) * decoder.get_height() * 4);
+      decoder.convert_to_bgra(bgra.data(), static_cast<size_t>(decoder.get_width()) * 4);
+      if (expected.empty()) {
+        // the scalar kernels come first
+        expected = std::move(bgra);
+      } else if (bgra != expected) {
+        AddError(FString::Printf(TEXT("%s kernels decode the fixture differently from the scalar ones at 1/%d"),
+                                 ANSI_TO_TCHAR(kernels->name), scale));
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+#endif // WITH_DEV_AUTOMATION_TESTS
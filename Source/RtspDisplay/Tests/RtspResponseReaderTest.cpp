@@ -0,0 +1,179 @@
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "rtsp_response_reader.hpp"
+
+namespace {
+// what the tests check of each response
+struct ParsedResponse {
+  int status_code;
+  int cseq;
+  std::string session;
+  std::string body;
+};
+
+const std::string SDP = "v=0\r\nm=video 0 RTP/AVP 26\r\na=framesize:26 640-480\r\n";
+
+// three pipelined responses, as the server would send them back to back:
+// OPTIONS, DESCRIBE (with the sdp as its body, and lower case header names)
+// and a SETUP which failed (with bare "\n" line endings)
+const std::string PIPELINED = "RTSP/1.0 200 OK\r\nCSeq: 1\r\nPublic: DESCRIBE, SETUP, PLAY\r\n\r\n"
+                                     "RTSP/1.0 200 OK\r\ncseq:2\r\ncontent-length: " +
+                                     std::to_string(SDP.size()) + "\r\nContent-Type: application/sdp\r\n\r\n" + SDP +
+                                     "RTSP/1.0 454 Session Not Found\nCSeq: 3\nSession: 12345678;timeout=60\n\n";
+
+// feed the bytes to the reader in pieces, ending at each of the cuts, and
+// collect the responses it hands out
+std::vector<ParsedResponse> feed(espp::RtspResponseReader &reader, std::string_view bytes, std::vector<size_t> cuts) {
+  std::vector<ParsedResponse> responses;
+  cuts.push_back(bytes.size());
+  size_t start = 0;
+  for (size_t cut : cuts) {
+    size_t size = cut - start;
+    if (size > 0) {
+      memcpy(reader.prepare(size), bytes.data() + start, size);
+      reader.commit(size);
+    }
+    start = cut;
+    while (auto response = reader.next()) {
+      responses.push_back({response->status_code, response->cseq, std::string(response->session),
+                           std::string(response->body)});
+    }
+  }
+  return responses;
+}
+
+bool check_pipelined(FAutomationTestBase &test, const espp::RtspResponseReader &reader,
+                     const std::vector<ParsedResponse> &responses, const FString &how) {
+  if (!test.TestEqual(FString::Printf(TEXT("Number of responses (%s)"), *how), static_cast<int>(responses.size()),
+                      3)) {
+    return false;
+  }
+  bool passed = true;
+  for (int i = 0; i < 3; i++) {
+    passed &= test.TestEqual(FString::Printf(TEXT("CSeq of response %d (%s)"), i, *how), responses[i].cseq, i + 1);
+  }
+  passed &= test.TestEqual(FString::Printf(TEXT("Status code (%s)"), *how), responses[2].status_code, 454);
+  passed &= test.TestTrue(FString::Printf(TEXT("SDP body (%s)"), *how), responses[1].body == SDP);
+  passed &= test.TestTrue(FString::Printf(TEXT("Session (%s)"), *how), responses[2].session == "12345678");
+  passed &= test.TestFalse(FString::Printf(TEXT("Error (%s)"), *how), reader.has_error());
+  return passed;
+}
+} // namespace
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FRtspResponseReaderSplitTest, "RtspDisplay.RtspResponseReader.Split",
+                                 EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FRtspResponseReaderSplitTest::RunTest(const FString &Parameters) {
+  // all at once, i.e. coalesced into one read
+  {
+    espp::RtspResponseReader reader;
+    if (!check_pipelined(*this, reader, feed(reader, PIPELINED, {}), TEXT("coalesced"))) {
+      return false;
+    }
+  }
+  // split in two at every byte
+  for (size_t cut = 1; cut < PIPELINED.size(); cut++) {
+    espp::RtspResponseReader reader;
+    FString how = FString::Printf(TEXT("split at %d"), static_cast<int32>(cut));
+    if (!check_pipelined(*this, reader, feed(reader, PIPELINED, {cut}), how)) {
+      return false;
+    }
+  }
+  // one byte at a time
+  {
+    espp::RtspResponseReader reader;
+    std::vector<size_t> cuts;
+    for (size_t cut = 1; cut < PIPELINED.size(); cut++) {
+      cuts.push_back(cut);
+    }
+    if (!check_pipelined(*this, reader, feed(reader, PIPELINED, cuts), TEXT("byte by byte"))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FRtspResponseReaderFramingTest, "RtspDisplay.RtspResponseReader.Framing",
+                                 EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FRtspResponseReaderFramingTest::RunTest(const FString &Parameters) {
+  // a blank line left over after the last response isn't part of the next
+  {
+    espp::RtspResponseReader reader;
+    auto responses = feed(reader, "\r\nRTSP/1.0 200 OK\r\nCSeq: 7\r\n\r\n", {1});
+    TestEqual(TEXT("Responses after a leading blank line"), static_cast<int>(responses.size()), 1);
+    TestTrue(TEXT("CSeq after a leading blank line"), responses.size() == 1 && responses[0].cseq == 7);
+    TestFalse(TEXT("Error after a leading blank line"), reader.has_error());
+  }
+  // a response without a cseq, e.g. from a server which leaves it out of
+  // its errors
+  {
+    espp::RtspResponseReader reader;
+    auto responses = feed(reader, "RTSP/1.0 500 Internal Server Error\r\n\r\n", {});
+    TestTrue(TEXT("Response without a CSeq"),
+             responses.size() == 1 && responses[0].cseq == -1 && responses[0].status_code == 500);
+  }
+  // the headers and the whole text of a response
+  {
+    espp::RtspResponseReader reader;
+    std::string text = "RTSP/1.0 200 OK\r\nCSeq: 1\r\nPublic: DESCRIBE\r\n\r\n";
+    memcpy(reader.prepare(text.size()), text.data(), text.size());
+    reader.commit(text.size());
+    auto response = reader.next();
+    if (!TestNotNull(TEXT("Response"), response)) {
+      return false;
+    }
+    TestTrue(TEXT("Header, ignoring case"), response->get_header("public") == "DESCRIBE");
+    TestTrue(TEXT("Missing header"), response->get_header("Session").empty());
+    TestTrue(TEXT("Status line"), response->status_line == "RTSP/1.0 200 OK");
+    TestTrue(TEXT("Text"), response->text == text);
+  }
+  return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FRtspResponseReaderErrorTest, "RtspDisplay.RtspResponseReader.Errors",
+                                 EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FRtspResponseReaderErrorTest::RunTest(const FString &Parameters) {
+  {
+    espp::RtspResponseReader reader;
+    feed(reader, "HTTP/1.1 200 OK\r\n\r\n", {});
+    TestTrue(TEXT("Malformed status line"), reader.has_error());
+  }
+  {
+    espp::RtspResponseReader reader;
+    feed(reader, "RTSP/1.0 2x0 OK\r\n\r\n", {});
+    TestTrue(TEXT("Malformed status code"), reader.has_error());
+  }
+  {
+    espp::RtspResponseReader reader;
+    feed(reader, "RTSP/1.0 200 OK\r\nContent-Length: ten\r\n\r\n", {});
+    TestTrue(TEXT("Malformed Content-Length"), reader.has_error());
+  }
+  {
+    espp::RtspResponseReader reader(256);
+    feed(reader, "RTSP/1.0 200 OK\r\nContent-Length: 1000\r\n\r\n", {});
+    TestTrue(TEXT("Body bigger than the limit"), reader.has_error());
+  }
+  {
+    espp::RtspResponseReader reader(256);
+    feed(reader, "RTSP/1.0 200 OK\r\nServer: " + std::string(300, 'x'), {});
+    TestTrue(TEXT("Headers bigger than the limit"), reader.has_error());
+  }
+  {
+    // and nothing comes out after an error
+    espp::RtspResponseReader reader;
+    auto responses = feed(reader, "garbage\r\n\r\nRTSP/1.0 200 OK\r\nCSeq: 1\r\n\r\n", {});
+    TestTrue(TEXT("Responses after an error"), responses.empty() && reader.has_error());
+  }
+  return true;
+}
+
+#endif // WITH_DEV_AUTOMATION_TESTS
@@ -0,0 +1,241 @@
+#include "UdpBatchReceiver.h"
+
+#if RTSP_USE_NATIVE_SOCKETS
+#include "NativeSocket.h"
+#else
+#include "Common/UdpSocketBuilder.h"
+#include "Sockets.h"
+#include "SocketSubsystem.h"
+#endif
+
+FUdpBatchReceiver::FUdpBatchReceiver(const FString &name, int port, int receive_buffer_size,
+                                     espp::PacketBufferPool &pool)
+  : pool_(pool)
+{
+#if RTSP_USE_NATIVE_SOCKETS
+  socket_fd_ = NativeSocket::open(SOCK_DGRAM);
+  if (socket_fd_ == NativeSocket::INVALID) {
+    UE_LOG(LogTemp, Error, TEXT("%s: failed to create socket, error = %d"), *name, NativeSocket::last_error());
+    return;
+  }
+  int reuse = 1;
+  ::setsockopt(socket_fd_, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char *>(&reuse), sizeof(reuse));
+  if (::setsockopt(socket_fd_, SOL_SOCKET, SO_RCVBUF, reinterpret_cast<const char *>(&receive_buffer_size),
+                   sizeof(receive_buffer_size)) != 0) {
+    UE_LOG(LogTemp, Warning, TEXT("%s: failed to set receive buffer size to %d"), *name, receive_buffer_size);
+  }
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port);
+  if (::bind(socket_fd_, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0) {
+    UE_LOG(LogTemp, Error, TEXT("%s: failed to bind to port %d, error = %d"), *name, port,
+           NativeSocket::last_error());
+    NativeSocket::close(socket_fd_);
+    socket_fd_ = NativeSocket::INVALID;
+    return;
+  }
+#else
+  socket_ = FUdpSocketBuilder(*name)
+    .AsReusable()
+    .BoundToPort(port)
+    .WithReceiveBufferSize(receive_buffer_size)
+    .WithSendBufferSize(6 * 1024)
+    .Build();
+#endif
+}
+
+FUdpBatchReceiver::~FUdpBatchReceiver()
+{
+#if RTSP_USE_NATIVE_SOCKETS
+  if (socket_fd_ != NativeSocket::INVALID) {
+    NativeSocket::close(socket_fd_);
+    socket_fd_ = NativeSocket::INVALID;
+  }
+#else
+  if (socket_) {
+    socket_->Close();
+    ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->DestroySocket(socket_);
+    socket_ = nullptr;
+  }
+#endif
+}
+
+bool FUdpBatchReceiver::is_valid() const
+{
+#if RTSP_USE_NATIVE_SOCKETS
+  return socket_fd_ != NativeSocket::INVALID;
+#else
+  return socket_ != nullptr;
+#endif
+}
+
+int FUdpBatchReceiver::receive(espp::PacketBuffer *packets, int max_packets, FTimespan wait_time)
+{
+  if (!is_valid() || max_packets <= 0) {
+    return 0;
+  }
+#if RTSP_USE_NATIVE_SOCKETS
+  return receive_native(packets, max_packets, wait_time);
+#else
+  return receive_fsocket(packets, max_packets, wait_time);
+#endif
+}
+
+FReactorSocket FUdpBatchReceiver::get_reactor_socket() const
+{
+#if RTSP_USE_NATIVE_SOCKETS
+  return socket_fd_;
+#else
+  return socket_;
+#endif
+}
+
+FUdpBatchReceiver::Stats FUdpBatchReceiver::get_stats() const
+{
+  Stats stats;
+  stats.Packets = packets_.load(std::memory_order_relaxed);
+  stats.Syscalls = syscalls_.load(std::memory_order_relaxed);
+  stats.Dropped = dropped_.load(std::memory_order_relaxed);
+  stats.Truncated = truncated_.load(std::memory_order_relaxed);
+  return stats;
+}
+
+float FUdpBatchReceiver::get_packets_per_syscall() const
+{
+  auto stats = get_stats();
+  return stats.Syscalls > 0 ? static_cast<float>(stats.Packets) / stats.Syscalls : 0.0f;
+}
+
+void FUdpBatchReceiver::count_packet(size_t bytes, size_t capacity)
+{
+  packets_.fetch_add(1, std::memory_order_relaxed);
+  if (bytes >= capacity) {
+    truncated_.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+#if RTSP_USE_NATIVE_SOCKETS
+
+int FUdpBatchReceiver::receive_native(espp::PacketBuffer *packets, int max_packets, FTimespan wait_time)
+{
+  pollfd poll_fd = {};
+  poll_fd.fd = socket_fd_;
+  poll_fd.events = POLLIN;
+  if (NativeSocket::poll(&poll_fd, 1, static_cast<int>(wait_time.GetTotalMilliseconds())) <= 0) {
+    return 0;
+  }
+
+  // gather the buffers left over from the last batch at the front, then top
+  // up the batch from the pool
+  max_packets = FMath::Min(max_packets, MAX_BATCH_SIZE);
+  int num_buffers = 0;
+  for (int i = 0; i < MAX_BATCH_SIZE; i++) {
+    if (spare_buffers_[i]) {
+      if (i != num_buffers) {
+        spare_buffers_[num_buffers] = std::move(spare_buffers_[i]);
+      }
+      num_buffers++;
+    }
+  }
+  while (num_buffers < max_packets) {
+    // only the first buffer of a batch is required, the rest are a bonus
+    spare_buffers_[num_buffers] = num_buffers == 0 ? pool_.acquire() : pool_.try_acquire();
+    if (!spare_buffers_[num_buffers]) {
+      break;
+    }
+    num_buffers++;
+  }
+  num_buffers = FMath::Min(num_buffers, max_packets);
+
+  if (num_buffers == 0) {
+    // no buffers left, so drain the datagram (the rest of it is discarded by
+    // the socket) and drop it, so it doesn't sit in the receive buffer
+    uint8_t discard[16];
+    if (NativeSocket::receive_datagram(socket_fd_, discard, sizeof(discard)) >= 0) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+    }
+    return 0;
+  }
+
+#if RTSP_USE_RECVMMSG
+  mmsghdr messages[MAX_BATCH_SIZE];
+  iovec iovecs[MAX_BATCH_SIZE];
+  for (int i = 0; i < num_buffers; i++) {
+    iovecs[i].iov_base = spare_buffers_[i].data();
+    iovecs[i].iov_len = spare_buffers_[i].capacity();
+    messages[i] = {};
+    messages[i].msg_hdr.msg_iov = &iovecs[i];
+    messages[i].msg_hdr.msg_iovlen = 1;
+  }
+  int num_received = ::recvmmsg(socket_fd_, messages, num_buffers, MSG_DONTWAIT, nullptr);
+  if (num_received <= 0) {
+    return 0;
+  }
+  syscalls_.fetch_add(1, std::memory_order_relaxed);
+  for (int i = 0; i < num_received; i++) {
+    spare_buffers_[i].set_size(messages[i].msg_len);
+    packets_.fetch_add(1, std::memory_order_relaxed);
+    if (messages[i].msg_hdr.msg_flags & MSG_TRUNC) {
+      truncated_.fetch_add(1, std::memory_order_relaxed);
+    }
+    packets[i] = std::move(spare_buffers_[i]);
+  }
+  return num_received;
+#else
+  // one datagram per call, until there are no more pending
+  int num_received = 0;
+  while (num_received < num_buffers) {
+    auto &buffer = spare_buffers_[num_received];
+    int bytes_read =
+        NativeSocket::receive_datagram(socket_fd_, buffer.data(), static_cast<int>(buffer.capacity()));
+    if (bytes_read < 0) {
+      break;
+    }
+    syscalls_.fetch_add(1, std::memory_order_relaxed);
+    count_packet(bytes_read, buffer.capacity());
+    buffer.set_size(bytes_read);
+    packets[num_received++] = std::move(buffer);
+  }
+  return num_received;
+#endif
+}
+
+#else
+
+int FUdpBatchReceiver::receive_fsocket(espp::PacketBuffer *packets, int max_packets, FTimespan wait_time)
+{
+  if (!socket_->Wait(ESocketWaitConditions::WaitForRead, wait_time)) {
+    return 0;
+  }
+  // FSocket can only read one datagram per call, so read everything that is
+  // already pending
+  int num_received = 0;
+  uint32 pending_size = 0;
+  while (num_received < max_packets) {
+    if (num_received > 0 && !socket_->HasPendingData(pending_size)) {
+      break;
+    }
+    int32 bytes_read = 0;
+    auto buffer = pool_.acquire();
+    if (!buffer) {
+      // no buffers left, so drain the datagram and drop it
+      uint8_t discard[16];
+      if (socket_->Recv(discard, sizeof(discard), bytes_read, ESocketReceiveFlags::None)) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+      }
+      break;
+    }
+    if (!socket_->Recv(buffer.data(), static_cast<int32>(buffer.capacity()), bytes_read, ESocketReceiveFlags::None) ||
+        bytes_read <= 0) {
+      break;
+    }
+    syscalls_.fetch_add(1, std::memory_order_relaxed);
+    count_packet(bytes_read, buffer.capacity());
+    buffer.set_size(bytes_read);
+    packets[num_received++] = std::move(buffer);
+  }
+  return num_received;
+}
+
+#endif
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <atomic>
+
+#include "CoreMinimal.h"
+
+#include "NetworkReactor.h"
+#include "packet_buffer_pool.hpp"
+
+#if PLATFORM_LINUX || PLATFORM_ANDROID
+#define RTSP_USE_RECVMMSG 1
+#else
+#define RTSP_USE_RECVMMSG 0
+#endif
+
+class FSocket;
+
+/**
+ * @brief Receives batches of UDP datagrams into pooled packet buffers.
+ *
+ * @details Where there are native sockets (see RTSP_USE_NATIVE_SOCKETS)
+ *          this binds a native UDP socket. On Linux (and Android) it pulls up
+ *          to MAX_BATCH_SIZE datagrams per system call with recvmmsg(), and
+ *          on the other platforms with native sockets it reads them one
+ *          recv() at a time. Otherwise it falls back to an FSocket. Either
+ *          way it reads every datagram that is already pending after waiting
+ *          for the first one.
+ *          Either way the caller gets a batch of filled PacketBuffers that it
+ *          can hand straight to the depacketizer.
+ */
+class FUdpBatchReceiver
+{
+public:
+  static constexpr int MAX_BATCH_SIZE = 64;
+
+  struct Stats
+  {
+    uint64 Packets = 0;   // datagrams received
+    uint64 Syscalls = 0;  // receive system calls that returned data
+    uint64 Dropped = 0;   // datagrams dropped because the pool was empty
+    uint64 Truncated = 0; // datagrams larger than the pool's buffers
+  };
+
+  /**
+   * @brief Bind a UDP socket to the port and prepare to receive into buffers
+   *        from the pool.
+   * @param name Name of the socket, for debugging.
+   * @param port Local port to bind to.
+   * @param receive_buffer_size Size of the kernel receive buffer in bytes.
+   * @param pool Pool to take packet buffers from. Must outlive the receiver.
+   */
+  FUdpBatchReceiver(const FString &name, int port, int receive_buffer_size, espp::PacketBufferPool &pool);
+
+  ~FUdpBatchReceiver();
+
+  // True if the socket was created and bound successfully.
+  bool is_valid() const;
+
+  /**
+   * @brief Wait up to wait_time for datagrams, then receive as many as are
+   *        available (up to max_packets) without blocking again.
+   * @param packets Array which receives the filled packet buffers.
+   * @param max_packets Size of the packets array.
+   * @param wait_time How long to wait for the first datagram.
+   * @return The number of packets written to the array.
+   */
+  int receive(espp::PacketBuffer *packets, int max_packets, FTimespan wait_time);
+
+  // The socket, to wait on with an FNetworkReactor (and then receive() with
+  // no wait time).
+  FReactorSocket get_reactor_socket() const;
+
+  Stats get_stats() const;
+
+  // Average number of datagrams returned by each receive system call.
+  float get_packets_per_syscall() const;
+
+protected:
+  void count_packet(size_t bytes, size_t capacity);
+
+  espp::PacketBufferPool &pool_;
+
+#if RTSP_USE_NATIVE_SOCKETS
+  int receive_native(espp::PacketBuffer *packets, int max_packets, FTimespan wait_time);
+
+  FReactorSocket socket_fd_;
+  // buffers which were acquired for a previous batch but not filled, kept so
+  // that each batch only has to acquire as many buffers as were consumed
+  espp::PacketBuffer spare_buffers_[MAX_BATCH_SIZE];
+#else
+  int receive_fsocket(espp::PacketBuffer *packets, int max_packets, FTimespan wait_time);
+
+  FSocket *socket_ = nullptr;
+#endif
+
+  std::atomic<uint64> packets_{0};
+  std::atomic<uint64> syscalls_{0};
+  std::atomic<uint64> dropped_{0};
+  std::atomic<uint64> truncated_{0};
+};
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+#include "spsc_queue.hpp"
+
+namespace espp {
+/// A mailbox which hands (uniquely owned) items from one producer thread to
+/// one consumer thread, and decides what to drop when the consumer falls
+/// behind.
+///
+/// Depending on the policy, it holds either a single item or a bounded queue
+/// of items:
+///  - DROP_OLDEST: a single slot; a new item replaces one which hasn't been
+///    taken yet ("latest wins"), so the consumer always gets the newest item.
+///  - DROP_NEWEST: a single slot; a new item is rejected while the slot is
+///    still full, so the consumer gets items in order but may skip some.
+///  - QUEUE: up to capacity items in order; a new item is rejected while the
+///    queue is full.
+///
+/// Dropped items are handed back to the producer so that it can reuse them.
+/// The single slot is an atomic pointer, so neither policy ever blocks.
+///
+/// @tparam T The item type; items are passed as std::unique_ptr<T>.
+template <typename T> class FrameMailbox {
+public:
+  /// What to do with a new item when the mailbox is full.
+  enum class Policy {
+    DROP_OLDEST, ///< Replace the oldest item with the new one.
+    DROP_NEWEST, ///< Reject the new item.
+    QUEUE,       ///< Queue up to capacity items, then reject new items.
+  };
+
+  /// Statistics about the mailbox.
+  struct Stats {
+    uint64_t replaced{0}; ///< Items dropped because a newer item replaced them.
+    uint64_t rejected{0}; ///< New items dropped because the mailbox was full.
+  };
+
+  /// Construct a mailbox.
+  /// @param policy What to do with a new item when the mailbox is full.
+  /// @param capacity The number of items queued with the QUEUE policy. The
+  ///        other policies always hold a single item.
+  explicit FrameMailbox(Policy policy, size_t capacity = 1) : policy_(policy) {
+    if (policy_ == Policy::QUEUE) {
+      queue_ = std::make_unique<SpscQueue<std::unique_ptr<T>>>(std::max<size_t>(capacity, 1));
+    }
+  }
+
+  FrameMailbox(const FrameMailbox &) = delete;
+  FrameMailbox &operator=(const FrameMailbox &) = delete;
+
+  ~FrameMailbox() { delete slot_.exchange(nullptr, std::memory_order_acquire); }
+
+  /// Put an item into the mailbox. Only call from the producer thread.
+  /// @param item The item.
+  /// @return The item which was dropped to make room (either an older item or
+  ///         this one, depending on the policy), or nullptr if none was.
+  std::unique_ptr<T> push(std::unique_ptr<T> item) {
+    switch (policy_) {
+    case Policy::DROP_OLDEST: {
+      std::unique_ptr<T> replaced(slot_.exchange(item.release(), std::memory_order_acq_rel));
+      if (replaced) {
+        replaced_.fetch_add(1, std::memory_order_relaxed);
+      }
+      update_max_size(1);
+      return replaced;
+    }
+    case Policy::DROP_NEWEST: {
+      T *expected = nullptr;
+      if (!slot_.compare_exchange_strong(expected, item.get(), std::memory_order_acq_rel)) {
+        rejected_.fetch_add(1, std::memory_order_relaxed);
+        return item;
+      }
+      item.release();
+      update_max_size(1);
+      return nullptr;
+    }
+    case Policy::QUEUE:
+    default:
+      if (!queue_->try_push(std::move(item))) {
+        rejected_.fetch_add(1, std::memory_order_relaxed);
+        return item;
+      }
+      return nullptr;
+    }
+  }
+
+  /// Take the next item out of the mailbox. Only call from the consumer
+  /// thread.
+  /// @return The item, or nullptr if the mailbox is empty.
+  std::unique_ptr<T> try_pop() {
+    if (queue_) {
+      auto item = queue_->try_pop();
+      return item ? std::move(*item) : nullptr;
+    }
+    return std::unique_ptr<T>(slot_.exchange(nullptr, std::memory_order_acq_rel));
+  }
+
+  /// Get the policy of the mailbox.
+  /// @return The policy of the mailbox.
+  Policy get_policy() const { return policy_; }
+
+  /// Get the number of items in the mailbox. Only a snapshot.
+  /// @return The number of items in the mailbox.
+  size_t size() const {
+    if (queue_) {
+      return queue_->size();
+    }
+    return slot_.load(std::memory_order_relaxed) ? 1 : 0;
+  }
+
+  /// Get the largest number of items that have been in the mailbox at once.
+  /// @return The largest number of items in the mailbox.
+  size_t max_size() const { return queue_ ? queue_->max_size() : max_size_.load(std::memory_order_relaxed); }
+
+  /// Get a snapshot of the mailbox statistics.
+  /// @return The mailbox statistics.
+  Stats get_stats() const {
+    Stats stats;
+    stats.replaced = replaced_.load(std::memory_order_relaxed);
+    stats.rejected = rejected_.load(std::memory_order_relaxed);
+    return stats;
+  }
+
+protected:
+  void update_max_size(size_t size) {
+    if (size > max_size_.load(std::memory_order_relaxed)) {
+      max_size_.store(size, std::memory_order_relaxed);
+    }
+  }
+
+  Policy policy_;
+  std::atomic<T *> slot_{nullptr};
+  std::unique_ptr<SpscQueue<std::unique_ptr<T>>> queue_;
+  std::atomic<size_t> max_size_{0};
+  std::atomic<uint64_t> replaced_{0};
+  std::atomic<uint64_t> rejected_{0};
+};
+} // namespace espp
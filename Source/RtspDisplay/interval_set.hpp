@@ -0,0 +1,96 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace espp {
+/// A compact set of half-open [begin, end) intervals.
+///
+/// The intervals are kept sorted and merged, so for data that mostly arrives
+/// in order the set holds a single interval and every operation is O(1). It
+/// is used to track which byte ranges of a frame have been received.
+class IntervalSet {
+public:
+  /// Add an interval to the set, merging it with any interval it overlaps or
+  /// touches.
+  /// @param begin The start of the interval.
+  /// @param end One past the end of the interval.
+  void insert(size_t begin, size_t end) {
+    if (begin >= end) {
+      return;
+    }
+    // fast path: appending to (or extending) the last interval
+    if (!intervals_.empty() && begin >= intervals_.back().first) {
+      auto &last = intervals_.back();
+      if (begin <= last.second) {
+        last.second = std::max(last.second, end);
+        return;
+      }
+      intervals_.emplace_back(begin, end);
+      return;
+    }
+    // find the first interval which ends at or after begin
+    auto it = std::lower_bound(intervals_.begin(), intervals_.end(), begin,
+                               [](const Interval &interval, size_t value) { return interval.second < value; });
+    // merge every interval which starts at or before end
+    auto last = it;
+    while (last != intervals_.end() && last->first <= end) {
+      begin = std::min(begin, last->first);
+      end = std::max(end, last->second);
+      ++last;
+    }
+    it = intervals_.erase(it, last);
+    intervals_.emplace(it, begin, end);
+  }
+
+  /// Check whether [begin, end) is entirely covered by the set.
+  /// @param begin The start of the range.
+  /// @param end One past the end of the range.
+  /// @return True if every value in the range is in the set.
+  bool covers(size_t begin, size_t end) const {
+    if (begin >= end) {
+      return true;
+    }
+    auto it = std::upper_bound(intervals_.begin(), intervals_.end(), begin,
+                               [](size_t value, const Interval &interval) { return value < interval.first; });
+    if (it == intervals_.begin()) {
+      return false;
+    }
+    --it;
+    return it->first <= begin && it->second >= end;
+  }
+
+  /// Get the end of the contiguous range starting at 0.
+  /// @return The number of values [0, n) in the set.
+  size_t contiguous_size() const {
+    if (intervals_.empty() || intervals_.front().first != 0) {
+      return 0;
+    }
+    return intervals_.front().second;
+  }
+
+  /// Get the total number of values in the set.
+  /// @return The sum of the lengths of the intervals.
+  size_t total_size() const {
+    size_t total = 0;
+    for (const auto &interval : intervals_) {
+      total += interval.second - interval.first;
+    }
+    return total;
+  }
+
+  /// Get the number of disjoint intervals in the set.
+  /// @return The number of intervals.
+  size_t num_intervals() const { return intervals_.size(); }
+
+  /// Remove every interval, keeping the allocated storage.
+  void clear() { intervals_.clear(); }
+
+protected:
+  using Interval = std::pair<size_t, size_t>;
+
+  std::vector<Interval> intervals_;
+};
+} // namespace espp
@@ -0,0 +1,793 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "jpeg_frame.hpp"
+#include "jpeg_huffman_table.hpp"
+#include "jpeg_kernels.hpp"
+
+namespace espp {
+/// A baseline JPEG decoder specialized for RFC 2435 (RTP/JPEG) frames.
+///
+/// Every RFC 2435 frame is a baseline, 8 bit, 3 component (YCbCr) JPEG which
+/// uses the standard Huffman tables (JpegHeader::HUFFMAN_TABLES) and whose
+/// only per-frame parameters are its size, its chroma subsampling (given by
+/// the RTP/JPEG type) and its two quantization tables. So instead of
+/// synthesizing a JPEG header and having a general purpose decoder parse it
+/// again, this decoder works directly from the frame's scan data and
+/// quantization tables, with Huffman lookup tables that are built at compile
+/// time (JpegHuffmanTables).
+///
+/// The scan is decoded into Y, Cb and Cr planes (padded to a whole number of
+/// MCUs) which are then converted to BGRA. The IDCT and the color conversion
+/// use the fastest JpegKernels the CPU supports. The decoder keeps its planes
+/// between frames, so it doesn't allocate once it has seen a frame of the
+/// stream's size.
+///
+/// Scans with restart markers (RFC 2435 types 64-127) are split at the
+/// markers, and since each restart interval can be entropy decoded on its
+/// own, the intervals are decoded in parallel with the ParallelFor given to
+/// set_parallel_for() (e.g. one which runs them on a worker pool). The
+/// conversion to BGRA is split into bands of rows the same way.
+///
+/// A frame can also be decoded incrementally while its packets are still
+/// arriving: decode_partial() (or begin() and decode_available()) decodes the
+/// MCUs whose data has been received so far and picks up where it left off on
+/// the next call, so that once the last packet arrives only the tail of the
+/// frame is left to decode. Without restart markers it decodes MCU by MCU and
+/// backs out of an MCU whose data isn't all there yet; with restart markers it
+/// decodes each restart interval once the marker which ends it arrives.
+///
+/// Instead of converting to BGRA, the decoded Y, Cb and Cr planes can be
+/// copied out as they are with copy_planes(), e.g. to upload them as three
+/// single channel textures and convert them to RGB in a material, which moves
+/// far fewer bytes than BGRA. convert_planes_to_bgra() is the CPU reference
+/// of that conversion.
+///
+/// The image can also be decoded at 1/2, 1/4 or 1/8 of its size (see
+/// set_scale()), e.g. for a display which only covers a small part of the
+/// screen. Every block is then inverse transformed to 4x4, 2x2 or 1x1 pixels
+/// from its lowest frequency coefficients, which saves most of the IDCT and
+/// color conversion work and shrinks the planes and the BGRA image.
+///
+/// @note Not thread safe; use one decoder per decoding thread.
+class JpegDecoder {
+public:
+  /// The chroma subsampling of a frame.
+  enum class Subsampling {
+    YUV422, ///< RFC 2435 type 0: chroma is halved horizontally.
+    YUV420, ///< RFC 2435 type 1: chroma is halved horizontally and vertically.
+  };
+
+  /// Runs task(i) for every i in [0, num_tasks), possibly in parallel, and
+  /// returns once all of them have finished.
+  using ParallelFor = std::function<void(int num_tasks, const std::function<void(int)> &task)>;
+
+  /// Get the subsampling of an RFC 2435 type.
+  /// @param type The RFC 2435 type, with or without restart markers.
+  /// @param subsampling Set to the subsampling of the type.
+  /// @return False if the type isn't supported.
+  static bool get_subsampling(int type, Subsampling &subsampling) {
+    // types 64-127 are types 0-63 with restart markers
+    switch (type & ~64) {
+    case 0:
+      subsampling = Subsampling::YUV422;
+      return true;
+    case 1:
+      subsampling = Subsampling::YUV420;
+      return true;
+    default:
+      return false;
+    }
+  }
+
+  /// Decode a complete frame into the decoder's planes.
+  /// @param frame The frame to decode.
+  /// @return True if the frame was decoded.
+  bool decode(const JpegFrame &frame) {
+    Subsampling subsampling;
+    if (!frame.is_complete() || !get_subsampling(frame.get_type(), subsampling)) {
+      return false;
+    }
+    return decode(frame.get_scan_data(), frame.get_q_table(0), frame.get_q_table(1), frame.get_width(),
+                  frame.get_height(), subsampling, frame.get_restart_interval());
+  }
+
+  /// Decode a complete frame to BGRA.
+  /// @param frame The frame to decode.
+  /// @param bgra Resized to and filled with the 4 byte per pixel BGRA image.
+  /// @return True if the frame was decoded.
+  bool decode(const JpegFrame &frame, std::vector<uint8_t> &bgra) {
+    if (!decode(frame)) {
+      return false;
+    }
+    bgra.resize(static_cast<size_t>(width_) * height_ * 4);
+    convert_to_bgra(bgra.data(), static_cast<size_t>(width_) * 4);
+    return true;
+  }
+
+  /// Decode a JPEG scan into the decoder's planes.
+  /// @param scan The entropy-coded scan data.
+  /// @param q0_table The luma quantization table, in zig-zag order.
+  /// @param q1_table The chroma quantization table, in zig-zag order.
+  /// @param width The width of the image in pixels.
+  /// @param height The height of the image in pixels.
+  /// @param subsampling The chroma subsampling of the image.
+  /// @param restart_interval The number of MCUs between the scan's restart
+  ///        markers, or 0 if it has none.
+  /// @return True if the scan was decoded. If the scan is corrupt, whatever
+  ///         was decoded before the error is kept and false is returned.
+  bool decode(std::string_view scan, std::string_view q0_table, std::string_view q1_table, int width,
+              int height, Subsampling subsampling, int restart_interval = 0) {
+    return begin(q0_table, q1_table, width, height, subsampling, restart_interval) &&
+           decode_available(scan, true);
+  }
+
+  /// Decode as much of a frame as has been received so far (the gap-free
+  /// prefix of its scan data), continuing from where the last call left off
+  /// if it was for the same frame (i.e. the same RTP timestamp).
+  /// @param frame The frame, complete or not.
+  /// @return False if the frame can't be decoded: its type isn't supported,
+  ///         its scan is corrupt, or it is complete but couldn't be decoded
+  ///         completely. If the frame's quantization tables haven't been
+  ///         received yet, nothing is decoded and true is returned.
+  bool decode_partial(const JpegFrame &frame) {
+    if (!frame.has_q_tables()) {
+      return !frame.is_complete();
+    }
+    if (!decoding_frame_ || frame.get_timestamp() != timestamp_) {
+      Subsampling subsampling;
+      if (!get_subsampling(frame.get_type(), subsampling) ||
+          !begin(frame.get_q_table(0), frame.get_q_table(1), frame.get_width(), frame.get_height(), subsampling,
+                 frame.get_restart_interval())) {
+        return false;
+      }
+      decoding_frame_ = true;
+      timestamp_ = frame.get_timestamp();
+    }
+    bool is_complete = frame.is_complete();
+    size_t available = is_complete ? frame.get_scan_data().size() : frame.get_contiguous_size();
+    if (!is_complete && available == scan_available_) {
+      // nothing new since the last call
+      return !failed_;
+    }
+    scan_available_ = available;
+    return decode_available(frame.get_scan_data().substr(0, available), is_complete);
+  }
+
+  /// Start decoding a scan incrementally with decode_available().
+  /// @param q0_table The luma quantization table, in zig-zag order.
+  /// @param q1_table The chroma quantization table, in zig-zag order.
+  /// @param width The width of the image in pixels.
+  /// @param height The height of the image in pixels.
+  /// @param subsampling The chroma subsampling of the image.
+  /// @param restart_interval The number of MCUs between the scan's restart
+  ///        markers, or 0 if it has none.
+  /// @return False if the parameters are invalid.
+  bool begin(std::string_view q0_table, std::string_view q1_table, int width, int height, Subsampling subsampling,
+             int restart_interval = 0) {
+    started_ = false;
+    decoding_frame_ = false;
+    if (width <= 0 || height <= 0 || q0_table.size() != 64 || q1_table.size() != 64) {
+      return false;
+    }
+    set_format(width, height, subsampling);
+    load_q_table(q0_table, q_tables_[0]);
+    load_q_table(q1_table, q_tables_[1]);
+    num_mcus_ = mcus_x_ * mcus_y_;
+    restart_interval_ = restart_interval > 0 && restart_interval < num_mcus_ ? restart_interval : 0;
+    next_mcu_ = 0;
+    dc_pred_[0] = dc_pred_[1] = dc_pred_[2] = 0;
+    reader_state_ = {};
+    restart_intervals_.clear();
+    next_interval_ = 0;
+    interval_start_ = 0;
+    marker_search_offset_ = 0;
+    scan_available_ = 0;
+    failed_ = false;
+    started_ = true;
+    return true;
+  }
+
+  /// Decode every MCU whose data is in the scan data received so far.
+  /// @param scan The scan data received so far; the data given to earlier
+  ///        calls since begin() must be a prefix of it.
+  /// @param is_complete True if this is the whole scan, in which case the rest
+  ///        of the frame is decoded.
+  /// @return False if the scan is corrupt, or if it is complete and couldn't
+  ///         be decoded completely.
+  bool decode_available(std::string_view scan, bool is_complete) {
+    if (!started_ || failed_) {
+      return false;
+    }
+    bool success = restart_interval_ ? decode_available_intervals(scan, is_complete)
+                                     : decode_available_mcus(scan, is_complete);
+    failed_ = !success;
+    return success;
+  }
+
+  /// Get the number of rows of pixels which have been completely decoded
+  /// since begin(), and so can be converted.
+  /// @return The number of decoded rows of pixels.
+  int get_decoded_rows() const {
+    int decoded_mcus = restart_interval_ ? std::min(next_interval_ * restart_interval_, num_mcus_) : next_mcu_;
+    return std::min(height_, decoded_mcus / mcus_x_ * mcu_height_);
+  }
+
+  /// Convert the decoded planes to BGRA.
+  /// @param bgra The output image, with room for get_height() rows.
+  /// @param stride The number of bytes between the starts of two rows of the
+  ///        output image; at least 4 * get_width().
+  void convert_to_bgra(uint8_t *bgra, size_t stride) const { convert_to_bgra(bgra, stride, 0, height_); }
+
+  /// Convert some rows of the decoded planes to BGRA.
+  /// @param bgra The output image, with room for get_height() rows.
+  /// @param stride The number of bytes between the starts of two rows of the
+  ///        output image; at least 4 * get_width().
+  /// @param first_row The first row to convert.
+  /// @param num_rows The number of rows to convert.
+  void convert_to_bgra(uint8_t *bgra, size_t stride, int first_row, int num_rows) const {
+    int chroma_shift_y = subsampling_ == Subsampling::YUV420 ? 1 : 0;
+    num_rows = std::min(num_rows, height_ - first_row);
+    int num_bands = parallel_for_ ? std::clamp(num_rows / MIN_BAND_HEIGHT, 1, MAX_SLICES) : 1;
+    run_parallel(num_bands, [&](int band) {
+      int end = first_row + (band + 1) * num_rows / num_bands;
+      for (int y = first_row + band * num_rows / num_bands; y < end; y++) {
+        const uint8_t *y_row = y_plane_.data() + y * y_stride_;
+        const uint8_t *cb_row = cb_plane_.data() + (y >> chroma_shift_y) * c_stride_;
+        const uint8_t *cr_row = cr_plane_.data() + (y >> chroma_shift_y) * c_stride_;
+        kernels_->ycbcr_to_bgra_row(y_row, cb_row, cr_row, bgra + y * stride, width_);
+      }
+    });
+  }
+
+  /// Copy the decoded planes out, without the padding to whole MCUs.
+  /// @param y The luma plane, get_width() x get_height() bytes.
+  /// @param cb The Cb plane, get_chroma_width() x get_chroma_height() bytes.
+  /// @param cr The Cr plane, get_chroma_width() x get_chroma_height() bytes.
+  void copy_planes(uint8_t *y, uint8_t *cb, uint8_t *cr) const { copy_planes(y, cb, cr, 0, height_); }
+
+  /// Copy some rows of the decoded planes out, along with the chroma rows
+  /// they use.
+  /// @param y The luma plane, get_width() x get_height() bytes.
+  /// @param cb The Cb plane, get_chroma_width() x get_chroma_height() bytes.
+  /// @param cr The Cr plane, get_chroma_width() x get_chroma_height() bytes.
+  /// @param first_row The first (luma) row to copy.
+  /// @param num_rows The number of (luma) rows to copy.
+  void copy_planes(uint8_t *y, uint8_t *cb, uint8_t *cr, int first_row, int num_rows) const {
+    int end = std::min(height_, first_row + num_rows);
+    for (int row = first_row; row < end; row++) {
+      memcpy(y + static_cast<size_t>(row) * width_, y_plane_.data() + row * y_stride_, width_);
+    }
+    int chroma_shift_y = subsampling_ == Subsampling::YUV420 ? 1 : 0;
+    int chroma_width = get_chroma_width();
+    int chroma_end = (end + chroma_shift_y) >> chroma_shift_y;
+    for (int row = first_row >> chroma_shift_y; row < chroma_end; row++) {
+      size_t offset = static_cast<size_t>(row) * chroma_width;
+      memcpy(cb + offset, cb_plane_.data() + row * c_stride_, chroma_width);
+      memcpy(cr + offset, cr_plane_.data() + row * c_stride_, chroma_width);
+    }
+  }
+
+  /// Get the width of the chroma planes of the last decoded image.
+  /// @return The width of the chroma planes in pixels.
+  int get_chroma_width() const { return (width_ + 1) / 2; }
+
+  /// Get the height of the chroma planes of the last decoded image.
+  /// @return The height of the chroma planes in pixels.
+  int get_chroma_height() const { return subsampling_ == Subsampling::YUV420 ? (height_ + 1) / 2 : height_; }
+
+  /// Get the chroma subsampling of the last decoded image.
+  /// @return The subsampling.
+  Subsampling get_subsampling() const { return subsampling_; }
+
+  /// Convert planes copied out with copy_planes() to BGRA. This is the CPU
+  /// reference of the conversion a material does with the planes as
+  /// textures: the JFIF conversion of each pixel with the chroma sample it
+  /// falls in.
+  /// @param y The luma plane, width x height bytes.
+  /// @param cb The Cb plane, (width + 1) / 2 bytes per row.
+  /// @param cr The Cr plane, (width + 1) / 2 bytes per row.
+  /// @param width The width of the image in pixels.
+  /// @param height The height of the image in pixels.
+  /// @param subsampling The chroma subsampling of the planes.
+  /// @param bgra The output image, 4 * width * height bytes.
+  static void convert_planes_to_bgra(const uint8_t *y, const uint8_t *cb, const uint8_t *cr, int width, int height,
+                                     Subsampling subsampling, uint8_t *bgra) {
+    int chroma_shift_y = subsampling == Subsampling::YUV420 ? 1 : 0;
+    size_t chroma_width = (width + 1) / 2;
+    const auto &kernels = JpegKernels::get_scalar();
+    for (int row = 0; row < height; row++) {
+      size_t chroma_offset = (row >> chroma_shift_y) * chroma_width;
+      kernels.ycbcr_to_bgra_row(y + static_cast<size_t>(row) * width, cb + chroma_offset, cr + chroma_offset,
+                                bgra + static_cast<size_t>(row) * width * 4, width);
+    }
+  }
+
+  /// Set the scale the decoder decodes images at, from the next image on.
+  /// The size of a scaled image is its full size divided by the scale,
+  /// rounded up.
+  /// @param scale 1 for full size, or 2, 4 or 8 for 1/2, 1/4 or 1/8 size.
+  ///        Other values are rounded down to one of those.
+  void set_scale(int scale) {
+    scale_shift_ = scale >= 8 ? 3 : scale >= 4 ? 2 : scale >= 2 ? 1 : 0;
+  }
+
+  /// Get the scale the decoder decodes images at.
+  /// @return 1, 2, 4 or 8.
+  int get_scale() const { return 1 << scale_shift_; }
+
+  /// Allocate the planes for images of up to this size (at the current
+  /// scale) ahead of time, e.g. from the stream's description, so that
+  /// decoding the first image doesn't have to.
+  /// @param width The full width of the images.
+  /// @param height The full height of the images.
+  void reserve(int width, int height) {
+    // room for either subsampling: the luma plane is padded to whole 4:2:0
+    // MCUs, and the chroma planes are the larger 4:2:2 ones
+    size_t block_size = 8 >> scale_shift_;
+    size_t mcus_x = (width + 15) / 16;
+    size_t luma_rows = (height + 15) / 16 * 2 * block_size;
+    size_t chroma_rows = (height + 7) / 8 * block_size;
+    y_plane_.reserve(mcus_x * 2 * block_size * luma_rows);
+    cb_plane_.reserve(mcus_x * block_size * chroma_rows);
+    cr_plane_.reserve(mcus_x * block_size * chroma_rows);
+  }
+
+  /// Set how the decoder runs independent work (restart intervals and bands
+  /// of the color conversion) in parallel. By default it all runs on the
+  /// calling thread.
+  /// @param parallel_for The ParallelFor, or nullptr to run everything on the
+  ///        calling thread.
+  void set_parallel_for(ParallelFor parallel_for) { parallel_for_ = std::move(parallel_for); }
+
+  /// Get the kernels the decoder uses.
+  /// @return The kernels.
+  const JpegKernels &get_kernels() const { return *kernels_; }
+
+  /// Set the kernels the decoder uses, e.g. the scalar reference to check the
+  /// output of the vector kernels against. Defaults to JpegKernels::get().
+  /// @param kernels The kernels.
+  void set_kernels(const JpegKernels &kernels) { kernels_ = &kernels; }
+
+  /// Get the width of the last decoded image, at the scale it was decoded
+  /// at.
+  /// @return The width of the image in pixels.
+  int get_width() const { return width_; }
+
+  /// Get the height of the last decoded image, at the scale it was decoded
+  /// at.
+  /// @return The height of the image in pixels.
+  int get_height() const { return height_; }
+
+protected:
+  /// The most tasks a decode or conversion is split into, which is plenty to
+  /// keep every core busy while keeping the per-task overhead low.
+  static constexpr int MAX_SLICES = 64;
+  /// The fewest rows of pixels worth converting as a separate task.
+  static constexpr int MIN_BAND_HEIGHT = 64;
+
+  /// Reads the entropy-coded bits of a scan, removing the stuffed zero bytes.
+  /// A marker (or the end of the data) reads as an endless run of zero bits.
+  /// The bits are buffered 64 at a time, and runs of bytes without any 0xFF
+  /// (so without stuffing or markers) are loaded in one go.
+  class BitReader {
+  public:
+    /// Where a reader is in its data, so that another reader can continue
+    /// from there (e.g. once more of the data has been received).
+    struct State {
+      size_t offset{0};
+      uint64_t buffer{0};
+      int num_bits{0};
+    };
+
+    explicit BitReader(std::string_view data) : BitReader(data, State()) {}
+
+    BitReader(std::string_view data, const State &state)
+        : begin_(reinterpret_cast<const uint8_t *>(data.data())),
+          data_(begin_ + std::min(state.offset, data.size())), end_(begin_ + data.size()), buffer_(state.buffer),
+          num_bits_(state.num_bits) {}
+
+    /// Check whether more bits have been consumed than the data holds, i.e.
+    /// whether any of the zeros read past a marker or the end were used.
+    bool overran() const { return num_bits_ < padding_bits_; }
+
+    /// Get the state of the reader, without any of the zeros read past a
+    /// marker or the end.
+    /// @note Only valid if the reader hasn't overran().
+    State get_state() const {
+      State state;
+      state.offset = data_ - begin_;
+      state.num_bits = num_bits_ - padding_bits_;
+      state.buffer = state.num_bits ? buffer_ & (~0ull << (64 - state.num_bits)) : 0;
+      return state;
+    }
+
+    /// Get the next num_bits bits without consuming them.
+    uint32_t peek(int num_bits) {
+      if (num_bits_ < num_bits) {
+        refill();
+      }
+      return static_cast<uint32_t>(buffer_ >> (64 - num_bits));
+    }
+
+    /// Consume num_bits bits which were peeked.
+    void skip(int num_bits) {
+      buffer_ <<= num_bits;
+      num_bits_ -= num_bits;
+    }
+
+    /// Get (and consume) the next num_bits bits.
+    uint32_t get_bits(int num_bits) {
+      if (num_bits == 0) {
+        return 0;
+      }
+      uint32_t bits = peek(num_bits);
+      skip(num_bits);
+      return bits;
+    }
+
+  protected:
+    void refill() {
+      if (end_ - data_ >= 8) {
+        uint64_t word = 0;
+        for (int i = 0; i < 8; i++) {
+          word = (word << 8) | data_[i];
+        }
+        // a zero byte in the inverted word is an 0xFF byte in the word
+        uint64_t inverted = ~word;
+        if (!((inverted - 0x0101010101010101ull) & ~inverted & 0x8080808080808080ull)) {
+          // take the whole bytes which fit; the bits of the partial byte
+          // below them are the same bits the next refill will add
+          int num_bytes = (63 - num_bits_) >> 3;
+          buffer_ |= word >> num_bits_;
+          data_ += num_bytes;
+          num_bits_ += num_bytes * 8;
+          return;
+        }
+      }
+      while (num_bits_ <= 56) {
+        uint32_t byte = 0;
+        if (data_ < end_) {
+          byte = *data_;
+          if (byte == 0xFF) {
+            if (data_ + 1 < end_ && data_[1] == 0x00) {
+              // a stuffed zero byte
+              data_ += 2;
+            } else {
+              // a marker (or the end of the data in the middle of a stuffed
+              // byte): stop here and feed zeros
+              byte = 0;
+              end_ = data_;
+              padding_bits_ += 8;
+            }
+          } else {
+            data_++;
+          }
+        } else {
+          padding_bits_ += 8;
+        }
+        buffer_ |= static_cast<uint64_t>(byte) << (56 - num_bits_);
+        num_bits_ += 8;
+      }
+    }
+
+    const uint8_t *begin_;
+    const uint8_t *data_;
+    const uint8_t *end_;
+    uint64_t buffer_;
+    int num_bits_;
+    int padding_bits_{0};
+  };
+
+  /// Map from zig-zag order to natural (row-major) order.
+  static constexpr uint8_t ZIGZAG[64] = {
+      0,  1,  8,  16, 9,  2,  3,  10, 17, 24, 32, 25, 18, 11, 4,  5,  12, 19, 26, 33, 40, 48,
+      41, 34, 27, 20, 13, 6,  7,  14, 21, 28, 35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23,
+      30, 37, 44, 51, 58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63,
+  };
+
+  void run_parallel(int num_tasks, const std::function<void(int)> &task) const {
+    if (parallel_for_ && num_tasks > 1) {
+      parallel_for_(num_tasks, task);
+      return;
+    }
+    for (int i = 0; i < num_tasks; i++) {
+      task(i);
+    }
+  }
+
+  /// Decode the MCUs (of a scan without restart markers) whose data has been
+  /// received.
+  bool decode_available_mcus(std::string_view scan, bool is_complete) {
+    BitReader reader(scan, reader_state_);
+    if (is_complete) {
+      // nothing to wait for, so decode the rest in one go
+      bool success = decode_mcus(reader, next_mcu_, num_mcus_ - next_mcu_, dc_pred_);
+      next_mcu_ = num_mcus_;
+      return success;
+    }
+    while (next_mcu_ < num_mcus_) {
+      auto state = reader.get_state();
+      int dc_pred[3] = {dc_pred_[0], dc_pred_[1], dc_pred_[2]};
+      bool success = decode_mcus(reader, next_mcu_, 1, dc_pred_);
+      if (reader.overran()) {
+        // the MCU continues past the data received so far; go back to its
+        // start and decode it once more data has arrived
+        reader_state_ = state;
+        std::copy(dc_pred, dc_pred + 3, dc_pred_);
+        return true;
+      }
+      if (!success) {
+        return false;
+      }
+      next_mcu_++;
+    }
+    return true;
+  }
+
+  /// Decode the restart intervals whose data has been received, i.e. which
+  /// are followed by their restart marker (or the end of a complete scan).
+  bool decode_available_intervals(std::string_view scan, bool is_complete) {
+    find_restart_intervals(scan, is_complete);
+    int num_intervals = (num_mcus_ + restart_interval_ - 1) / restart_interval_;
+    int first = next_interval_;
+    int end = std::min(num_intervals, static_cast<int>(restart_intervals_.size()));
+    if (end > first) {
+      // each restart interval starts on a byte boundary with the DC
+      // predictions reset, so the intervals can be decoded independently
+      int num_slices = std::min(end - first, MAX_SLICES);
+      std::atomic<bool> success{true};
+      run_parallel(num_slices, [&](int slice) {
+        int slice_end = first + (slice + 1) * (end - first) / num_slices;
+        for (int i = first + slice * (end - first) / num_slices; i < slice_end; i++) {
+          BitReader reader(scan.substr(restart_intervals_[i].first, restart_intervals_[i].second));
+          int first_mcu = i * restart_interval_;
+          int dc_pred[3] = {0, 0, 0};
+          if (!decode_mcus(reader, first_mcu, std::min(restart_interval_, num_mcus_ - first_mcu), dc_pred)) {
+            success = false;
+          }
+        }
+      });
+      next_interval_ = end;
+      if (!success) {
+        return false;
+      }
+    }
+    return !is_complete || next_interval_ == num_intervals;
+  }
+
+  /// Find the restart intervals in the newly received scan data, which end at
+  /// a restart (RSTn) marker or at the end of a complete scan.
+  void find_restart_intervals(std::string_view scan, bool is_complete) {
+    const char *start = scan.data();
+    const char *end = scan.data() + scan.size();
+    const char *p = start + marker_search_offset_;
+    while (p < end && (p = static_cast<const char *>(memchr(p, 0xFF, end - p))) != nullptr && p + 1 < end) {
+      uint8_t marker = static_cast<uint8_t>(p[1]);
+      if (marker >= 0xD0 && marker <= 0xD7) {
+        restart_intervals_.emplace_back(interval_start_, (p - start) - interval_start_);
+        interval_start_ = (p - start) + 2;
+        p = start + interval_start_;
+      } else {
+        // a stuffed zero byte, another marker or a fill byte
+        p += marker == 0xFF ? 1 : 2;
+      }
+    }
+    // an 0xFF at the end may be the start of a marker; look at it again once
+    // the next byte has arrived
+    marker_search_offset_ = p ? std::min<size_t>(p - start, scan.size()) : scan.size();
+    if (is_complete && interval_start_ <= scan.size()) {
+      restart_intervals_.emplace_back(interval_start_, scan.size() - interval_start_);
+      interval_start_ = scan.size() + 1;
+    }
+  }
+
+  /// Decode a run of MCUs (in raster order) into the planes.
+  /// @param reader The reader positioned at the first MCU.
+  /// @param first_mcu The index of the first MCU.
+  /// @param num_mcus The number of MCUs to decode.
+  /// @param dc_pred The DC predictions of the components, updated as the MCUs
+  ///        are decoded.
+  /// @return True if the MCUs were decoded.
+  bool decode_mcus(BitReader &reader, int first_mcu, int num_mcus, int *dc_pred) {
+    const auto &dc_luma = JpegHuffmanTables::DC_LUMA;
+    const auto &ac_luma = JpegHuffmanTables::AC_LUMA;
+    const auto &dc_chroma = JpegHuffmanTables::DC_CHROMA;
+    const auto &ac_chroma = JpegHuffmanTables::AC_CHROMA;
+    auto idct = kernels_->idct;
+    alignas(16) int16_t block[64];
+    uint32_t row_mask;
+    int block_size = block_size_;
+    int y_blocks_h = mcu_width_ / block_size;
+    int y_blocks_v = mcu_height_ / block_size;
+    auto transform = [&](const int16_t *q_table, uint8_t *out, size_t stride) {
+      if (block_size == 8) {
+        idct(block, q_table, row_mask, out, stride);
+      } else {
+        JpegKernels::idct_reduced(block, q_table, row_mask, block_size, out, stride);
+      }
+    };
+    for (int mcu = first_mcu; mcu < first_mcu + num_mcus; mcu++) {
+      int mcu_x = mcu % mcus_x_;
+      int mcu_y = mcu / mcus_x_;
+      // the luma blocks, in raster order within the MCU
+      for (int by = 0; by < y_blocks_v; by++) {
+        for (int bx = 0; bx < y_blocks_h; bx++) {
+          if (!decode_block(reader, dc_luma, ac_luma, dc_pred[0], block, row_mask)) {
+            return false;
+          }
+          uint8_t *out = y_plane_.data() + (mcu_y * mcu_height_ + by * block_size) * y_stride_ +
+                         mcu_x * mcu_width_ + bx * block_size;
+          transform(q_tables_[0], out, y_stride_);
+        }
+      }
+      // then one block each of Cb and Cr
+      for (int c = 1; c < 3; c++) {
+        if (!decode_block(reader, dc_chroma, ac_chroma, dc_pred[c], block, row_mask)) {
+          return false;
+        }
+        auto &plane = c == 1 ? cb_plane_ : cr_plane_;
+        transform(q_tables_[1], plane.data() + (mcu_y * c_stride_ + mcu_x) * block_size, c_stride_);
+      }
+    }
+    return true;
+  }
+
+  /// Decode the next Huffman coded symbol the canonical way, for the codes
+  /// the lookup doesn't resolve.
+  /// @return The symbol, or -1 if the stream holds an invalid code.
+  static int decode_symbol(BitReader &reader, const JpegHuffmanTable &table) {
+    for (int length = 1; length <= 16; length++) {
+      int32_t code = reader.peek(length);
+      if (code <= table.max_code[length]) {
+        reader.skip(length);
+        return table.symbols[table.symbol_offset[length] + code];
+      }
+    }
+    return -1;
+  }
+
+  /// Decode the (quantized) coefficients of one 8x8 block, in natural order.
+  /// @param row_mask Set to a mask of the rows which have nonzero AC
+  ///        coefficients, as JpegKernels::IdctFunction takes it.
+  static bool decode_block(BitReader &reader, const JpegHuffmanTable &dc_table, const JpegHuffmanTable &ac_table,
+                           int &dc_pred, int16_t *block, uint32_t &row_mask) {
+    memset(block, 0, 64 * sizeof(int16_t));
+    row_mask = 0;
+    const auto &dc_entry = dc_table.lookup[reader.peek(JpegHuffmanTable::LOOKUP_BITS)];
+    if (dc_entry.count) {
+      reader.skip(dc_entry.length[0]);
+      dc_pred += dc_entry.value[0];
+    } else {
+      int size = decode_symbol(reader, dc_table);
+      if (size < 0 || size > 11) {
+        return false;
+      }
+      dc_pred += JpegHuffmanTable::extend(reader.get_bits(size), size);
+    }
+    block[0] = static_cast<int16_t>(dc_pred);
+    int k = 1;
+    while (k < 64) {
+      const auto &entry = ac_table.lookup[reader.peek(JpegHuffmanTable::LOOKUP_BITS)];
+      if (entry.count) {
+        // the second symbol only belongs to this block if the first one
+        // didn't fill it, so consume them one at a time
+        for (int i = 0; i < entry.count && k < 64; i++) {
+          reader.skip(entry.length[i]);
+          if (entry.run[i] == JpegHuffmanTable::END_OF_BLOCK) {
+            return true;
+          }
+          k += entry.run[i];
+          if (k > 63) {
+            return false;
+          }
+          if (entry.value[i]) {
+            int index = ZIGZAG[k];
+            block[index] = entry.value[i];
+            row_mask |= 1 << (index >> 3);
+          }
+          k++;
+        }
+        continue;
+      }
+      int symbol = decode_symbol(reader, ac_table);
+      if (symbol < 0) {
+        return false;
+      }
+      int run = symbol >> 4;
+      int size = symbol & 0x0F;
+      if (size == 0 && run != 15) {
+        // end of block
+        return true;
+      }
+      // (a run of 16 zeros is a run of 15 and a zero coefficient)
+      k += run;
+      if (k > 63) {
+        return false;
+      }
+      int value = JpegHuffmanTable::extend(reader.get_bits(size), size);
+      if (value) {
+        int index = ZIGZAG[k];
+        block[index] = static_cast<int16_t>(value);
+        row_mask |= 1 << (index >> 3);
+      }
+      k++;
+    }
+    return true;
+  }
+
+  /// Convert a quantization table from its 8 bit zig-zag form to natural
+  /// order.
+  static void load_q_table(std::string_view table, int16_t *q_table) {
+    for (int i = 0; i < 64; i++) {
+      q_table[ZIGZAG[i]] = static_cast<uint8_t>(table[i]);
+    }
+  }
+
+  /// Size the planes for the image.
+  void set_format(int width, int height, Subsampling subsampling) {
+    // the planes (and the MCU sizes) are in scaled pixels
+    int scale = 1 << scale_shift_;
+    width_ = (width + scale - 1) >> scale_shift_;
+    height_ = (height + scale - 1) >> scale_shift_;
+    subsampling_ = subsampling;
+    block_size_ = 8 >> scale_shift_;
+    int mcu_rows = subsampling == Subsampling::YUV420 ? 2 : 1;
+    mcus_x_ = (width + 15) / 16;
+    mcus_y_ = (height + 8 * mcu_rows - 1) / (8 * mcu_rows);
+    mcu_width_ = 2 * block_size_;
+    mcu_height_ = mcu_rows * block_size_;
+    y_stride_ = mcus_x_ * mcu_width_;
+    c_stride_ = mcus_x_ * block_size_;
+    y_plane_.resize(static_cast<size_t>(y_stride_) * mcus_y_ * mcu_height_);
+    cb_plane_.resize(static_cast<size_t>(c_stride_) * mcus_y_ * block_size_);
+    cr_plane_.resize(static_cast<size_t>(c_stride_) * mcus_y_ * block_size_);
+  }
+
+  int width_{0};
+  int height_{0};
+  Subsampling subsampling_{Subsampling::YUV422};
+  int scale_shift_{0};
+  int block_size_{8};
+  int mcu_width_{16};
+  int mcu_height_{8};
+  int mcus_x_{0};
+  int mcus_y_{0};
+  int y_stride_{0};
+  int c_stride_{0};
+  const JpegKernels *kernels_{&JpegKernels::get()};
+  alignas(16) int16_t q_tables_[2][64];
+  std::vector<uint8_t> y_plane_;
+  std::vector<uint8_t> cb_plane_;
+  std::vector<uint8_t> cr_plane_;
+  ParallelFor parallel_for_;
+
+  // where the incremental decode of the current scan is
+  bool started_{false};
+  bool failed_{false};
+  // set if the scan is a frame given to decode_partial(), with its timestamp
+  bool decoding_frame_{false};
+  uint32_t timestamp_{0};
+  size_t scan_available_{0};
+  int num_mcus_{0};
+  int restart_interval_{0};
+  // without restart markers: the next MCU, and the state after the last one
+  int next_mcu_{0};
+  int dc_pred_[3] = {0, 0, 0};
+  BitReader::State reader_state_;
+  // with restart markers: the (offset, size) of each interval found so far,
+  // and the next one to decode
+  std::vector<std::pair<size_t, size_t>> restart_intervals_;
+  int next_interval_{0};
+  size_t interval_start_{0};
+  size_t marker_search_offset_{0};
+};
+} // namespace espp
@@ -1,124 +1,296 @@
 #pragma once
 
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <optional>
+
+#include "interval_set.hpp"
 #include "jpeg_header.hpp"
-#include "rtp_jpeg_packet.hpp"
+#include "rtp_jpeg_packet_view.hpp"
 
 namespace espp {
 /// A class that represents a complete JPEG frame.
 ///
 /// This class is used to collect the JPEG scans that are received in RTP
-/// packets and to serialize them into a complete JPEG frame.
+/// packets and to serialize them into a complete JPEG frame. Each fragment's
+/// scan data is written at its RFC 2435 fragment offset, so fragments may be
+/// added in any order, and the byte ranges that have been received are
+/// tracked so that the frame is only complete once the last fragment (the one
+/// with the marker bit) has arrived and there are no gaps.
+///
+/// The quantization tables are kept from the first fragment, which is all a
+/// decoder of the scan data needs. The JPEG header is only synthesized when
+/// the serialized frame is requested with get_data(), and is written
+/// (right-aligned) into a reserved prefix in front of the scan data. That way
+/// the header and scan are contiguous and get_data() never has to move or
+/// copy the scan.
 class JpegFrame {
 public:
-  /// Construct a JpegFrame from a RtpJpegPacket.
+  /// Construct a JpegFrame from a RtpJpegPacketView.
   ///
   /// This constructor will parse the header of the packet and add the JPEG
-  /// data to the frame.
+  /// data to the frame. The scan data is copied into the frame, so the packet
+  /// buffer may be reused once this returns.
   ///
-  /// @param packet The packet to parse.
-  explicit JpegFrame(const RtpJpegPacket &packet)
-      : header_(packet.get_width(), packet.get_height(), packet.get_q_table(0),
-                packet.get_q_table(1)) {
-    // add the jpeg header
-    serialize_header();
-    // add the jpeg data
-    add_scan(packet);
+  /// @param packet The packet to parse. It may be any fragment of the frame.
+  /// @param size_hint The expected size of the frame's scan data (e.g. the size
+  ///        of the previous frame), used to preallocate the frame buffer.
+  explicit JpegFrame(const RtpJpegPacketView &packet, size_t size_hint = 0) {
+    reset(packet, size_hint);
   }
 
   /// Construct a JpegFrame from buffer of jpeg data
   /// @param data The buffer containing the jpeg data.
   /// @param size The size of the buffer.
-  explicit JpegFrame(const char *data, size_t size)
-      : data_(data, data + size), header_(std::string_view((const char*) data_.data(), size)) {}
+  explicit JpegFrame(const char *data, size_t size) {
+    header_.emplace(std::string_view(data, size));
+    width_ = header_->get_width();
+    height_ = header_->get_height();
+    restart_interval_ = header_->get_restart_interval();
+    type_ = header_->get_type() | (restart_interval_ ? 64 : 0);
+    set_q_tables(header_->get_quantization_table(0), header_->get_quantization_table(1));
+    auto header_size = header_->get_data().size();
+    scan_start_ = header_size;
+    data_.assign(data, data + size);
+    scan_size_ = size - header_size;
+    received_.insert(0, scan_size_);
+    finalized_ = true;
+  }
+
+  // the header refers to its own buffer, so frames are neither copied nor
+  // moved; pass them around by (unique) pointer instead
+  JpegFrame(const JpegFrame &) = delete;
+  JpegFrame &operator=(const JpegFrame &) = delete;
+
+  /// Reuse this frame (and its buffer) for a new frame.
+  /// @param packet Any fragment of the new frame.
+  /// @param size_hint The expected size of the new frame's scan data.
+  void reset(const RtpJpegPacketView &packet, size_t size_hint = 0) {
+    header_.reset();
+    has_q_tables_ = false;
+    received_.clear();
+    scan_start_ = HEADER_RESERVE;
+    scan_size_ = 0;
+    finalized_ = false;
+    completion_time_ = {};
+    width_ = packet.get_width();
+    height_ = packet.get_height();
+    type_ = packet.get_type();
+    restart_interval_ = packet.get_restart_interval();
+    timestamp_ = packet.get_timestamp();
+    reserve(size_hint);
+    add_scan(packet);
+  }
+
+  /// Check whether the quantization tables have been received (i.e. whether
+  /// the first fragment has been received).
+  /// @return True if the quantization tables are available.
+  bool has_q_tables() const { return has_q_tables_; }
+
+  /// Get one of the quantization tables, in zig-zag order.
+  /// @note Only valid if has_q_tables() returns true.
+  /// @param index The index of the table: 0 for luma, 1 for chroma.
+  /// @return The 64 byte quantization table.
+  std::string_view get_q_table(int index) const {
+    return std::string_view(q_tables_.data() + (index == 0 ? 0 : Q_TABLE_SIZE), Q_TABLE_SIZE);
+  }
 
-  /// Get a reference to the header.
+  /// Check whether the JPEG header is available (i.e. whether the first
+  /// fragment has been received).
+  /// @return True if the header is available.
+  bool has_header() const { return has_q_tables_; }
+
+  /// Get a reference to the header, synthesizing it if it hasn't been yet.
+  /// @note Only valid if has_header() returns true.
   /// @return A reference to the header.
-  const JpegHeader &get_header() const { return header_; }
+  const JpegHeader &get_header() const {
+    serialize_header();
+    return *header_;
+  }
 
   /// Get the width of the frame.
   /// @return The width of the frame.
-  int get_width() const { return header_.get_width(); }
+  int get_width() const { return width_; }
 
   /// Get the height of the frame.
   /// @return The height of the frame.
-  int get_height() const { return header_.get_height(); }
+  int get_height() const { return height_; }
+
+  /// Get the RFC 2435 type of the frame, which gives its chroma subsampling
+  /// (and whether it uses restart markers).
+  /// @return The RFC 2435 type of the frame.
+  int get_type() const { return type_; }
+
+  /// Get the restart interval of the frame's scan.
+  /// @return The number of MCUs between restart markers, or 0 if the scan has
+  ///         none.
+  int get_restart_interval() const { return restart_interval_; }
+
+  /// Get the RTP timestamp shared by all of the frame's packets.
+  /// @return The RTP timestamp of the frame.
+  uint32_t get_timestamp() const { return timestamp_; }
 
   /// Check if the frame is complete.
-  /// @return True if the frame is complete, false otherwise.
-  bool is_complete() const { return finalized_; }
+  /// @return True if the last fragment and the header have been received and
+  ///         there are no gaps in the scan data.
+  bool is_complete() const { return finalized_ && has_q_tables_ && received_.covers(0, scan_size_); }
 
-  /// Append a RtpJpegPacket to the frame.
-  /// This will add the JPEG data to the frame.
-  /// @param packet The packet containing the scan to append.
-  void append(const RtpJpegPacket &packet) { add_scan(packet); }
+  /// Get when the frame was completed, i.e. when the packet which completed
+  /// it was reassembled.
+  /// @return The time the frame was completed, or the epoch if it hasn't been
+  ///         set.
+  std::chrono::steady_clock::time_point get_completion_time() const { return completion_time_; }
+
+  /// Set when the frame was completed.
+  /// @param completion_time The time the frame was completed.
+  void set_completion_time(std::chrono::steady_clock::time_point completion_time) {
+    completion_time_ = completion_time;
+  }
+
+  /// Check whether the last fragment (with the marker bit) has been received.
+  /// @return True if the size of the frame is known.
+  bool is_finalized() const { return finalized_; }
+
+  /// Get the number of scan bytes received so far.
+  /// @return The number of scan bytes received.
+  size_t get_received_size() const { return received_.total_size(); }
 
-  /// Append a JPEG scan to the frame.
+  /// Get the number of scan bytes received contiguously from the start.
+  /// @return The size of the gap-free prefix of the scan data.
+  size_t get_contiguous_size() const { return received_.contiguous_size(); }
+
+  /// Append a RtpJpegPacketView to the frame.
   /// This will add the JPEG data to the frame.
-  /// @note If the packet contains the EOI marker, the frame will be
-  ///       finalized, and no further scans can be added.
   /// @param packet The packet containing the scan to append.
-  void add_scan(const RtpJpegPacket &packet) {
-    add_scan(packet.get_jpeg_data());
+  void append(const RtpJpegPacketView &packet) { add_scan(packet); }
+
+  /// Add a JPEG scan to the frame at its fragment offset.
+  /// @note If the packet has the marker bit set, it is the last fragment and
+  ///       defines the size of the frame; no data may be added past it.
+  /// @param packet The packet containing the scan to add.
+  void add_scan(const RtpJpegPacketView &packet) {
+    if (!has_q_tables_ && packet.has_q_tables()) {
+      set_q_tables(packet.get_q_table(0), packet.get_q_table(1));
+    }
+    add_scan(packet.get_offset(), packet.get_jpeg_data());
     if (packet.get_marker()) {
-      finalize();
+      finalize(packet.get_offset() + packet.get_jpeg_data().size());
     }
   }
 
   /// Get the serialized data.
-  /// This will return the serialized data.
-  /// @return The serialized data.
-  std::string_view get_data() const { return std::string_view((const char*)data_.data(), data_.size()); }
+  /// This will return the serialized data (the header followed by the scan
+  /// data), synthesizing the header if it hasn't been yet.
+  /// @return The serialized data, or an empty string_view if the header has
+  ///         not been received.
+  std::string_view get_data() const {
+    serialize_header();
+    if (!header_) {
+      return {};
+    }
+    auto header_size = header_->get_data().size();
+    return std::string_view((const char *)data_.data() + scan_start_ - header_size, header_size + scan_size_);
+  }
 
   /// Get the scan data.
   /// This will return the scan data.
   /// @return The scan data.
   std::string_view get_scan_data() const {
-    auto header_data = header_.get_data();
-    size_t header_size = header_data.size();
-    return std::string_view((const char*)data_.data() + header_size, data_.size() - header_size);
+    return std::string_view((const char *)data_.data() + scan_start_, scan_size_);
   }
 
 protected:
-  /// Serialize the header.
-  void serialize_header() {
-    auto header_data = header_.get_data();
-    data_.resize(header_data.size());
-    memcpy(data_.data(), header_data.data(), header_data.size());
+  /// Space reserved in front of the scan data for the JPEG header.
+  static constexpr size_t HEADER_RESERVE = 1024;
+  /// The fragment offset is 24 bits, so no frame can be larger than this.
+  static constexpr size_t MAX_SCAN_SIZE = 1 << 24;
+  /// Size of each (8 bit) quantization table.
+  static constexpr size_t Q_TABLE_SIZE = 64;
+
+  /// Make sure the buffer can hold at least scan_size bytes of scan data.
+  void reserve(size_t scan_size) {
+    size_t required = scan_start_ + scan_size;
+    if (data_.size() < required) {
+      // grow geometrically so that frames which keep getting larger don't
+      // reallocate on every fragment
+      data_.resize(std::max(required, data_.size() + data_.size() / 2));
+    }
   }
 
-  /// Append a JPEG scan to the frame.
-  /// This will add the JPEG data to the frame.
-  /// @param scan The jpeg scan to append.
-  void add_scan(std::string_view scan) {
-    if (finalized_) {
+  /// Keep a copy of the quantization tables.
+  void set_q_tables(std::string_view q0_table, std::string_view q1_table) {
+    if (q0_table.size() != Q_TABLE_SIZE || q1_table.size() != Q_TABLE_SIZE) {
+      return;
+    }
+    memcpy(q_tables_.data(), q0_table.data(), Q_TABLE_SIZE);
+    memcpy(q_tables_.data() + Q_TABLE_SIZE, q1_table.data(), Q_TABLE_SIZE);
+    has_q_tables_ = true;
+  }
+
+  /// Build the header, if it hasn't been yet, and write it in front of the
+  /// scan data.
+  void serialize_header() const {
+    if (header_ || !has_q_tables_) {
+      return;
+    }
+    header_.emplace(width_, height_, get_q_table(0), get_q_table(1), type_, restart_interval_);
+    auto header_data = header_->get_data();
+    if (header_data.size() > scan_start_) {
+      // can't happen with the headers we generate, but don't write out of
+      // bounds if it does
+      header_.reset();
+      return;
+    }
+    memcpy(data_.data() + scan_start_ - header_data.size(), header_data.data(), header_data.size());
+  }
+
+  /// Write a JPEG scan into the frame at the given offset.
+  /// @param offset The offset of the scan within the frame's scan data.
+  /// @param scan The jpeg scan to add.
+  void add_scan(size_t offset, std::string_view scan) {
+    size_t end = offset + scan.size();
+    if (end > MAX_SCAN_SIZE || (finalized_ && end > scan_size_)) {
       // TODO: handle this error
       return;
     }
-    data_.insert(std::end(data_), std::begin(scan), std::end(scan));
+    reserve(end);
+    memcpy(data_.data() + scan_start_ + offset, scan.data(), scan.size());
+    received_.insert(offset, end);
+    if (!finalized_) {
+      scan_size_ = std::max(scan_size_, end);
+    }
   }
 
-  /// Add the EOI marker to the frame.
-  /// This will add the EOI marker to the frame. This must be called before
-  /// calling get_data().
-  /// @note This will prevent any further scans from being added to the frame.
-  void finalize() {
+  /// Mark the frame as finalized.
+  /// This fixes the size of the scan data to the end of the last fragment.
+  /// @note This will prevent any scans from being added past the end.
+  /// @param scan_size The total size of the scan data.
+  void finalize(size_t scan_size) {
     if (!finalized_) {
       finalized_ = true;
-      // add_eoi();
+      scan_size_ = scan_size;
     } else {
       // TODO: handle this error
       // already finalized
     }
   }
 
-  /// Add the EOI marker to the frame.
-  void add_eoi() {
-    data_.push_back(0xFF);
-    data_.push_back(0xD9);
-  }
-
-  std::vector<uint8_t> data_;
-  JpegHeader header_;
+  // the header is only synthesized when it's needed, so these are written by
+  // the const accessors
+  mutable std::vector<uint8_t> data_;
+  mutable std::optional<JpegHeader> header_;
+  std::array<char, 2 * Q_TABLE_SIZE> q_tables_;
+  bool has_q_tables_ = false;
+  IntervalSet received_;
+  size_t scan_start_ = HEADER_RESERVE;
+  size_t scan_size_ = 0;
+  int width_ = 0;
+  int height_ = 0;
+  int type_ = 0;
+  int restart_interval_ = 0;
+  uint32_t timestamp_ = 0;
   bool finalized_ = false;
+  std::chrono::steady_clock::time_point completion_time_;
 };
 } // namespace espp
@@ -16,8 +16,14 @@ public:
   /// @param height The image height in pixels.
   /// @param q0_table The quantization table for the Y channel.
   /// @param q1_table The quantization table for the Cb and Cr channels.
-  explicit JpegHeader(int width, int height, std::string_view q0_table, std::string_view q1_table)
-      : width_(width), height_(height), q0_table_(q0_table), q1_table_(q1_table) {
+  /// @param type The RFC 2435 type, which gives the chroma subsampling: 0
+  ///        (or 64) for 4:2:2, 1 (or 65) for 4:2:0.
+  /// @param restart_interval The number of MCUs between restart markers, or
+  ///        0 if the scan has none. If nonzero, a DRI segment is added.
+  explicit JpegHeader(int width, int height, std::string_view q0_table, std::string_view q1_table,
+                      int type = 0, int restart_interval = 0)
+      : width_(width), height_(height), type_(type & ~64), restart_interval_(restart_interval),
+        q0_table_(q0_table), q1_table_(q1_table) {
     serialize();
   }
 
@@ -36,6 +42,16 @@ public:
   /// @return The image height in pixels.
   int get_height() const { return height_; }
 
+  /// Get the RFC 2435 type (without the restart marker bit) matching the
+  /// header's chroma subsampling.
+  /// @return 0 for 4:2:2, 1 for 4:2:0.
+  int get_type() const { return type_; }
+
+  /// Get the restart interval.
+  /// @return The number of MCUs between restart markers, or 0 if the header
+  ///         has no DRI segment.
+  int get_restart_interval() const { return restart_interval_; }
+
   /// Get the JPEG header data.
   /// @return The JPEG header data.
   std::string_view get_data() const { return std::string_view((const char*) data_.data(), data_.size()); }
@@ -49,6 +65,7 @@ public:
 
 protected:
   static constexpr int SOF0_SIZE = 19;
+  static constexpr int DRI_SIZE = 6;
   static constexpr int DQT_HEADER_SIZE = 5;
 
   // JFIF APP0 Marker for version 1.2 with 72 DPI and no thumbnail
@@ -63,6 +80,10 @@ protected:
       0x00, 0x00                    // No thumbnail
   };
 
+public:
+  /// The DHT segments for the (fixed) Huffman tables used by RFC 2435 streams:
+  /// DC luminance (0x00), AC luminance (0x10), DC chrominance (0x01) and AC
+  /// chrominance (0x11), from the JPEG standard (ITU-T T.81, K.3).
   static constexpr uint8_t HUFFMAN_TABLES[] = {
       // Huffman table DC (luminance)
       0xff,
@@ -502,6 +523,7 @@ protected:
       0xfa,
   };
 
+protected:
   // Scan header (SOS)
   static constexpr uint8_t SOS[] = {
       0xFF, 0xDA,      // SOS marker
@@ -530,9 +552,9 @@ protected:
     data_[offset++] = width_ & 0xFF;
     // add the number of components
     data_[offset++] = 0x03;
-    // add the Y component
+    // add the Y component, with 2x1 (4:2:2) or 2x2 (4:2:0) sampling
     data_[offset++] = 0x01;
-    data_[offset++] = 0x21;
+    data_[offset++] = type_ == 1 ? 0x22 : 0x21;
     data_[offset++] = 0x00;
     // add the Cb component
     data_[offset++] = 0x02;
@@ -545,10 +567,23 @@ protected:
     return offset;
   }
 
+  int add_dri(int offset) {
+    // add the DRI marker
+    data_[offset++] = 0xFF;
+    data_[offset++] = 0xDD;
+    // add the length of the marker
+    data_[offset++] = 0x00;
+    data_[offset++] = 0x04;
+    // add the restart interval
+    data_[offset++] = (restart_interval_ >> 8) & 0xFF;
+    data_[offset++] = restart_interval_ & 0xFF;
+    return offset;
+  }
+
   void serialize() {
     int header_size = 2 + sizeof(JFIF_APP0_DATA) + DQT_HEADER_SIZE + q0_table_.size() +
                       DQT_HEADER_SIZE + q1_table_.size() + sizeof(HUFFMAN_TABLES) + SOF0_SIZE +
-                      sizeof(SOS);
+                      (restart_interval_ ? DRI_SIZE : 0) + sizeof(SOS);
     // serialize the jpeg header to the data_ vector
     data_.resize(header_size);
     int offset = 0;
@@ -568,6 +603,9 @@ protected:
     data_[offset++] = 0x43;
     data_[offset++] = 0x00;
     memcpy(data_.data() + offset, q0_table_.data(), q0_table_.size());
+    // refer to our own copy of the table, so the header doesn't depend on the
+    // lifetime of the buffer the table came from
+    q0_table_ = std::string_view((const char*) data_.data() + offset, q0_table_.size());
     offset += q0_table_.size();
 
     // add the DQT marker for chrominance
@@ -577,6 +615,7 @@ protected:
     data_[offset++] = 0x43;
     data_[offset++] = 0x01;
     memcpy(data_.data() + offset, q1_table_.data(), q1_table_.size());
+    q1_table_ = std::string_view((const char*) data_.data() + offset, q1_table_.size());
     offset += q1_table_.size();
 
     // add huffman tables
@@ -586,6 +625,11 @@ protected:
     // add the SOF0
     offset = add_sof0(offset);
 
+    // add the restart interval, if the scan has restart markers
+    if (restart_interval_) {
+      offset = add_dri(offset);
+    }
+
     // add the SOS marker
     memcpy(data_.data() + offset, SOS, sizeof(SOS));
     offset += sizeof(SOS);
@@ -669,10 +713,11 @@ protected:
       // UE_LOG(LogTemp, Error, TEXT("Invalid SOF0 marker\n"));
       return;
     }
-    if (data_[offset++] != 0x21) {
+    if (data_[offset] != 0x21 && data_[offset] != 0x22) {
       // UE_LOG(LogTemp, Error, TEXT("Invalid SOF0 marker\n"));
       return;
     }
+    type_ = data_[offset++] == 0x22 ? 1 : 0;
     if (data_[offset++] != 0x00) {
       // UE_LOG(LogTemp, Error, TEXT("Invalid SOF0 marker\n"));
       return;
@@ -701,6 +746,11 @@ protected:
       // UE_LOG(LogTemp, Error, TEXT("Invalid SOF0 marker\n"));
       return;
     }
+    // check for the (optional) DRI marker
+    if (data_[offset] == 0xFF && data_[offset + 1] == 0xDD) {
+      restart_interval_ = (data_[offset + 4] << 8) | data_[offset + 5];
+      offset += DRI_SIZE;
+    }
     // check the SOS marker
     if (data_[offset++] != 0xFF || data_[offset++] != 0xDA) {
       // UE_LOG(LogTemp, Error, TEXT("Invalid SOS marker\n"));
@@ -755,6 +805,8 @@ protected:
 
   int width_;
   int height_;
+  int type_{0};
+  int restart_interval_{0};
   std::string_view q0_table_;
   std::string_view q1_table_;
 
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "jpeg_header.hpp"
+
+namespace espp {
+/// Huffman decoding table for one of the standard JPEG Huffman tables, which
+/// are the only ones RFC 2435 streams use.
+///
+/// The table is built at compile time from JpegHeader::HUFFMAN_TABLES (see
+/// JpegHuffmanTables), so it lives in read-only data and is never built at
+/// run time. Its lookup is indexed by the next LOOKUP_BITS bits of the scan,
+/// and each entry holds everything those bits decode to: up to two whole
+/// symbols, each with its amplitude bits already read and sign extended. Most
+/// coefficients of a typical block have short codes and small amplitudes, so
+/// a single lookup usually decodes one or two of them. Codes (plus amplitude)
+/// which don't fit in the lookup are decoded the canonical way, with
+/// max_code, symbol_offset and symbols.
+struct JpegHuffmanTable {
+  /// The number of bits each lookup resolves.
+  static constexpr int LOOKUP_BITS = 10;
+  /// The run of a symbol which ends the block.
+  static constexpr uint8_t END_OF_BLOCK = 0xFF;
+
+  /// What the next LOOKUP_BITS bits of a scan decode to.
+  struct Entry {
+    /// The number of symbols the bits decode to completely (with their
+    /// amplitude); 0 if the next symbol has to be decoded the slow way.
+    uint8_t count{0};
+    /// The number of bits of each symbol, including its amplitude.
+    uint8_t length[2]{};
+    /// The number of zero coefficients before each coefficient, or
+    /// END_OF_BLOCK. Always 0 for DC symbols.
+    uint8_t run[2]{};
+    /// Each coefficient (for AC tables) or DC difference (for DC tables).
+    int16_t value[2]{};
+  };
+
+  std::array<Entry, 1 << LOOKUP_BITS> lookup{};
+  /// The largest code of each length, or -1 if there are none.
+  std::array<int32_t, 17> max_code{};
+  /// Index of the first symbol of each length minus the first code of that
+  /// length.
+  std::array<int32_t, 17> symbol_offset{};
+  std::array<uint8_t, 256> symbols{};
+
+  /// Build the table for one of the tables in JpegHeader::HUFFMAN_TABLES.
+  /// @param table_class 0 for a DC table, 1 for an AC table.
+  /// @param table_id 0 for the luma table, 1 for the chroma table.
+  /// @return The table; empty if there is no such table.
+  static constexpr JpegHuffmanTable build(int table_class, int table_id) {
+    JpegHuffmanTable table;
+    const uint8_t *data = JpegHeader::HUFFMAN_TABLES;
+    size_t offset = 0;
+    while (offset + 4 < sizeof(JpegHeader::HUFFMAN_TABLES)) {
+      // FF C4, length, then the table class (DC = 0, AC = 1) and id, the 16
+      // code length counts and the symbols
+      size_t length = (data[offset + 2] << 8) | data[offset + 3];
+      uint8_t class_and_id = data[offset + 4];
+      if ((class_and_id >> 4) == table_class && (class_and_id & 0x0F) == table_id) {
+        table.build_canonical(data + offset + 5);
+        table.build_lookup(table_class == 1);
+        break;
+      }
+      offset += 2 + length;
+    }
+    return table;
+  }
+
+  /// Sign extend an amplitude of the given size.
+  static constexpr int extend(uint32_t bits, int size) {
+    return size && bits < (1u << (size - 1)) ? static_cast<int>(bits) - (1 << size) + 1 : static_cast<int>(bits);
+  }
+
+protected:
+  /// Where a code starts in the lookup, with the length and symbol of each
+  /// (short enough) code.
+  struct Code {
+    uint8_t length{0};
+    uint8_t symbol{0};
+  };
+
+  constexpr void build_canonical(const uint8_t *counts) {
+    const uint8_t *dht_symbols = counts + 16;
+    int code = 0;
+    int index = 0;
+    for (int length = 1; length <= 16; length++) {
+      int count = counts[length - 1];
+      symbol_offset[length] = index - code;
+      for (int i = 0; i < count; i++, index++, code++) {
+        symbols[index] = dht_symbols[index];
+      }
+      max_code[length] = count ? code - 1 : -1;
+      code <<= 1;
+    }
+  }
+
+  constexpr void build_lookup(bool is_ac) {
+    // first the single code that each lookup index starts with
+    std::array<Code, 1 << LOOKUP_BITS> codes{};
+    int code = 0;
+    int index = 0;
+    for (int length = 1; length <= LOOKUP_BITS; length++) {
+      for (; index <= symbol_offset[length] + max_code[length]; index++, code++) {
+        int shift = LOOKUP_BITS - length;
+        for (int j = 0; j < (1 << shift); j++) {
+          codes[(code << shift) | j] = Code{static_cast<uint8_t>(length), symbols[index]};
+        }
+      }
+      code <<= 1;
+    }
+    // then decode as many whole symbols as fit in each index
+    for (size_t i = 0; i < lookup.size(); i++) {
+      Entry &entry = lookup[i];
+      int used = 0;
+      while (entry.count < (is_ac ? 2 : 1)) {
+        // the remaining bits, followed by zeros
+        uint32_t bits = static_cast<uint32_t>(i << used) & ((1u << LOOKUP_BITS) - 1);
+        const Code &next = codes[bits];
+        int size = is_ac ? next.symbol & 0x0F : next.symbol;
+        int symbol_length = next.length + size;
+        if (next.length == 0 || used + symbol_length > LOOKUP_BITS) {
+          break;
+        }
+        uint32_t amplitude = (bits >> (LOOKUP_BITS - symbol_length)) & ((1u << size) - 1);
+        bool end_of_block = is_ac && next.symbol == 0x00;
+        entry.length[entry.count] = static_cast<uint8_t>(symbol_length);
+        entry.run[entry.count] = end_of_block ? END_OF_BLOCK : static_cast<uint8_t>(is_ac ? next.symbol >> 4 : 0);
+        entry.value[entry.count] = static_cast<int16_t>(extend(amplitude, size));
+        entry.count++;
+        used += symbol_length;
+        if (end_of_block) {
+          break;
+        }
+      }
+    }
+  }
+};
+
+/// The decoding tables of the standard Huffman tables in
+/// JpegHeader::HUFFMAN_TABLES, built at compile time.
+struct JpegHuffmanTables {
+  static constexpr JpegHuffmanTable DC_LUMA = JpegHuffmanTable::build(0, 0);
+  static constexpr JpegHuffmanTable AC_LUMA = JpegHuffmanTable::build(1, 0);
+  static constexpr JpegHuffmanTable DC_CHROMA = JpegHuffmanTable::build(0, 1);
+  static constexpr JpegHuffmanTable AC_CHROMA = JpegHuffmanTable::build(1, 1);
+};
+} // namespace espp
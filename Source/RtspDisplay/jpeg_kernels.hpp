@@ -0,0 +1,687 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define ESPP_JPEG_KERNELS_SSE2 1
+#include <emmintrin.h>
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+// msvc allows avx2 intrinsics in any function
+#define ESPP_JPEG_KERNELS_TARGET_AVX2
+#else
+#define ESPP_JPEG_KERNELS_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#define ESPP_JPEG_KERNELS_AVX2 1
+#endif
+
+#if defined(__ARM_NEON) || defined(__aarch64__) || defined(_M_ARM64)
+#define ESPP_JPEG_KERNELS_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace espp {
+/// The inner loops of the JPEG decoder: dequantization with the 8x8 inverse
+/// DCT, and YCbCr to BGRA color conversion with chroma upsampling.
+///
+/// Each set of kernels is a table of function pointers. There is a scalar
+/// reference set, and SSE2 and AVX2 (x86) or NEON (ARM) sets. get() picks the
+/// best set the CPU supports the first time it is called. Every set produces
+/// exactly the same output as the scalar reference: the vector kernels use
+/// the same fixed point arithmetic, rounding and saturation, so the choice of
+/// kernels never changes the decoded image.
+///
+/// The IDCT is done as two passes of the 8x8 basis matrix with 2^12 fixed
+/// point coefficients: over the rows (rounded to 2 fractional bits and
+/// saturated to 16 bits), then over the columns (rounded, level shifted and
+/// saturated to 8 bits). The color conversion is the JFIF (full range)
+/// conversion with 2^14 fixed point coefficients; chroma is upsampled by
+/// repeating each sample. The BGRA output is the byte order of
+/// PF_B8G8R8A8 textures.
+///
+/// For decoding at a reduced scale there is also a (scalar) reduced IDCT,
+/// which turns a block into 4x4, 2x2 or 1x1 pixels using only its lowest
+/// frequency coefficients.
+struct JpegKernels {
+  /// Dequantize and inverse DCT one 8x8 block.
+  /// @param coefficients The quantized coefficients, in natural (row-major)
+  ///        order.
+  /// @param q_table The quantization table, in natural order.
+  /// @param row_mask Bit v is set if row v of the block has a nonzero AC
+  ///        coefficient. The DC coefficient is always used, so 0 means the
+  ///        block only has a DC coefficient.
+  /// @param out The top left pixel of the block.
+  /// @param stride The number of bytes between two rows of pixels.
+  using IdctFunction = void (*)(const int16_t *coefficients, const int16_t *q_table, uint32_t row_mask, uint8_t *out,
+                                size_t stride);
+
+  /// Convert a row of pixels from YCbCr (with horizontally halved chroma) to
+  /// BGRA.
+  /// @param y The luma samples of the row, width of them.
+  /// @param cb The Cb samples of the row, (width + 1) / 2 of them.
+  /// @param cr The Cr samples of the row, (width + 1) / 2 of them.
+  /// @param bgra The output row, 4 * width bytes.
+  /// @param width The number of pixels in the row.
+  using ColorConvertFunction = void (*)(const uint8_t *y, const uint8_t *cb, const uint8_t *cr, uint8_t *bgra,
+                                        int width);
+
+  const char *name;
+  IdctFunction idct;
+  ColorConvertFunction ycbcr_to_bgra_row;
+
+  /// Get the fastest kernels the CPU supports.
+  /// @return The kernels, chosen once for the whole process.
+  static const JpegKernels &get() {
+    static const JpegKernels &kernels = *get_supported().back();
+    return kernels;
+  }
+
+  /// Get the scalar reference kernels.
+  /// @return The scalar kernels.
+  static const JpegKernels &get_scalar() { return SCALAR; }
+
+  /// Get every set of kernels the CPU supports, from the scalar reference to
+  /// the fastest, e.g. to check that they all produce the same output.
+  /// @return The supported kernels.
+  static std::vector<const JpegKernels *> get_supported() {
+    std::vector<const JpegKernels *> kernels = {&SCALAR};
+#if ESPP_JPEG_KERNELS_SSE2
+    kernels.push_back(&SSE2);
+    if (cpu_has_avx2()) {
+      kernels.push_back(&AVX2);
+    }
+#endif
+#if ESPP_JPEG_KERNELS_NEON
+    kernels.push_back(&NEON);
+#endif
+    return kernels;
+  }
+
+  /// The inverse DCT basis, IDCT_MATRIX[x][u] = C(u) / 2 * cos((2x + 1)uπ / 16)
+  /// with C(0) = 1 / sqrt(2) and C(u) = 1 otherwise, scaled by 2^12.
+  static constexpr int16_t IDCT_MATRIX[8][8] = {
+      {1448, 2009, 1892, 1703, 1448, 1138, 784, 400},
+      {1448, 1703, 784, -400, -1448, -2009, -1892, -1138},
+      {1448, 1138, -784, -2009, -1448, 400, 1892, 1703},
+      {1448, 400, -1892, -1138, 1448, 1703, -784, -2009},
+      {1448, -400, -1892, 1138, 1448, -1703, -784, 2009},
+      {1448, -1138, -784, 2009, -1448, -400, 1892, -1703},
+      {1448, -1703, 784, 400, -1448, 2009, -1892, 1138},
+      {1448, -2009, 1892, -1703, 1448, -1138, 784, -400},
+  };
+
+  /// The reduced inverse DCT bases, IDCT_MATRIX_N[x][u] =
+  /// C(u) / 2 * cos((2x + 1)uπ / 2N), scaled by 2^12. These are the 8 point
+  /// basis functions sampled at the centers of N pixels instead of 8, so an
+  /// N x N inverse DCT of the lowest N x N coefficients gives the block scaled
+  /// down by 8 / N.
+  static constexpr int16_t IDCT_MATRIX_4[4][4] = {
+      {1448, 1892, 1448, 784},
+      {1448, 784, -1448, -1892},
+      {1448, -784, -1448, 1892},
+      {1448, -1892, 1448, -784},
+  };
+  static constexpr int16_t IDCT_MATRIX_2[2][2] = {
+      {1448, 1448},
+      {1448, -1448},
+  };
+
+  /// JFIF YCbCr to RGB coefficients, scaled by 2^14.
+  static constexpr int16_t CR_TO_R = 22970;  // 1.402
+  static constexpr int16_t CB_TO_G = 5638;   // 0.344136
+  static constexpr int16_t CR_TO_G = 11700;  // 0.714136
+  static constexpr int16_t CB_TO_B = 29032;  // 1.772
+  static constexpr int32_t COLOR_ROUNDING = 1 << 13;
+
+  /// Round the output of the first IDCT pass, keeping 2 fractional bits.
+  static int16_t descale_row(int32_t sum) {
+    return static_cast<int16_t>(std::clamp((sum + (1 << 9)) >> 10, -32768, 32767));
+  }
+
+  /// Round the output of the second IDCT pass to a (level shifted) pixel.
+  static uint8_t descale_column(int32_t sum) {
+    return static_cast<uint8_t>(std::clamp(((sum + (1 << 13)) >> 14) + 128, 0, 255));
+  }
+
+  /// Inverse DCT of a block which only has a DC coefficient, which is a flat
+  /// block of a single value. Gives the same value the full IDCT would.
+  static void idct_dc_only(const int16_t *coefficients, const int16_t *q_table, uint8_t *out, size_t stride) {
+    int16_t dc = static_cast<int16_t>(coefficients[0] * q_table[0]);
+    uint8_t value = descale_column(IDCT_MATRIX[0][0] * descale_row(IDCT_MATRIX[0][0] * dc));
+    for (int y = 0; y < 8; y++) {
+      memset(out + y * stride, value, 8);
+    }
+  }
+
+  /// Dequantize and inverse DCT one 8x8 block to a reduced size x size block,
+  /// using only its lowest size x size coefficients. The passes are rounded
+  /// the same way as the full IDCT, so a block which only has a DC
+  /// coefficient gives the same value as idct_dc_only().
+  /// @param coefficients The quantized coefficients, in natural order.
+  /// @param q_table The quantization table, in natural order.
+  /// @param row_mask The row mask of the block, as IdctFunction takes it.
+  /// @param size The size of the output block: 1, 2 or 4.
+  /// @param out The top left pixel of the output block.
+  /// @param stride The number of bytes between two rows of pixels.
+  static void idct_reduced(const int16_t *coefficients, const int16_t *q_table, uint32_t row_mask, int size,
+                           uint8_t *out, size_t stride) {
+    if (size == 1 || row_mask == 0) {
+      int16_t dc = static_cast<int16_t>(coefficients[0] * q_table[0]);
+      uint8_t value = descale_column(IDCT_MATRIX[0][0] * descale_row(IDCT_MATRIX[0][0] * dc));
+      for (int y = 0; y < size; y++) {
+        memset(out + y * stride, value, size);
+      }
+    } else if (size == 2) {
+      idct_2x2(coefficients, q_table, out, stride);
+    } else {
+      idct_4x4(coefficients, q_table, row_mask, out, stride);
+    }
+  }
+
+  /// Convert one pixel from YCbCr to BGRA.
+  static void ycbcr_to_bgra(int y, int cb, int cr, uint8_t *out) {
+    cb -= 128;
+    cr -= 128;
+    out[0] = static_cast<uint8_t>(std::clamp(y + ((CB_TO_B * cb + COLOR_ROUNDING) >> 14), 0, 255));
+    out[1] = static_cast<uint8_t>(std::clamp(y - ((CB_TO_G * cb + CR_TO_G * cr + COLOR_ROUNDING) >> 14), 0, 255));
+    out[2] = static_cast<uint8_t>(std::clamp(y + ((CR_TO_R * cr + COLOR_ROUNDING) >> 14), 0, 255));
+    out[3] = 0xFF;
+  }
+
+protected:
+  static void idct_scalar(const int16_t *coefficients, const int16_t *q_table, uint32_t row_mask, uint8_t *out,
+                          size_t stride) {
+    if (row_mask == 0) {
+      idct_dc_only(coefficients, q_table, out, stride);
+      return;
+    }
+    // the rows which are all zero stay zero
+    row_mask |= 1;
+    int16_t tmp[64];
+    for (int v = 0; v < 8; v++) {
+      int16_t *tmp_row = tmp + v * 8;
+      if (!(row_mask & (1 << v))) {
+        memset(tmp_row, 0, 8 * sizeof(int16_t));
+        continue;
+      }
+      int16_t row[8];
+      for (int u = 0; u < 8; u++) {
+        row[u] = static_cast<int16_t>(coefficients[v * 8 + u] * q_table[v * 8 + u]);
+      }
+      // output 7 - x has the same even terms and the negated odd terms of
+      // output x
+      for (int x = 0; x < 4; x++) {
+        const int16_t *m = IDCT_MATRIX[x];
+        int32_t even = m[0] * row[0] + m[2] * row[2] + m[4] * row[4] + m[6] * row[6];
+        int32_t odd = m[1] * row[1] + m[3] * row[3] + m[5] * row[5] + m[7] * row[7];
+        tmp_row[x] = descale_row(even + odd);
+        tmp_row[7 - x] = descale_row(even - odd);
+      }
+    }
+    for (int x = 0; x < 8; x++) {
+      for (int y = 0; y < 4; y++) {
+        const int16_t *m = IDCT_MATRIX[y];
+        int32_t even = 0;
+        int32_t odd = 0;
+        for (int v = 0; v < 8; v += 2) {
+          even += m[v] * tmp[v * 8 + x];
+          odd += m[v + 1] * tmp[(v + 1) * 8 + x];
+        }
+        out[y * stride + x] = descale_column(even + odd);
+        out[(7 - y) * stride + x] = descale_column(even - odd);
+      }
+    }
+  }
+
+  /// The 4 point IDCT of IDCT_MATRIX_4, with the even and odd parts factored.
+  template <typename T>
+  static void idct_4(int32_t in0, int32_t in1, int32_t in2, int32_t in3, T (&out)[4]) {
+    int32_t even0 = IDCT_MATRIX_4[0][0] * (in0 + in2);
+    int32_t even1 = IDCT_MATRIX_4[0][0] * (in0 - in2);
+    int32_t odd0 = IDCT_MATRIX_4[0][1] * in1 + IDCT_MATRIX_4[0][3] * in3;
+    int32_t odd1 = IDCT_MATRIX_4[1][1] * in1 + IDCT_MATRIX_4[1][3] * in3;
+    out[0] = even0 + odd0;
+    out[1] = even1 + odd1;
+    out[2] = even1 - odd1;
+    out[3] = even0 - odd0;
+  }
+
+  static void idct_4x4(const int16_t *coefficients, const int16_t *q_table, uint32_t row_mask, uint8_t *out,
+                       size_t stride) {
+    // the rows which are all zero stay zero
+    row_mask |= 1;
+    int16_t tmp[4][4];
+    for (int v = 0; v < 4; v++) {
+      if (!(row_mask & (1 << v))) {
+        memset(tmp[v], 0, sizeof(tmp[v]));
+        continue;
+      }
+      const int16_t *c = coefficients + v * 8;
+      const int16_t *q = q_table + v * 8;
+      int32_t sums[4];
+      idct_4(static_cast<int16_t>(c[0] * q[0]), static_cast<int16_t>(c[1] * q[1]), static_cast<int16_t>(c[2] * q[2]),
+             static_cast<int16_t>(c[3] * q[3]), sums);
+      for (int x = 0; x < 4; x++) {
+        tmp[v][x] = descale_row(sums[x]);
+      }
+    }
+    for (int x = 0; x < 4; x++) {
+      int32_t sums[4];
+      idct_4(tmp[0][x], tmp[1][x], tmp[2][x], tmp[3][x], sums);
+      for (int y = 0; y < 4; y++) {
+        out[y * stride + x] = descale_column(sums[y]);
+      }
+    }
+  }
+
+  static void idct_2x2(const int16_t *coefficients, const int16_t *q_table, uint8_t *out, size_t stride) {
+    constexpr int32_t m = IDCT_MATRIX_2[0][0];
+    int16_t tmp[2][2];
+    for (int v = 0; v < 2; v++) {
+      int16_t in0 = static_cast<int16_t>(coefficients[v * 8] * q_table[v * 8]);
+      int16_t in1 = static_cast<int16_t>(coefficients[v * 8 + 1] * q_table[v * 8 + 1]);
+      tmp[v][0] = descale_row(m * (in0 + in1));
+      tmp[v][1] = descale_row(m * (in0 - in1));
+    }
+    for (int x = 0; x < 2; x++) {
+      out[x] = descale_column(m * (tmp[0][x] + tmp[1][x]));
+      out[stride + x] = descale_column(m * (tmp[0][x] - tmp[1][x]));
+    }
+  }
+
+  static void ycbcr_to_bgra_row_scalar(const uint8_t *y, const uint8_t *cb, const uint8_t *cr, uint8_t *bgra,
+                                       int width) {
+    for (int x = 0; x < width; x++) {
+      ycbcr_to_bgra(y[x], cb[x >> 1], cr[x >> 1], bgra + x * 4);
+    }
+  }
+
+#if ESPP_JPEG_KERNELS_SSE2
+  /// Two 16 bit constants, as the (a, b) pair of every 32 bit lane for
+  /// _mm_madd_epi16.
+  static int32_t pair(int16_t a, int16_t b) {
+    return static_cast<int32_t>(static_cast<uint16_t>(a) | (static_cast<uint32_t>(static_cast<uint16_t>(b)) << 16));
+  }
+
+  static void transpose_sse2(__m128i r[8]) {
+    __m128i a0 = _mm_unpacklo_epi16(r[0], r[1]);
+    __m128i a1 = _mm_unpackhi_epi16(r[0], r[1]);
+    __m128i a2 = _mm_unpacklo_epi16(r[2], r[3]);
+    __m128i a3 = _mm_unpackhi_epi16(r[2], r[3]);
+    __m128i a4 = _mm_unpacklo_epi16(r[4], r[5]);
+    __m128i a5 = _mm_unpackhi_epi16(r[4], r[5]);
+    __m128i a6 = _mm_unpacklo_epi16(r[6], r[7]);
+    __m128i a7 = _mm_unpackhi_epi16(r[6], r[7]);
+    __m128i b0 = _mm_unpacklo_epi32(a0, a2);
+    __m128i b1 = _mm_unpackhi_epi32(a0, a2);
+    __m128i b2 = _mm_unpacklo_epi32(a1, a3);
+    __m128i b3 = _mm_unpackhi_epi32(a1, a3);
+    __m128i b4 = _mm_unpacklo_epi32(a4, a6);
+    __m128i b5 = _mm_unpackhi_epi32(a4, a6);
+    __m128i b6 = _mm_unpacklo_epi32(a5, a7);
+    __m128i b7 = _mm_unpackhi_epi32(a5, a7);
+    r[0] = _mm_unpacklo_epi64(b0, b4);
+    r[1] = _mm_unpackhi_epi64(b0, b4);
+    r[2] = _mm_unpacklo_epi64(b1, b5);
+    r[3] = _mm_unpackhi_epi64(b1, b5);
+    r[4] = _mm_unpacklo_epi64(b2, b6);
+    r[5] = _mm_unpackhi_epi64(b2, b6);
+    r[6] = _mm_unpacklo_epi64(b3, b7);
+    r[7] = _mm_unpackhi_epi64(b3, b7);
+  }
+
+  /// One 1D IDCT pass over 8 lanes: out[x] = sum(IDCT_MATRIX[x][u] * in[u])
+  /// for each lane, rounded and shifted right by `shift`, saturated to 16 bits.
+  template <int SHIFT> static void idct_pass_sse2(const __m128i in[8], __m128i out[8]) {
+    const __m128i rounding = _mm_set1_epi32(1 << (SHIFT - 1));
+    __m128i p02_lo = _mm_unpacklo_epi16(in[0], in[2]);
+    __m128i p02_hi = _mm_unpackhi_epi16(in[0], in[2]);
+    __m128i p46_lo = _mm_unpacklo_epi16(in[4], in[6]);
+    __m128i p46_hi = _mm_unpackhi_epi16(in[4], in[6]);
+    __m128i p13_lo = _mm_unpacklo_epi16(in[1], in[3]);
+    __m128i p13_hi = _mm_unpackhi_epi16(in[1], in[3]);
+    __m128i p57_lo = _mm_unpacklo_epi16(in[5], in[7]);
+    __m128i p57_hi = _mm_unpackhi_epi16(in[5], in[7]);
+    for (int x = 0; x < 4; x++) {
+      const int16_t *m = IDCT_MATRIX[x];
+      __m128i k02 = _mm_set1_epi32(pair(m[0], m[2]));
+      __m128i k46 = _mm_set1_epi32(pair(m[4], m[6]));
+      __m128i k13 = _mm_set1_epi32(pair(m[1], m[3]));
+      __m128i k57 = _mm_set1_epi32(pair(m[5], m[7]));
+      __m128i even_lo = _mm_add_epi32(_mm_madd_epi16(p02_lo, k02), _mm_madd_epi16(p46_lo, k46));
+      __m128i even_hi = _mm_add_epi32(_mm_madd_epi16(p02_hi, k02), _mm_madd_epi16(p46_hi, k46));
+      __m128i odd_lo = _mm_add_epi32(_mm_madd_epi16(p13_lo, k13), _mm_madd_epi16(p57_lo, k57));
+      __m128i odd_hi = _mm_add_epi32(_mm_madd_epi16(p13_hi, k13), _mm_madd_epi16(p57_hi, k57));
+      out[x] = _mm_packs_epi32(_mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(even_lo, odd_lo), rounding), SHIFT),
+                               _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(even_hi, odd_hi), rounding), SHIFT));
+      out[7 - x] = _mm_packs_epi32(_mm_srai_epi32(_mm_add_epi32(_mm_sub_epi32(even_lo, odd_lo), rounding), SHIFT),
+                                   _mm_srai_epi32(_mm_add_epi32(_mm_sub_epi32(even_hi, odd_hi), rounding), SHIFT));
+    }
+  }
+
+  /// Level shift and store 8 rows of pixels.
+  static void store_pixels_sse2(const __m128i rows[8], uint8_t *out, size_t stride) {
+    const __m128i level_shift = _mm_set1_epi16(128);
+    for (int y = 0; y < 8; y++) {
+      __m128i pixels = _mm_adds_epi16(rows[y], level_shift);
+      _mm_storel_epi64(reinterpret_cast<__m128i *>(out + y * stride), _mm_packus_epi16(pixels, pixels));
+    }
+  }
+
+  static void idct_sse2(const int16_t *coefficients, const int16_t *q_table, uint32_t row_mask, uint8_t *out,
+                        size_t stride) {
+    if (row_mask == 0) {
+      idct_dc_only(coefficients, q_table, out, stride);
+      return;
+    }
+    __m128i r[8];
+    for (int v = 0; v < 8; v++) {
+      r[v] = _mm_mullo_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(coefficients + v * 8)),
+                             _mm_loadu_si128(reinterpret_cast<const __m128i *>(q_table + v * 8)));
+    }
+    // the row pass works on the columns of the block (one lane per row), and
+    // produces the columns of the intermediate result
+    transpose_sse2(r);
+    __m128i t[8];
+    idct_pass_sse2<10>(r, t);
+    // the column pass works on its rows (one lane per column), and produces
+    // the rows of pixels
+    transpose_sse2(t);
+    idct_pass_sse2<14>(t, r);
+    store_pixels_sse2(r, out, stride);
+  }
+
+  /// Interleave 16 pixels of B, G and R (and opaque A) into BGRA.
+  static void store_bgra_sse2(__m128i b, __m128i g, __m128i r, uint8_t *bgra) {
+    const __m128i alpha = _mm_set1_epi8(static_cast<char>(0xFF));
+    __m128i bg_lo = _mm_unpacklo_epi8(b, g);
+    __m128i bg_hi = _mm_unpackhi_epi8(b, g);
+    __m128i ra_lo = _mm_unpacklo_epi8(r, alpha);
+    __m128i ra_hi = _mm_unpackhi_epi8(r, alpha);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(bgra), _mm_unpacklo_epi16(bg_lo, ra_lo));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(bgra + 16), _mm_unpackhi_epi16(bg_lo, ra_lo));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(bgra + 32), _mm_unpacklo_epi16(bg_hi, ra_hi));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(bgra + 48), _mm_unpackhi_epi16(bg_hi, ra_hi));
+  }
+
+  /// Compute the B, G and R offsets from luma of 8 pixels, whose (centered)
+  /// chroma is in cb and cr.
+  static void chroma_to_rgb_sse2(__m128i cb, __m128i cr, __m128i &b, __m128i &g, __m128i &r) {
+    const __m128i one = _mm_set1_epi16(1);
+    const __m128i k_b = _mm_set1_epi32(pair(CB_TO_B, static_cast<int16_t>(COLOR_ROUNDING)));
+    const __m128i k_g = _mm_set1_epi32(pair(CB_TO_G, CR_TO_G));
+    const __m128i k_r = _mm_set1_epi32(pair(CR_TO_R, static_cast<int16_t>(COLOR_ROUNDING)));
+    const __m128i rounding = _mm_set1_epi32(COLOR_ROUNDING);
+    __m128i cb_one_lo = _mm_unpacklo_epi16(cb, one);
+    __m128i cb_one_hi = _mm_unpackhi_epi16(cb, one);
+    __m128i cr_one_lo = _mm_unpacklo_epi16(cr, one);
+    __m128i cr_one_hi = _mm_unpackhi_epi16(cr, one);
+    __m128i cb_cr_lo = _mm_unpacklo_epi16(cb, cr);
+    __m128i cb_cr_hi = _mm_unpackhi_epi16(cb, cr);
+    b = _mm_packs_epi32(_mm_srai_epi32(_mm_madd_epi16(cb_one_lo, k_b), 14),
+                        _mm_srai_epi32(_mm_madd_epi16(cb_one_hi, k_b), 14));
+    g = _mm_packs_epi32(_mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(cb_cr_lo, k_g), rounding), 14),
+                        _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(cb_cr_hi, k_g), rounding), 14));
+    r = _mm_packs_epi32(_mm_srai_epi32(_mm_madd_epi16(cr_one_lo, k_r), 14),
+                        _mm_srai_epi32(_mm_madd_epi16(cr_one_hi, k_r), 14));
+  }
+
+  static void ycbcr_to_bgra_row_sse2(const uint8_t *y, const uint8_t *cb, const uint8_t *cr, uint8_t *bgra,
+                                     int width) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i center = _mm_set1_epi16(128);
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+      __m128i y8 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(y + x));
+      __m128i y_lo = _mm_unpacklo_epi8(y8, zero);
+      __m128i y_hi = _mm_unpackhi_epi8(y8, zero);
+      // 8 chroma samples cover the 16 pixels; repeat each of them twice
+      __m128i cb8 = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(cb + x / 2));
+      __m128i cr8 = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(cr + x / 2));
+      cb8 = _mm_unpacklo_epi8(cb8, cb8);
+      cr8 = _mm_unpacklo_epi8(cr8, cr8);
+      __m128i cb_lo = _mm_sub_epi16(_mm_unpacklo_epi8(cb8, zero), center);
+      __m128i cb_hi = _mm_sub_epi16(_mm_unpackhi_epi8(cb8, zero), center);
+      __m128i cr_lo = _mm_sub_epi16(_mm_unpacklo_epi8(cr8, zero), center);
+      __m128i cr_hi = _mm_sub_epi16(_mm_unpackhi_epi8(cr8, zero), center);
+      __m128i b_lo, g_lo, r_lo, b_hi, g_hi, r_hi;
+      chroma_to_rgb_sse2(cb_lo, cr_lo, b_lo, g_lo, r_lo);
+      chroma_to_rgb_sse2(cb_hi, cr_hi, b_hi, g_hi, r_hi);
+      __m128i b = _mm_packus_epi16(_mm_adds_epi16(y_lo, b_lo), _mm_adds_epi16(y_hi, b_hi));
+      __m128i g = _mm_packus_epi16(_mm_subs_epi16(y_lo, g_lo), _mm_subs_epi16(y_hi, g_hi));
+      __m128i r = _mm_packus_epi16(_mm_adds_epi16(y_lo, r_lo), _mm_adds_epi16(y_hi, r_hi));
+      store_bgra_sse2(b, g, r, bgra + x * 4);
+    }
+    for (; x < width; x++) {
+      ycbcr_to_bgra(y[x], cb[x >> 1], cr[x >> 1], bgra + x * 4);
+    }
+  }
+
+  /// 256 bit version of idct_pass_sse2: each pair of inputs is interleaved
+  /// into one register, so each multiply-add covers all 8 lanes.
+  template <int SHIFT> ESPP_JPEG_KERNELS_TARGET_AVX2 static void idct_pass_avx2(const __m128i in[8], __m128i out[8]) {
+    const __m256i rounding = _mm256_set1_epi32(1 << (SHIFT - 1));
+    __m256i p02 = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_unpacklo_epi16(in[0], in[2])),
+                                          _mm_unpackhi_epi16(in[0], in[2]), 1);
+    __m256i p46 = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_unpacklo_epi16(in[4], in[6])),
+                                          _mm_unpackhi_epi16(in[4], in[6]), 1);
+    __m256i p13 = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_unpacklo_epi16(in[1], in[3])),
+                                          _mm_unpackhi_epi16(in[1], in[3]), 1);
+    __m256i p57 = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_unpacklo_epi16(in[5], in[7])),
+                                          _mm_unpackhi_epi16(in[5], in[7]), 1);
+    for (int x = 0; x < 4; x++) {
+      const int16_t *m = IDCT_MATRIX[x];
+      __m256i even = _mm256_add_epi32(_mm256_madd_epi16(p02, _mm256_set1_epi32(pair(m[0], m[2]))),
+                                      _mm256_madd_epi16(p46, _mm256_set1_epi32(pair(m[4], m[6]))));
+      __m256i odd = _mm256_add_epi32(_mm256_madd_epi16(p13, _mm256_set1_epi32(pair(m[1], m[3]))),
+                                     _mm256_madd_epi16(p57, _mm256_set1_epi32(pair(m[5], m[7]))));
+      __m256i sum = _mm256_srai_epi32(_mm256_add_epi32(_mm256_add_epi32(even, odd), rounding), SHIFT);
+      __m256i difference = _mm256_srai_epi32(_mm256_add_epi32(_mm256_sub_epi32(even, odd), rounding), SHIFT);
+      out[x] = _mm_packs_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+      out[7 - x] = _mm_packs_epi32(_mm256_castsi256_si128(difference), _mm256_extracti128_si256(difference, 1));
+    }
+  }
+
+  ESPP_JPEG_KERNELS_TARGET_AVX2 static void idct_avx2(const int16_t *coefficients, const int16_t *q_table,
+                                                      uint32_t row_mask, uint8_t *out, size_t stride) {
+    if (row_mask == 0) {
+      idct_dc_only(coefficients, q_table, out, stride);
+      return;
+    }
+    __m128i r[8];
+    for (int v = 0; v < 8; v++) {
+      r[v] = _mm_mullo_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(coefficients + v * 8)),
+                             _mm_loadu_si128(reinterpret_cast<const __m128i *>(q_table + v * 8)));
+    }
+    transpose_sse2(r);
+    __m128i t[8];
+    idct_pass_avx2<10>(r, t);
+    transpose_sse2(t);
+    idct_pass_avx2<14>(t, r);
+    store_pixels_sse2(r, out, stride);
+  }
+
+  ESPP_JPEG_KERNELS_TARGET_AVX2 static void ycbcr_to_bgra_row_avx2(const uint8_t *y, const uint8_t *cb,
+                                                                   const uint8_t *cr, uint8_t *bgra, int width) {
+    const __m256i center = _mm256_set1_epi16(128);
+    const __m256i one = _mm256_set1_epi16(1);
+    const __m256i k_b = _mm256_set1_epi32(pair(CB_TO_B, static_cast<int16_t>(COLOR_ROUNDING)));
+    const __m256i k_g = _mm256_set1_epi32(pair(CB_TO_G, CR_TO_G));
+    const __m256i k_r = _mm256_set1_epi32(pair(CR_TO_R, static_cast<int16_t>(COLOR_ROUNDING)));
+    const __m256i rounding = _mm256_set1_epi32(COLOR_ROUNDING);
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+      __m256i y16 = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(y + x)));
+      __m128i cb8 = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(cb + x / 2));
+      __m128i cr8 = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(cr + x / 2));
+      __m256i cb16 = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_unpacklo_epi8(cb8, cb8)), center);
+      __m256i cr16 = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_unpacklo_epi8(cr8, cr8)), center);
+      // the unpacks and packs both work within each 128 bit lane, so the
+      // pixels come back out in order
+      __m256i b = _mm256_packs_epi32(_mm256_srai_epi32(_mm256_madd_epi16(_mm256_unpacklo_epi16(cb16, one), k_b), 14),
+                                     _mm256_srai_epi32(_mm256_madd_epi16(_mm256_unpackhi_epi16(cb16, one), k_b), 14));
+      __m256i g = _mm256_packs_epi32(
+          _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(_mm256_unpacklo_epi16(cb16, cr16), k_g), rounding), 14),
+          _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(_mm256_unpackhi_epi16(cb16, cr16), k_g), rounding),
+                            14));
+      __m256i r = _mm256_packs_epi32(_mm256_srai_epi32(_mm256_madd_epi16(_mm256_unpacklo_epi16(cr16, one), k_r), 14),
+                                     _mm256_srai_epi32(_mm256_madd_epi16(_mm256_unpackhi_epi16(cr16, one), k_r), 14));
+      b = _mm256_adds_epi16(y16, b);
+      g = _mm256_subs_epi16(y16, g);
+      r = _mm256_adds_epi16(y16, r);
+      store_bgra_sse2(_mm_packus_epi16(_mm256_castsi256_si128(b), _mm256_extracti128_si256(b, 1)),
+                      _mm_packus_epi16(_mm256_castsi256_si128(g), _mm256_extracti128_si256(g, 1)),
+                      _mm_packus_epi16(_mm256_castsi256_si128(r), _mm256_extracti128_si256(r, 1)), bgra + x * 4);
+    }
+    for (; x < width; x++) {
+      ycbcr_to_bgra(y[x], cb[x >> 1], cr[x >> 1], bgra + x * 4);
+    }
+  }
+
+  static bool cpu_has_avx2() {
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) {
+      return false;
+    }
+    __cpuid(info, 1);
+    // the OS has to save the AVX registers too
+    bool os_saves_avx = (info[2] & (1 << 27)) && (_xgetbv(0) & 0x6) == 0x6;
+    __cpuidex(info, 7, 0);
+    return os_saves_avx && (info[1] & (1 << 5));
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+  }
+#endif // ESPP_JPEG_KERNELS_SSE2
+
+#if ESPP_JPEG_KERNELS_NEON
+  static void transpose_neon(int16x8_t r[8]) {
+    int16x8x2_t a01 = vtrnq_s16(r[0], r[1]);
+    int16x8x2_t a23 = vtrnq_s16(r[2], r[3]);
+    int16x8x2_t a45 = vtrnq_s16(r[4], r[5]);
+    int16x8x2_t a67 = vtrnq_s16(r[6], r[7]);
+    int32x4x2_t b02 = vtrnq_s32(vreinterpretq_s32_s16(a01.val[0]), vreinterpretq_s32_s16(a23.val[0]));
+    int32x4x2_t b13 = vtrnq_s32(vreinterpretq_s32_s16(a01.val[1]), vreinterpretq_s32_s16(a23.val[1]));
+    int32x4x2_t b46 = vtrnq_s32(vreinterpretq_s32_s16(a45.val[0]), vreinterpretq_s32_s16(a67.val[0]));
+    int32x4x2_t b57 = vtrnq_s32(vreinterpretq_s32_s16(a45.val[1]), vreinterpretq_s32_s16(a67.val[1]));
+    r[0] = vreinterpretq_s16_s32(vcombine_s32(vget_low_s32(b02.val[0]), vget_low_s32(b46.val[0])));
+    r[4] = vreinterpretq_s16_s32(vcombine_s32(vget_high_s32(b02.val[0]), vget_high_s32(b46.val[0])));
+    r[1] = vreinterpretq_s16_s32(vcombine_s32(vget_low_s32(b13.val[0]), vget_low_s32(b57.val[0])));
+    r[5] = vreinterpretq_s16_s32(vcombine_s32(vget_high_s32(b13.val[0]), vget_high_s32(b57.val[0])));
+    r[2] = vreinterpretq_s16_s32(vcombine_s32(vget_low_s32(b02.val[1]), vget_low_s32(b46.val[1])));
+    r[6] = vreinterpretq_s16_s32(vcombine_s32(vget_high_s32(b02.val[1]), vget_high_s32(b46.val[1])));
+    r[3] = vreinterpretq_s16_s32(vcombine_s32(vget_low_s32(b13.val[1]), vget_low_s32(b57.val[1])));
+    r[7] = vreinterpretq_s16_s32(vcombine_s32(vget_high_s32(b13.val[1]), vget_high_s32(b57.val[1])));
+  }
+
+  /// One 1D IDCT pass over 8 lanes, like idct_pass_sse2. vqrshrn rounds,
+  /// shifts and saturates exactly like the scalar descale.
+  template <int SHIFT> static void idct_pass_neon(const int16x8_t in[8], int16x8_t out[8]) {
+    for (int x = 0; x < 4; x++) {
+      const int16_t *m = IDCT_MATRIX[x];
+      int32x4_t even_lo = vmull_n_s16(vget_low_s16(in[0]), m[0]);
+      int32x4_t even_hi = vmull_n_s16(vget_high_s16(in[0]), m[0]);
+      int32x4_t odd_lo = vmull_n_s16(vget_low_s16(in[1]), m[1]);
+      int32x4_t odd_hi = vmull_n_s16(vget_high_s16(in[1]), m[1]);
+      for (int u = 2; u < 8; u += 2) {
+        even_lo = vmlal_n_s16(even_lo, vget_low_s16(in[u]), m[u]);
+        even_hi = vmlal_n_s16(even_hi, vget_high_s16(in[u]), m[u]);
+        odd_lo = vmlal_n_s16(odd_lo, vget_low_s16(in[u + 1]), m[u + 1]);
+        odd_hi = vmlal_n_s16(odd_hi, vget_high_s16(in[u + 1]), m[u + 1]);
+      }
+      out[x] = vcombine_s16(vqrshrn_n_s32(vaddq_s32(even_lo, odd_lo), SHIFT),
+                            vqrshrn_n_s32(vaddq_s32(even_hi, odd_hi), SHIFT));
+      out[7 - x] = vcombine_s16(vqrshrn_n_s32(vsubq_s32(even_lo, odd_lo), SHIFT),
+                                vqrshrn_n_s32(vsubq_s32(even_hi, odd_hi), SHIFT));
+    }
+  }
+
+  static void idct_neon(const int16_t *coefficients, const int16_t *q_table, uint32_t row_mask, uint8_t *out,
+                        size_t stride) {
+    if (row_mask == 0) {
+      idct_dc_only(coefficients, q_table, out, stride);
+      return;
+    }
+    int16x8_t r[8];
+    for (int v = 0; v < 8; v++) {
+      r[v] = vmulq_s16(vld1q_s16(coefficients + v * 8), vld1q_s16(q_table + v * 8));
+    }
+    transpose_neon(r);
+    int16x8_t t[8];
+    idct_pass_neon<10>(r, t);
+    transpose_neon(t);
+    idct_pass_neon<14>(t, r);
+    const int16x8_t level_shift = vdupq_n_s16(128);
+    for (int y = 0; y < 8; y++) {
+      vst1_u8(out + y * stride, vqmovun_s16(vqaddq_s16(r[y], level_shift)));
+    }
+  }
+
+  /// Compute the B, G and R offsets from luma of 8 pixels. vrshrn rounds and
+  /// shifts exactly like the scalar conversion.
+  static void chroma_to_rgb_neon(int16x8_t cb, int16x8_t cr, int16x8_t &b, int16x8_t &g, int16x8_t &r) {
+    b = vcombine_s16(vrshrn_n_s32(vmull_n_s16(vget_low_s16(cb), CB_TO_B), 14),
+                     vrshrn_n_s32(vmull_n_s16(vget_high_s16(cb), CB_TO_B), 14));
+    g = vcombine_s16(
+        vrshrn_n_s32(vmlal_n_s16(vmull_n_s16(vget_low_s16(cb), CB_TO_G), vget_low_s16(cr), CR_TO_G), 14),
+        vrshrn_n_s32(vmlal_n_s16(vmull_n_s16(vget_high_s16(cb), CB_TO_G), vget_high_s16(cr), CR_TO_G), 14));
+    r = vcombine_s16(vrshrn_n_s32(vmull_n_s16(vget_low_s16(cr), CR_TO_R), 14),
+                     vrshrn_n_s32(vmull_n_s16(vget_high_s16(cr), CR_TO_R), 14));
+  }
+
+  static void ycbcr_to_bgra_row_neon(const uint8_t *y, const uint8_t *cb, const uint8_t *cr, uint8_t *bgra,
+                                     int width) {
+    const int16x8_t center = vdupq_n_s16(128);
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+      uint8x16_t y8 = vld1q_u8(y + x);
+      int16x8_t y_lo = vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(y8)));
+      int16x8_t y_hi = vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(y8)));
+      // 8 chroma samples cover the 16 pixels; repeat each of them twice
+      uint8x8x2_t cb8 = vzip_u8(vld1_u8(cb + x / 2), vld1_u8(cb + x / 2));
+      uint8x8x2_t cr8 = vzip_u8(vld1_u8(cr + x / 2), vld1_u8(cr + x / 2));
+      int16x8_t b_lo, g_lo, r_lo, b_hi, g_hi, r_hi;
+      chroma_to_rgb_neon(vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(cb8.val[0])), center),
+                         vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(cr8.val[0])), center), b_lo, g_lo, r_lo);
+      chroma_to_rgb_neon(vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(cb8.val[1])), center),
+                         vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(cr8.val[1])), center), b_hi, g_hi, r_hi);
+      uint8x16x4_t pixels;
+      pixels.val[0] = vcombine_u8(vqmovun_s16(vqaddq_s16(y_lo, b_lo)), vqmovun_s16(vqaddq_s16(y_hi, b_hi)));
+      pixels.val[1] = vcombine_u8(vqmovun_s16(vqsubq_s16(y_lo, g_lo)), vqmovun_s16(vqsubq_s16(y_hi, g_hi)));
+      pixels.val[2] = vcombine_u8(vqmovun_s16(vqaddq_s16(y_lo, r_lo)), vqmovun_s16(vqaddq_s16(y_hi, r_hi)));
+      pixels.val[3] = vdupq_n_u8(0xFF);
+      vst4q_u8(bgra + x * 4, pixels);
+    }
+    for (; x < width; x++) {
+      ycbcr_to_bgra(y[x], cb[x >> 1], cr[x >> 1], bgra + x * 4);
+    }
+  }
+#endif // ESPP_JPEG_KERNELS_NEON
+
+  static const JpegKernels SCALAR;
+#if ESPP_JPEG_KERNELS_SSE2
+  static const JpegKernels SSE2;
+  static const JpegKernels AVX2;
+#endif
+#if ESPP_JPEG_KERNELS_NEON
+  static const JpegKernels NEON;
+#endif
+};
+
+inline const JpegKernels JpegKernels::SCALAR = {"scalar", &JpegKernels::idct_scalar,
+                                                &JpegKernels::ycbcr_to_bgra_row_scalar};
+#if ESPP_JPEG_KERNELS_SSE2
+inline const JpegKernels JpegKernels::SSE2 = {"sse2", &JpegKernels::idct_sse2, &JpegKernels::ycbcr_to_bgra_row_sse2};
+inline const JpegKernels JpegKernels::AVX2 = {"avx2", &JpegKernels::idct_avx2, &JpegKernels::ycbcr_to_bgra_row_avx2};
+#endif
+#if ESPP_JPEG_KERNELS_NEON
+inline const JpegKernels JpegKernels::NEON = {"neon", &JpegKernels::idct_neon, &JpegKernels::ycbcr_to_bgra_row_neon};
+#endif
+} // namespace espp
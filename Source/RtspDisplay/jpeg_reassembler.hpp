@@ -0,0 +1,166 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "jpeg_frame.hpp"
+#include "reorder_buffer.hpp"
+
+namespace espp {
+/// Reassembles the RTP/JPEG packets of a single stream into JpegFrames.
+///
+/// Several frames may be in flight at once (e.g. when the last packets of one
+/// frame arrive after the first packets of the next); they are keyed by their
+/// extended RTP timestamp and held in a bounded number of slots. When a new
+/// frame needs a slot and none is free, the oldest in-flight frame is evicted.
+/// When a frame completes, every older in-flight frame is evicted too, since
+/// it could only be displayed out of order.
+///
+/// Completed frames are handed to the caller, who should give them back with
+/// recycle() once they have been decoded so that their buffers are reused.
+///
+/// @note Not thread safe; each stream owns its own reassembler.
+class JpegReassembler {
+public:
+  /// Statistics about the reassembly.
+  struct Stats {
+    uint64_t frames_completed{0}; ///< Frames that were completely received.
+    uint64_t frames_evicted{0};   ///< Incomplete frames that were dropped.
+    uint64_t packets_late{0};     ///< Packets for frames that were already completed or dropped.
+    size_t frames_in_flight{0};   ///< Frames currently being reassembled.
+  };
+
+  /// Construct a reassembler.
+  /// @param max_frames The maximum number of frames in flight at once.
+  explicit JpegReassembler(size_t max_frames = 4) : max_frames_(std::max<size_t>(max_frames, 1)) {
+    slots_.reserve(max_frames_);
+  }
+
+  /// Add a packet to the frame it belongs to.
+  /// @param packet The packet to add. Its data is copied into the frame.
+  /// @return The frame, if this packet completed it; nullptr otherwise.
+  std::unique_ptr<JpegFrame> add_packet(const RtpJpegPacketView &packet) {
+    int64_t timestamp = timestamp_unwrapper_.unwrap(packet.get_timestamp());
+    if (last_timestamp_ && timestamp <= *last_timestamp_) {
+      // this frame was already completed (or superseded by a newer one)
+      stats_.packets_late++;
+      return nullptr;
+    }
+
+    auto slot = std::find_if(slots_.begin(), slots_.end(),
+                             [timestamp](const Slot &s) { return s.timestamp == timestamp; });
+    if (slot == slots_.end()) {
+      if (slots_.size() >= max_frames_) {
+        // no free slots, so give up on the oldest frame
+        auto oldest = std::min_element(slots_.begin(), slots_.end(),
+                                       [](const Slot &a, const Slot &b) { return a.timestamp < b.timestamp; });
+        evict(oldest);
+      }
+      slots_.push_back({timestamp, make_frame(packet)});
+      slot = slots_.end() - 1;
+      stats_.frames_in_flight = slots_.size();
+    } else {
+      slot->frame->add_scan(packet);
+    }
+
+    if (!slot->frame->is_complete()) {
+      return nullptr;
+    }
+
+    auto frame = std::move(slot->frame);
+    frame->set_completion_time(std::chrono::steady_clock::now());
+    slots_.erase(slot);
+    // frames older than this one can no longer be shown in order
+    for (auto it = slots_.begin(); it != slots_.end();) {
+      if (it->timestamp < timestamp) {
+        it = evict(it);
+      } else {
+        ++it;
+      }
+    }
+    last_timestamp_ = timestamp;
+    size_hint_ = frame->get_scan_data().size();
+    stats_.frames_completed++;
+    stats_.frames_in_flight = slots_.size();
+    return frame;
+  }
+
+  /// Get the newest frame which is still being reassembled, e.g. to start
+  /// decoding what has been received of it so far.
+  /// @return The newest in-flight frame, or nullptr if there are none. It is
+  ///         only valid until the next call to add_packet() or reset().
+  const JpegFrame *get_newest_frame() const {
+    auto newest = std::max_element(slots_.begin(), slots_.end(),
+                                   [](const Slot &a, const Slot &b) { return a.timestamp < b.timestamp; });
+    return newest == slots_.end() ? nullptr : newest->frame.get();
+  }
+
+  /// Give a frame back so that its buffer can be reused for a later frame.
+  /// @param frame The frame to recycle.
+  void recycle(std::unique_ptr<JpegFrame> frame) {
+    if (frame && spare_frames_.size() < max_frames_) {
+      spare_frames_.push_back(std::move(frame));
+    }
+  }
+
+  /// Set the expected size of the frames' scan data, e.g. from the stream's
+  /// description, so that the buffers of the first frames are allocated at
+  /// that size instead of growing as their packets arrive. Later frames are
+  /// sized from the frames before them.
+  /// @param scan_size The expected size of the scan data, in bytes.
+  void set_size_hint(size_t scan_size) { size_hint_ = scan_size; }
+
+  /// Drop every in-flight frame and start a new sequence of frames.
+  void reset() {
+    while (!slots_.empty()) {
+      recycle(std::move(slots_.back().frame));
+      slots_.pop_back();
+    }
+    timestamp_unwrapper_.reset();
+    last_timestamp_.reset();
+    stats_.frames_in_flight = 0;
+  }
+
+  /// Get the reassembly statistics.
+  /// @return The reassembly statistics.
+  const Stats &get_stats() const { return stats_; }
+
+protected:
+  struct Slot {
+    int64_t timestamp;
+    std::unique_ptr<JpegFrame> frame;
+  };
+
+  std::unique_ptr<JpegFrame> make_frame(const RtpJpegPacketView &packet) {
+    // size the frame buffer for a frame a bit larger than the last one, so it
+    // (usually) never has to grow
+    size_t size_hint = size_hint_ + size_hint_ / 4;
+    if (spare_frames_.empty()) {
+      return std::make_unique<JpegFrame>(packet, size_hint);
+    }
+    auto frame = std::move(spare_frames_.back());
+    spare_frames_.pop_back();
+    frame->reset(packet, size_hint);
+    return frame;
+  }
+
+  std::vector<Slot>::iterator evict(std::vector<Slot>::iterator slot) {
+    stats_.frames_evicted++;
+    recycle(std::move(slot->frame));
+    auto next = slots_.erase(slot);
+    stats_.frames_in_flight = slots_.size();
+    return next;
+  }
+
+  size_t max_frames_;
+  std::vector<Slot> slots_;
+  std::vector<std::unique_ptr<JpegFrame>> spare_frames_;
+  Unwrapper<uint32_t> timestamp_unwrapper_;
+  std::optional<int64_t> last_timestamp_;
+  size_t size_hint_{0};
+  Stats stats_;
+};
+} // namespace espp
@@ -0,0 +1,213 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <utility>
+
+namespace espp {
+class PacketBufferPool;
+
+/// A fixed-capacity buffer borrowed from a PacketBufferPool.
+/// The buffer is move-only and is returned to the pool it came from when it
+/// is destroyed (or reset), so it can be handed from the socket read through
+/// to reassembly without any allocation or copy.
+class PacketBuffer {
+public:
+  /// Construct an empty buffer which does not belong to any pool.
+  PacketBuffer() = default;
+
+  PacketBuffer(const PacketBuffer &) = delete;
+  PacketBuffer &operator=(const PacketBuffer &) = delete;
+
+  PacketBuffer(PacketBuffer &&other) noexcept { *this = std::move(other); }
+
+  PacketBuffer &operator=(PacketBuffer &&other) noexcept {
+    if (this != &other) {
+      reset();
+      pool_ = std::exchange(other.pool_, nullptr);
+      data_ = std::exchange(other.data_, nullptr);
+      index_ = other.index_;
+      capacity_ = std::exchange(other.capacity_, 0);
+      size_ = std::exchange(other.size_, 0);
+    }
+    return *this;
+  }
+
+  /// Return the buffer to its pool.
+  ~PacketBuffer() { reset(); }
+
+  /// Return the buffer to its pool, leaving this object empty.
+  inline void reset();
+
+  /// Check whether this object holds a buffer.
+  /// @return True if this object holds a buffer from a pool.
+  explicit operator bool() const { return data_ != nullptr; }
+
+  /// Get a pointer to the buffer memory.
+  /// @return A pointer to the buffer memory.
+  uint8_t *data() { return data_; }
+
+  /// Get a pointer to the buffer memory.
+  /// @return A pointer to the buffer memory.
+  const uint8_t *data() const { return data_; }
+
+  /// Get the number of bytes the buffer can hold.
+  /// @return The capacity of the buffer in bytes.
+  size_t capacity() const { return capacity_; }
+
+  /// Get the number of valid bytes in the buffer.
+  /// @return The number of valid bytes in the buffer.
+  size_t size() const { return size_; }
+
+  /// Set the number of valid bytes in the buffer.
+  /// @param size The number of valid bytes, clamped to the capacity.
+  void set_size(size_t size) { size_ = std::min(size, capacity_); }
+
+  /// Get a string_view of the valid bytes in the buffer.
+  /// @return A string_view of the valid bytes in the buffer.
+  std::string_view view() const { return std::string_view((const char *)data_, size_); }
+
+protected:
+  friend class PacketBufferPool;
+
+  PacketBuffer(PacketBufferPool *pool, uint8_t *data, uint32_t index, size_t capacity)
+      : pool_(pool), data_(data), index_(index), capacity_(capacity) {}
+
+  PacketBufferPool *pool_{nullptr};
+  uint8_t *data_{nullptr};
+  uint32_t index_{0};
+  size_t capacity_{0};
+  size_t size_{0};
+};
+
+/// A fixed-capacity, lock-free pool of equally sized packet buffers.
+///
+/// All of the buffer memory is allocated once when the pool is constructed.
+/// Buffers are acquired and released through a lock-free (Treiber) stack of
+/// free indices whose head is tagged to avoid the ABA problem, so any thread
+/// may acquire or release buffers concurrently.
+///
+/// @note The pool must outlive every PacketBuffer acquired from it.
+class PacketBufferPool {
+public:
+  /// Statistics about the usage of the pool.
+  struct Stats {
+    size_t capacity{0};        ///< Total number of buffers in the pool.
+    size_t buffer_size{0};     ///< Size of each buffer in bytes.
+    size_t in_use{0};          ///< Number of buffers currently acquired.
+    size_t high_water_mark{0}; ///< Largest number of buffers ever acquired at once.
+    size_t exhausted_count{0}; ///< Number of times acquire() found the pool empty.
+  };
+
+  /// Construct a pool and allocate all of its buffers.
+  /// @param num_buffers The number of buffers in the pool.
+  /// @param buffer_size The size of each buffer in bytes.
+  explicit PacketBufferPool(size_t num_buffers, size_t buffer_size)
+      : num_buffers_(num_buffers), buffer_size_(buffer_size),
+        storage_(new uint8_t[num_buffers * buffer_size]),
+        next_(new std::atomic<uint32_t>[num_buffers]) {
+    for (size_t i = 0; i < num_buffers_; i++) {
+      next_[i].store(i + 1 < num_buffers_ ? static_cast<uint32_t>(i + 1) : NIL,
+                     std::memory_order_relaxed);
+    }
+    head_.store(make_head(0, num_buffers_ > 0 ? 0 : NIL), std::memory_order_release);
+  }
+
+  PacketBufferPool(const PacketBufferPool &) = delete;
+  PacketBufferPool &operator=(const PacketBufferPool &) = delete;
+
+  /// Acquire a buffer from the pool.
+  /// @return A buffer from the pool, or an empty PacketBuffer if the pool is
+  ///         exhausted.
+  PacketBuffer acquire() {
+    auto buffer = try_acquire();
+    if (!buffer) {
+      exhausted_count_.fetch_add(1, std::memory_order_relaxed);
+    }
+    return buffer;
+  }
+
+  /// Acquire a buffer from the pool if one is free, without counting an empty
+  /// pool as exhausted. Useful for opportunistically acquiring extra buffers.
+  /// @return A buffer from the pool, or an empty PacketBuffer if the pool is
+  ///         empty.
+  PacketBuffer try_acquire() {
+    uint64_t head = head_.load(std::memory_order_acquire);
+    while (true) {
+      uint32_t index = head_index(head);
+      if (index == NIL) {
+        return {};
+      }
+      uint32_t next = next_[index].load(std::memory_order_relaxed);
+      if (head_.compare_exchange_weak(head, make_head(head_tag(head) + 1, next),
+                                      std::memory_order_acq_rel, std::memory_order_acquire)) {
+        size_t in_use = in_use_.fetch_add(1, std::memory_order_relaxed) + 1;
+        size_t high_water_mark = high_water_mark_.load(std::memory_order_relaxed);
+        while (in_use > high_water_mark &&
+               !high_water_mark_.compare_exchange_weak(high_water_mark, in_use,
+                                                       std::memory_order_relaxed)) {
+        }
+        return PacketBuffer(this, storage_.get() + index * buffer_size_, index, buffer_size_);
+      }
+    }
+  }
+
+  /// Get the size of each buffer in the pool.
+  /// @return The size of each buffer in bytes.
+  size_t get_buffer_size() const { return buffer_size_; }
+
+  /// Get a snapshot of the pool statistics.
+  /// @return The pool statistics.
+  Stats get_stats() const {
+    Stats stats;
+    stats.capacity = num_buffers_;
+    stats.buffer_size = buffer_size_;
+    stats.in_use = in_use_.load(std::memory_order_relaxed);
+    stats.high_water_mark = high_water_mark_.load(std::memory_order_relaxed);
+    stats.exhausted_count = exhausted_count_.load(std::memory_order_relaxed);
+    return stats;
+  }
+
+protected:
+  friend class PacketBuffer;
+
+  static constexpr uint32_t NIL = 0xFFFFFFFF;
+
+  static uint64_t make_head(uint32_t tag, uint32_t index) {
+    return (static_cast<uint64_t>(tag) << 32) | index;
+  }
+  static uint32_t head_tag(uint64_t head) { return static_cast<uint32_t>(head >> 32); }
+  static uint32_t head_index(uint64_t head) { return static_cast<uint32_t>(head); }
+
+  void release(uint32_t index) {
+    uint64_t head = head_.load(std::memory_order_relaxed);
+    do {
+      next_[index].store(head_index(head), std::memory_order_relaxed);
+    } while (!head_.compare_exchange_weak(head, make_head(head_tag(head) + 1, index),
+                                          std::memory_order_release, std::memory_order_relaxed));
+    in_use_.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  size_t num_buffers_;
+  size_t buffer_size_;
+  std::unique_ptr<uint8_t[]> storage_;
+  std::unique_ptr<std::atomic<uint32_t>[]> next_;
+  std::atomic<uint64_t> head_{0};
+  std::atomic<size_t> in_use_{0};
+  std::atomic<size_t> high_water_mark_{0};
+  std::atomic<size_t> exhausted_count_{0};
+};
+
+void PacketBuffer::reset() {
+  if (pool_) {
+    pool_->release(index_);
+  }
+  pool_ = nullptr;
+  data_ = nullptr;
+  capacity_ = 0;
+  size_ = 0;
+}
+} // namespace espp
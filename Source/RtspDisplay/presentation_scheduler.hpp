@@ -0,0 +1,228 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "reorder_buffer.hpp"
+
+namespace espp {
+/// Paces the presentation of a stream's frames by their RTP timestamps, so
+/// that network (and decode) jitter doesn't show up as uneven frame times.
+///
+/// Every frame's RTP timestamp is mapped to the local clock with a model of
+/// the sender's clock fit to the times the frames were ready. Only the least
+/// delayed frames say anything about the clocks (the rest is jitter), so the
+/// drift between the clocks is the slope between the least delayed frames of
+/// the older and newer halves of a window of recent frames, and the offset
+/// follows the least delayed frame in the window. Each frame is then held
+/// until its target display time, the mapped time plus a fixed playout delay,
+/// and presented on the tick closest to it. The playout delay is the latency
+/// traded for smoothness; it should cover the variation in how long the
+/// frames take to arrive and decode.
+///
+/// @tparam T The (move constructible) frame type.
+/// @note Not thread safe; call from the thread which presents the frames.
+template <typename T> class PresentationScheduler {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  /// Statistics about the presentation.
+  struct Stats {
+    uint64_t frames_presented{0}; ///< Frames that were presented.
+    uint64_t frames_early{0};     ///< Frames presented ahead of their target time to make room for newer ones.
+    uint64_t frames_late{0};      ///< Frames that were only ready after their target time.
+    uint64_t frames_skipped{0};   ///< Frames replaced by a newer frame that was due on the same tick.
+    uint64_t resyncs{0};          ///< Times the clock model was reset for a discontinuity in the stream.
+    float jitter_ms{0};           ///< Mean deviation of the presentation times from the target times.
+    float drift_ppm{0};           ///< Estimated drift of the sender's clock relative to the local clock.
+  };
+
+  /// Construct a scheduler.
+  /// @param playout_delay How long after its (mapped) capture time each frame
+  ///        is presented.
+  /// @param capacity The maximum number of frames waiting to be presented.
+  /// @param clock_rate The RTP clock rate of the stream, 90 kHz for video.
+  explicit PresentationScheduler(Clock::duration playout_delay, size_t capacity = 4, uint32_t clock_rate = 90000)
+      : playout_delay_(playout_delay), capacity_(std::max<size_t>(capacity, 1)), clock_rate_(clock_rate) {
+    samples_.reserve(WINDOW_SIZE);
+  }
+
+  /// Set the playout delay, which applies to the frames added from now on.
+  /// @param playout_delay How long after its capture time each frame is
+  ///        presented.
+  void set_playout_delay(Clock::duration playout_delay) { playout_delay_ = playout_delay; }
+
+  /// Add a frame to be presented at its target time.
+  /// @param frame The frame.
+  /// @param rtp_timestamp The RTP timestamp of the frame.
+  /// @param ready_time When the frame was ready to be presented (e.g. when it
+  ///        finished decoding).
+  /// @return The target display time of the frame.
+  Clock::time_point push(T &&frame, uint32_t rtp_timestamp, Clock::time_point ready_time) {
+    auto target = schedule(rtp_timestamp, ready_time);
+    if (ready_time > target) {
+      // it can't be shown on time; it is shown on the next tick
+      stats_.frames_late++;
+    }
+    pending_.push_back({std::move(frame), target});
+    return target;
+  }
+
+  /// Get the frame to present on this tick, if there is one: the newest frame
+  /// whose target time is closer to this tick than to the next one. Any older
+  /// frames which were due are skipped.
+  /// @param now The time of this tick.
+  /// @param tick_interval The expected time until the next tick.
+  /// @return The frame to present, or nullopt if none is due yet.
+  std::optional<T> pop(Clock::time_point now, Clock::duration tick_interval) {
+    auto due = now + tick_interval / 2;
+    std::optional<T> frame;
+    Clock::time_point target;
+    bool early = false;
+    while (!pending_.empty() && (pending_.front().target <= due || pending_.size() > capacity_)) {
+      if (frame) {
+        stats_.frames_skipped++;
+      }
+      early = pending_.front().target > due;
+      target = pending_.front().target;
+      // emplace rather than assign, so the old frame is destroyed first
+      frame.reset();
+      frame.emplace(std::move(pending_.front().frame));
+      pending_.pop_front();
+    }
+    if (!frame) {
+      return frame;
+    }
+    stats_.frames_presented++;
+    if (early) {
+      stats_.frames_early++;
+    }
+    float deviation_ms = std::abs(std::chrono::duration<float, std::milli>(now - target).count());
+    stats_.jitter_ms += (deviation_ms - stats_.jitter_ms) / 16.0f;
+    return frame;
+  }
+
+  /// Get the number of frames waiting to be presented.
+  /// @return The number of frames waiting to be presented.
+  size_t size() const { return pending_.size(); }
+
+  /// Drop every waiting frame and forget the clock model, e.g. for a new
+  /// stream.
+  void reset() {
+    pending_.clear();
+    reset_clock_model();
+  }
+
+  /// Get the presentation statistics.
+  /// @return The presentation statistics.
+  const Stats &get_stats() const { return stats_; }
+
+protected:
+  /// Number of recent frames the clock model is fit to, ~17 s at 30 fps.
+  static constexpr size_t WINDOW_SIZE = 512;
+  /// Number of frames needed before the drift is estimated.
+  static constexpr size_t MIN_DRIFT_SAMPLES = 16;
+  /// Largest drift believed, real clocks are well within this.
+  static constexpr double MAX_DRIFT = 1000e-6;
+  /// A frame this far off the clock model means the stream jumped (e.g. the
+  /// sender restarted), so the model is started over.
+  static constexpr double RESYNC_THRESHOLD_S = 1.0;
+
+  struct Pending {
+    T frame;
+    Clock::time_point target;
+  };
+
+  // one frame of the clock model: its media time and how long after it (in
+  // local time) the frame was ready, both in seconds since the first frame
+  struct Sample {
+    double media_time;
+    double offset;
+  };
+
+  Clock::time_point schedule(uint32_t rtp_timestamp, Clock::time_point ready_time) {
+    int64_t timestamp = timestamp_unwrapper_.unwrap(rtp_timestamp);
+    if (samples_.empty()) {
+      first_timestamp_ = timestamp;
+      epoch_ = ready_time;
+    }
+    double media_time = static_cast<double>(timestamp - first_timestamp_) / clock_rate_;
+    double offset = std::chrono::duration<double>(ready_time - epoch_).count() - media_time;
+    if (!samples_.empty() && std::abs(offset - predict_offset(media_time)) > RESYNC_THRESHOLD_S) {
+      stats_.resyncs++;
+      reset_clock_model();
+      return schedule(rtp_timestamp, ready_time);
+    }
+    add_sample({media_time, offset});
+    auto mapped = std::chrono::duration<double>(media_time + predict_offset(media_time));
+    return epoch_ + std::chrono::duration_cast<Clock::duration>(mapped) + playout_delay_;
+  }
+
+  double predict_offset(double media_time) const { return base_offset_ + drift_ * media_time; }
+
+  void add_sample(const Sample &sample) {
+    if (samples_.size() < WINDOW_SIZE) {
+      samples_.push_back(sample);
+    } else {
+      samples_[next_sample_] = sample;
+      next_sample_ = (next_sample_ + 1) % WINDOW_SIZE;
+    }
+    // the drift is the slope between the least delayed frames of each half
+    // of the window
+    if (samples_.size() >= MIN_DRIFT_SAMPLES) {
+      auto [first, last] = std::minmax_element(samples_.begin(), samples_.end(), [](const Sample &a, const Sample &b) {
+        return a.media_time < b.media_time;
+      });
+      double middle = (first->media_time + last->media_time) / 2;
+      std::optional<Sample> older;
+      std::optional<Sample> newer;
+      for (const auto &s : samples_) {
+        auto &half = s.media_time < middle ? older : newer;
+        if (!half || s.offset < half->offset) {
+          half = s;
+        }
+      }
+      if (older && newer && newer->media_time > older->media_time) {
+        double slope = (newer->offset - older->offset) / (newer->media_time - older->media_time);
+        drift_ = std::clamp(slope, -MAX_DRIFT, MAX_DRIFT);
+      }
+    }
+    // and the offset follows the frame which arrived with the least delay,
+    // since any more delay than that is jitter
+    base_offset_ = sample.offset - drift_ * sample.media_time;
+    for (const auto &s : samples_) {
+      base_offset_ = std::min(base_offset_, s.offset - drift_ * s.media_time);
+    }
+    stats_.drift_ppm = static_cast<float>(drift_ * 1e6);
+  }
+
+  void reset_clock_model() {
+    samples_.clear();
+    next_sample_ = 0;
+    drift_ = 0;
+    base_offset_ = 0;
+    timestamp_unwrapper_.reset();
+  }
+
+  Clock::duration playout_delay_;
+  size_t capacity_;
+  uint32_t clock_rate_;
+  std::deque<Pending> pending_;
+
+  Unwrapper<uint32_t> timestamp_unwrapper_;
+  int64_t first_timestamp_{0};
+  Clock::time_point epoch_;
+  std::vector<Sample> samples_;
+  size_t next_sample_{0};
+  double drift_{0};
+  double base_offset_{0};
+  Stats stats_;
+};
+} // namespace espp
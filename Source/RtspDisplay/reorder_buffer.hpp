@@ -0,0 +1,230 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace espp {
+/// Extends a wrapping unsigned counter (such as the 16-bit RTP sequence number
+/// or the 32-bit RTP timestamp) to a monotonic 64-bit value.
+///
+/// Each new value is interpreted as the closest value (forwards or backwards)
+/// to the most recent one, so counters keep increasing across wraparounds and
+/// packets that arrive a little late still unwrap to the right value.
+template <typename T> class Unwrapper {
+  static_assert(std::is_unsigned_v<T>, "Unwrapper requires an unsigned counter type");
+
+public:
+  /// Unwrap a value.
+  /// @param value The wrapped value.
+  /// @return The extended 64-bit value.
+  int64_t unwrap(T value) {
+    if (!initialized_) {
+      initialized_ = true;
+      last_value_ = value;
+      // start far enough from 0 that values before the first one stay positive
+      last_unwrapped_ = (int64_t{1} << (sizeof(T) * 8)) + value;
+      return last_unwrapped_;
+    }
+    auto delta = static_cast<std::make_signed_t<T>>(static_cast<T>(value - last_value_));
+    int64_t unwrapped = last_unwrapped_ + delta;
+    if (delta > 0) {
+      last_value_ = value;
+      last_unwrapped_ = unwrapped;
+    }
+    return unwrapped;
+  }
+
+  /// Forget the history, the next value will start a new sequence.
+  void reset() { initialized_ = false; }
+
+protected:
+  bool initialized_{false};
+  T last_value_{0};
+  int64_t last_unwrapped_{0};
+};
+
+/// A bounded, sequence-ordered reorder (jitter) buffer.
+///
+/// Items are pushed with an extended (unwrapped) sequence number and are
+/// released, in sequence order, through a callback. An item is released as
+/// soon as every item before it has been released. If an item is missing, the
+/// buffer waits for it until the deadline (arrival time + max delay) of the
+/// next buffered item passes, or until a new item no longer fits in the
+/// window, and then skips it. Items older than the last released item are
+/// dropped as late.
+///
+/// @tparam T The (movable) item type.
+template <typename T> class ReorderBuffer {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  /// Statistics about the reordering.
+  struct Stats {
+    size_t depth{0};             ///< Number of items currently buffered.
+    size_t max_depth{0};         ///< Largest number of items ever buffered at once.
+    int64_t max_reorder_distance{0}; ///< Furthest an item arrived behind a newer one.
+    uint64_t reordered{0};       ///< Items which arrived after a newer item.
+    uint64_t late_drops{0};      ///< Items dropped because they arrived after being skipped.
+    uint64_t duplicate_drops{0}; ///< Items dropped because they were already buffered.
+    uint64_t skipped{0};         ///< Sequence numbers skipped because they never arrived.
+  };
+
+  /// Construct a reorder buffer.
+  /// @param capacity The maximum number of sequence numbers the buffer spans.
+  /// @param max_delay How long to wait for a missing item.
+  explicit ReorderBuffer(size_t capacity, Clock::duration max_delay)
+      : slots_(std::max<size_t>(capacity, 1)), max_delay_(max_delay) {}
+
+  /// Insert an item and release every item that can be released.
+  /// @param sequence The extended sequence number of the item.
+  /// @param item The item.
+  /// @param now The arrival time of the item.
+  /// @param release Callable invoked as release(T&&) for each released item,
+  ///        in sequence order.
+  /// @return False if the item was dropped (late or duplicate).
+  template <typename F> bool push(int64_t sequence, T &&item, Clock::time_point now, F &&release) {
+    if (next_sequence_ && *next_sequence_ - sequence > RESYNC_DISTANCE) {
+      // far too old to be a late item, the sender must have restarted
+      flush(release);
+      next_sequence_.reset();
+    }
+    if (!next_sequence_) {
+      next_sequence_ = sequence;
+      highest_sequence_ = sequence;
+    }
+    if (sequence < *next_sequence_) {
+      stats_.late_drops++;
+      return false;
+    }
+    if (sequence < highest_sequence_) {
+      stats_.reordered++;
+      stats_.max_reorder_distance = std::max(stats_.max_reorder_distance, highest_sequence_ - sequence);
+    }
+    highest_sequence_ = std::max(highest_sequence_, sequence);
+    // make room in the window, skipping whatever is missing before the item
+    int64_t window = static_cast<int64_t>(slots_.size());
+    while (sequence >= *next_sequence_ + window) {
+      if (stats_.depth == 0) {
+        // nothing left to release, so jump straight to the new window
+        stats_.skipped += sequence - window + 1 - *next_sequence_;
+        next_sequence_ = sequence - window + 1;
+        break;
+      }
+      release_head(release);
+    }
+    auto &slot = slot_for(sequence);
+    if (slot.item) {
+      stats_.duplicate_drops++;
+      return false;
+    }
+    slot.item.emplace(std::move(item));
+    slot.deadline = now + max_delay_;
+    stats_.depth++;
+    stats_.max_depth = std::max(stats_.max_depth, stats_.depth);
+    release_ready(now, release);
+    return true;
+  }
+
+  /// Release every item whose wait for missing predecessors has expired.
+  /// @param now The current time.
+  /// @param release Callable invoked as release(T&&) for each released item.
+  template <typename F> void release_expired(Clock::time_point now, F &&release) {
+    release_ready(now, release);
+  }
+
+  /// Get the time at which the next buffered item will be released even if
+  /// its predecessors are still missing.
+  /// @return The deadline, or nullopt if nothing is buffered.
+  std::optional<Clock::time_point> get_next_deadline() const {
+    if (stats_.depth == 0 || !next_sequence_) {
+      return std::nullopt;
+    }
+    for (size_t i = 0; i < slots_.size(); i++) {
+      const auto &slot = slot_for(*next_sequence_ + i);
+      if (slot.item) {
+        return slot.deadline;
+      }
+    }
+    return std::nullopt;
+  }
+
+  /// Release every buffered item in sequence order, skipping whatever is
+  /// missing, and start a new sequence.
+  /// @param release Callable invoked as release(T&&) for each released item.
+  template <typename F> void flush(F &&release) {
+    while (stats_.depth > 0) {
+      release_head(release);
+    }
+    next_sequence_.reset();
+  }
+
+  /// Drop every buffered item and start a new sequence.
+  void reset() {
+    for (auto &slot : slots_) {
+      slot.item.reset();
+    }
+    next_sequence_.reset();
+    highest_sequence_ = 0;
+    stats_.depth = 0;
+  }
+
+  /// Get the reorder statistics.
+  /// @return The reorder statistics.
+  const Stats &get_stats() const { return stats_; }
+
+protected:
+  /// Items this far behind the window are treated as a new sequence.
+  static constexpr int64_t RESYNC_DISTANCE = 1024;
+
+  struct Slot {
+    std::optional<T> item;
+    Clock::time_point deadline;
+  };
+
+  Slot &slot_for(int64_t sequence) { return slots_[static_cast<uint64_t>(sequence) % slots_.size()]; }
+  const Slot &slot_for(int64_t sequence) const {
+    return slots_[static_cast<uint64_t>(sequence) % slots_.size()];
+  }
+
+  /// Release (or skip) the item at the head of the window.
+  template <typename F> void release_head(F &release) {
+    auto &slot = slot_for(*next_sequence_);
+    if (slot.item) {
+      T item = std::move(*slot.item);
+      slot.item.reset();
+      stats_.depth--;
+      release(std::move(item));
+    } else {
+      stats_.skipped++;
+    }
+    (*next_sequence_)++;
+  }
+
+  template <typename F> void release_ready(Clock::time_point now, F &release) {
+    while (stats_.depth > 0) {
+      if (slot_for(*next_sequence_).item) {
+        release_head(release);
+        continue;
+      }
+      // the head is missing; give up on it if the next buffered item has
+      // waited long enough
+      auto deadline = get_next_deadline();
+      if (!deadline || now < *deadline) {
+        break;
+      }
+      release_head(release);
+    }
+  }
+
+  std::vector<Slot> slots_;
+  Clock::duration max_delay_;
+  std::optional<int64_t> next_sequence_;
+  int64_t highest_sequence_{0};
+  Stats stats_;
+};
+} // namespace espp
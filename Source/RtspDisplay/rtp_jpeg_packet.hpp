@@ -85,6 +85,21 @@ public:
   /// @return The fragment type field.
   int get_height() const { return height_; }
 
+  /// Check whether the frame uses restart markers (RFC 2435 types 64-127),
+  /// in which case every packet has a restart marker header.
+  /// @return True if the frame uses restart markers.
+  bool has_restart_markers() const { return frag_type_ >= 64 && frag_type_ < 128; }
+
+  /// Get the restart interval from the restart marker header.
+  /// @return The number of MCUs between restart markers, or 0 if the frame
+  ///         doesn't use restart markers.
+  int get_restart_interval() const { return restart_interval_; }
+
+  /// Get the restart count from the restart marker header.
+  /// @return The restart count, or 0 if the frame doesn't use restart
+  ///         markers.
+  int get_restart_count() const { return restart_count_; }
+
   /// Get the mjepg header.
   /// @return The mjepg header.
   std::string_view get_mjpeg_header() {
@@ -133,6 +148,7 @@ public:
 
 protected:
   static constexpr int MJPEG_HEADER_SIZE = 8;
+  static constexpr int RESTART_HEADER_SIZE = 4;
   static constexpr int QUANT_HEADER_SIZE = 4;
   static constexpr int NUM_Q_TABLES = 2;
   static constexpr int Q_TABLE_SIZE = 64;
@@ -143,26 +159,48 @@ protected:
 
   void parse_mjpeg_header() {
     auto payload = get_payload();
-    type_specific_ = payload[0];
-    offset_ = (payload[1] << 16) | (payload[2] << 8) | payload[3];
-    frag_type_ = payload[4];
-    q_ = payload[5];
-    width_ = payload[6] * 8;
-    height_ = payload[7] * 8;
+    // a truncated packet has no jpeg data
+    jpeg_data_start_ = 0;
+    jpeg_data_size_ = 0;
+    if (payload.size() < MJPEG_HEADER_SIZE) {
+      return;
+    }
+    // the fields are unsigned bytes, which char may not be
+    auto p = reinterpret_cast<const uint8_t *>(payload.data());
+    type_specific_ = p[0];
+    offset_ = (p[1] << 16) | (p[2] << 8) | p[3];
+    frag_type_ = p[4];
+    q_ = p[5];
+    width_ = p[6] * 8;
+    height_ = p[7] * 8;
 
     size_t offset = MJPEG_HEADER_SIZE;
 
+    if (has_restart_markers()) {
+      if (payload.size() < offset + RESTART_HEADER_SIZE) {
+        return;
+      }
+      restart_interval_ = (p[offset] << 8) | p[offset + 1];
+      restart_count_ = ((p[offset + 2] & 0x3F) << 8) | p[offset + 3];
+      offset += RESTART_HEADER_SIZE;
+    }
+
     if (has_q_tables()) {
-      uint8_t num_quant_bytes = payload[11];
-      int expected_num_quant_bytes = NUM_Q_TABLES * Q_TABLE_SIZE;
-      if (num_quant_bytes == expected_num_quant_bytes) {
+      if (payload.size() < offset + QUANT_HEADER_SIZE) {
+        return;
+      }
+      size_t num_quant_bytes = (p[offset + 2] << 8) | p[offset + 3];
+      offset += QUANT_HEADER_SIZE;
+      if (payload.size() < offset + num_quant_bytes) {
+        return;
+      }
+      if (num_quant_bytes == NUM_Q_TABLES * Q_TABLE_SIZE) {
         q_tables_.resize(NUM_Q_TABLES);
-        offset += QUANT_HEADER_SIZE;
         for (int i = 0; i < NUM_Q_TABLES; i++) {
-          q_tables_[i] = std::string_view((char*)payload.data() + offset, Q_TABLE_SIZE);
-          offset += Q_TABLE_SIZE;
+          q_tables_[i] = std::string_view(payload.data() + offset + i * Q_TABLE_SIZE, Q_TABLE_SIZE);
         }
       }
+      offset += num_quant_bytes;
     }
 
     jpeg_data_start_ = offset;
@@ -207,6 +245,8 @@ protected:
   uint8_t q_{0};
   uint32_t width_{0};
   uint32_t height_{0};
+  uint16_t restart_interval_{0};
+  uint16_t restart_count_{0};
   int jpeg_data_start_{0};
   int jpeg_data_size_{0};
   std::vector<std::string_view> q_tables_;
@@ -0,0 +1,160 @@
+#pragma once
+
+#include "rtp_packet_view.hpp"
+
+namespace espp {
+/// Non-owning view over an RTP packet for JPEG video.
+/// The RTP payload for JPEG is defined in RFC 2435. The JPEG header,
+/// quantization tables and scan data are parsed in place from the buffer the
+/// view was constructed with, so the buffer must outlive the view.
+class RtpJpegPacketView : public RtpPacketView {
+public:
+  /// Construct an empty (invalid) RtpJpegPacketView.
+  RtpJpegPacketView() = default;
+
+  /// Construct an RtpJpegPacketView over a buffer and parse the RTP and JPEG
+  /// headers.
+  /// @param data The buffer containing the RTP packet. Must outlive the view.
+  explicit RtpJpegPacketView(std::string_view data) : RtpPacketView(data) {
+    if (valid_) {
+      valid_ = parse_mjpeg_header();
+    }
+  }
+
+  /// Get the type-specific field.
+  /// @return The type-specific field.
+  int get_type_specific() const { return type_specific_; }
+
+  /// Get the fragment offset field.
+  /// @return The offset of this fragment's scan data within the frame.
+  int get_offset() const { return offset_; }
+
+  /// Get the type field.
+  /// @return The type field.
+  int get_type() const { return type_; }
+
+  /// Get the q field.
+  /// @return The q field.
+  int get_q() const { return q_; }
+
+  /// Get the width of the frame.
+  /// @return The width of the frame in pixels.
+  int get_width() const { return width_; }
+
+  /// Get the height of the frame.
+  /// @return The height of the frame in pixels.
+  int get_height() const { return height_; }
+
+  /// Check whether the frame uses restart markers (RFC 2435 types 64-127),
+  /// in which case every packet has a restart marker header.
+  /// @return True if the frame uses restart markers.
+  bool has_restart_markers() const { return type_ >= 64 && type_ < 128; }
+
+  /// Get the restart interval from the restart marker header.
+  /// @return The number of MCUs between restart markers, or 0 if the frame
+  ///         doesn't use restart markers.
+  int get_restart_interval() const { return restart_interval_; }
+
+  /// Get the restart count from the restart marker header.
+  /// @return The restart count (0x3FFF if the packet isn't aligned to restart
+  ///         intervals), or 0 if the frame doesn't use restart markers.
+  int get_restart_count() const { return restart_count_; }
+
+  /// Get the mjpeg header.
+  /// @return The mjpeg header.
+  std::string_view get_mjpeg_header() const { return get_payload().substr(0, MJPEG_HEADER_SIZE); }
+
+  /// Get whether the packet contains quantization tables.
+  /// @note Quantization tables are only sent in the first fragment of a frame
+  ///       (offset 0) and only if the q field is 128-255.
+  /// @return Whether the packet contains quantization tables.
+  bool has_q_tables() const { return num_q_tables_ > 0; }
+
+  /// Get the number of quantization tables.
+  /// @return The number of quantization tables.
+  int get_num_q_tables() const { return num_q_tables_; }
+
+  /// Get the quantization table at the specified index.
+  /// @param index The index of the quantization table.
+  /// @return The quantization table at the specified index.
+  std::string_view get_q_table(int index) const {
+    if (index >= 0 && index < num_q_tables_) {
+      return q_tables_[index];
+    }
+    return {};
+  }
+
+  /// Get the JPEG data.
+  /// The jpeg data is the payload minus the mjpeg header and quantization
+  /// tables.
+  /// @return The JPEG data.
+  std::string_view get_jpeg_data() const { return jpeg_data_; }
+
+protected:
+  static constexpr size_t MJPEG_HEADER_SIZE = 8;
+  static constexpr size_t RESTART_HEADER_SIZE = 4;
+  static constexpr size_t QUANT_HEADER_SIZE = 4;
+  static constexpr int NUM_Q_TABLES = 2;
+  static constexpr size_t Q_TABLE_SIZE = 64;
+
+  bool parse_mjpeg_header() {
+    auto payload = get_payload();
+    if (payload.size() < MJPEG_HEADER_SIZE) {
+      return false;
+    }
+    auto p = reinterpret_cast<const uint8_t *>(payload.data());
+    type_specific_ = p[0];
+    offset_ = (p[1] << 16) | (p[2] << 8) | p[3];
+    type_ = p[4];
+    q_ = p[5];
+    width_ = p[6] * 8;
+    height_ = p[7] * 8;
+
+    size_t offset = MJPEG_HEADER_SIZE;
+
+    if (has_restart_markers()) {
+      if (payload.size() < offset + RESTART_HEADER_SIZE) {
+        return false;
+      }
+      // restart interval, then the first and last bits and the restart count
+      restart_interval_ = (p[offset] << 8) | p[offset + 1];
+      restart_count_ = ((p[offset + 2] & 0x3F) << 8) | p[offset + 3];
+      offset += RESTART_HEADER_SIZE;
+    }
+
+    if (offset_ == 0 && q_ >= 128) {
+      if (payload.size() < offset + QUANT_HEADER_SIZE) {
+        return false;
+      }
+      size_t num_quant_bytes = (p[offset + 2] << 8) | p[offset + 3];
+      offset += QUANT_HEADER_SIZE;
+      if (payload.size() < offset + num_quant_bytes) {
+        return false;
+      }
+      // we only support two 8-bit tables (luma and chroma)
+      if (num_quant_bytes == NUM_Q_TABLES * Q_TABLE_SIZE) {
+        num_q_tables_ = NUM_Q_TABLES;
+        for (int i = 0; i < NUM_Q_TABLES; i++) {
+          q_tables_[i] = payload.substr(offset + i * Q_TABLE_SIZE, Q_TABLE_SIZE);
+        }
+      }
+      offset += num_quant_bytes;
+    }
+
+    jpeg_data_ = payload.substr(offset);
+    return true;
+  }
+
+  uint8_t type_specific_{0};
+  uint32_t offset_{0};
+  uint8_t type_{0};
+  uint8_t q_{0};
+  uint32_t width_{0};
+  uint32_t height_{0};
+  uint16_t restart_interval_{0};
+  uint16_t restart_count_{0};
+  int num_q_tables_{0};
+  std::string_view q_tables_[NUM_Q_TABLES];
+  std::string_view jpeg_data_;
+};
+} // namespace espp
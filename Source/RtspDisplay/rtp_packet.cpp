@@ -29,9 +29,9 @@ bool RtpPacket::get_extension() const { return extension_; }
 int RtpPacket::get_csrc_count() const { return csrc_count_; }
 bool RtpPacket::get_marker() const { return marker_; }
 int RtpPacket::get_payload_type() const { return payload_type_; }
-int RtpPacket::get_sequence_number() const { return sequence_number_; }
-int RtpPacket::get_timestamp() const { return timestamp_; }
-int RtpPacket::get_ssrc() const { return ssrc_; }
+uint16_t RtpPacket::get_sequence_number() const { return sequence_number_; }
+uint32_t RtpPacket::get_timestamp() const { return timestamp_; }
+uint32_t RtpPacket::get_ssrc() const { return ssrc_; }
 
 /// Setters for the RTP header fields.
 void RtpPacket::set_version(int version) { version_ = version; }
@@ -40,9 +40,9 @@ void RtpPacket::set_extension(bool extension) { extension_ = extension; }
 void RtpPacket::set_csrc_count(int csrc_count) { csrc_count_ = csrc_count; }
 void RtpPacket::set_marker(bool marker) { marker_ = marker; }
 void RtpPacket::set_payload_type(int payload_type) { payload_type_ = payload_type; }
-void RtpPacket::set_sequence_number(int sequence_number) { sequence_number_ = sequence_number; }
-void RtpPacket::set_timestamp(int timestamp) { timestamp_ = timestamp; }
-void RtpPacket::set_ssrc(int ssrc) { ssrc_ = ssrc; }
+void RtpPacket::set_sequence_number(uint16_t sequence_number) { sequence_number_ = sequence_number; }
+void RtpPacket::set_timestamp(uint32_t timestamp) { timestamp_ = timestamp; }
+void RtpPacket::set_ssrc(uint32_t ssrc) { ssrc_ = ssrc; }
 
 void RtpPacket::serialize() { serialize_rtp_header(); }
 
@@ -76,8 +76,8 @@ void RtpPacket::parse_rtp_header() {
   marker_ = (packet_[1] & 0x80) >> 7;
   payload_type_ = packet_[1] & 0x7F;
   sequence_number_ = (packet_[2] << 8) | packet_[3];
-  timestamp_ = (packet_[4] << 24) | (packet_[5] << 16) | (packet_[6] << 8) | packet_[7];
-  ssrc_ = (packet_[8] << 24) | (packet_[9] << 16) | (packet_[10] << 8) | packet_[11];
+  timestamp_ = (uint32_t(packet_[4]) << 24) | (packet_[5] << 16) | (packet_[6] << 8) | packet_[7];
+  ssrc_ = (uint32_t(packet_[8]) << 24) | (packet_[9] << 16) | (packet_[10] << 8) | packet_[11];
 }
 
 void RtpPacket::serialize_rtp_header() {
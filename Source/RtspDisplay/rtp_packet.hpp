@@ -58,15 +58,15 @@ public:
 
   /// Get the sequence number.
   /// @return The sequence number.
-  int get_sequence_number() const;
+  uint16_t get_sequence_number() const;
 
   /// Get the timestamp.
   /// @return The timestamp.
-  int get_timestamp() const;
+  uint32_t get_timestamp() const;
 
   /// Get the SSRC.
   /// @return The SSRC.
-  int get_ssrc() const;
+  uint32_t get_ssrc() const;
 
   // -----------------------------------------------------------------
   // Setters for the RTP header fields.
@@ -98,15 +98,15 @@ public:
 
   /// Set the sequence number.
   /// @param sequence_number The sequence number to set.
-  void set_sequence_number(int sequence_number);
+  void set_sequence_number(uint16_t sequence_number);
 
   /// Set the timestamp.
   /// @param timestamp The timestamp to set.
-  void set_timestamp(int timestamp);
+  void set_timestamp(uint32_t timestamp);
 
   /// Set the SSRC.
   /// @param ssrc The SSRC to set.
-  void set_ssrc(int ssrc);
+  void set_ssrc(uint32_t ssrc);
 
   // -----------------------------------------------------------------
   // Utility methods.
@@ -159,9 +159,9 @@ protected:
   int csrc_count_{0};
   bool marker_{false};
   int payload_type_{0};
-  int sequence_number_{0};
-  int timestamp_{0};
-  int ssrc_{0};
+  uint16_t sequence_number_{0};
+  uint32_t timestamp_{0};
+  uint32_t ssrc_{0};
   int payload_size_{0};
 };
 } // namespace espp
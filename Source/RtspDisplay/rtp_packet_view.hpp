@@ -0,0 +1,172 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+namespace espp {
+/// RtpPacketView is a non-owning view over an RTP packet.
+/// It parses the RTP header (including the CSRC list, the header extension and
+/// the padding) in place, directly from the buffer it was constructed with.
+/// Unlike RtpPacket, it never copies the packet, so the buffer must outlive
+/// the view.
+class RtpPacketView {
+public:
+  /// Construct an empty (invalid) RtpPacketView.
+  RtpPacketView() = default;
+
+  /// Construct an RtpPacketView over a buffer and parse the header.
+  /// @param data The buffer containing the RTP packet. Must outlive the view.
+  explicit RtpPacketView(std::string_view data) { parse(data); }
+
+  /// Check whether the packet was parsed successfully.
+  /// @note A packet is invalid if it is too short to contain the header, CSRC
+  ///       list, extension and padding that its header announces, or if its
+  ///       version is not 2.
+  /// @return True if the packet is a well-formed RTP packet.
+  bool is_valid() const { return valid_; }
+
+  // -----------------------------------------------------------------
+  // Getters for the RTP header fields.
+  // -----------------------------------------------------------------
+
+  /// Get the RTP version.
+  /// @return The RTP version.
+  int get_version() const { return byte(0) >> 6; }
+
+  /// Get the padding flag.
+  /// @return The padding flag.
+  bool get_padding() const { return (byte(0) & 0x20) != 0; }
+
+  /// Get the extension flag.
+  /// @return The extension flag.
+  bool get_extension() const { return (byte(0) & 0x10) != 0; }
+
+  /// Get the CSRC count.
+  /// @return The CSRC count.
+  int get_csrc_count() const { return byte(0) & 0x0F; }
+
+  /// Get the marker flag.
+  /// @return The marker flag.
+  bool get_marker() const { return (byte(1) & 0x80) != 0; }
+
+  /// Get the payload type.
+  /// @return The payload type.
+  int get_payload_type() const { return byte(1) & 0x7F; }
+
+  /// Get the sequence number.
+  /// @return The sequence number.
+  uint16_t get_sequence_number() const { return read_u16(2); }
+
+  /// Get the timestamp.
+  /// @return The timestamp.
+  uint32_t get_timestamp() const { return read_u32(4); }
+
+  /// Get the SSRC.
+  /// @return The SSRC.
+  uint32_t get_ssrc() const { return read_u32(8); }
+
+  /// Get the CSRC at the specified index.
+  /// @param index The index of the CSRC, must be less than get_csrc_count().
+  /// @return The CSRC at the specified index, or 0 if the index is invalid.
+  uint32_t get_csrc(int index) const {
+    if (!valid_ || index < 0 || index >= get_csrc_count()) {
+      return 0;
+    }
+    return read_u32(RTP_HEADER_SIZE + index * 4);
+  }
+
+  /// Get the profile-defined identifier of the header extension.
+  /// @return The extension profile, or 0 if there is no extension.
+  uint16_t get_extension_profile() const { return extension_profile_; }
+
+  /// Get the header extension data (without the 4 byte extension header).
+  /// @return A string_view of the extension data, empty if there is none.
+  std::string_view get_extension_data() const { return extension_data_; }
+
+  /// Get the number of padding bytes at the end of the packet.
+  /// @return The number of padding bytes.
+  size_t get_padding_size() const { return padding_size_; }
+
+  // -----------------------------------------------------------------
+  // Utility methods.
+  // -----------------------------------------------------------------
+
+  /// Get a string_view of the whole packet.
+  /// @return A string_view of the whole packet.
+  std::string_view get_data() const { return data_; }
+
+  /// Get the size of the RTP header, including the CSRC list and the header
+  /// extension.
+  /// @return The size of the RTP header.
+  size_t get_rtp_header_size() const { return header_size_; }
+
+  /// Get a string_view of the RTP header.
+  /// @return A string_view of the RTP header.
+  std::string_view get_rtp_header() const { return data_.substr(0, header_size_); }
+
+  /// Get a string_view of the payload (without the padding).
+  /// @return A string_view of the payload.
+  std::string_view get_payload() const { return payload_; }
+
+protected:
+  static constexpr size_t RTP_HEADER_SIZE = 12;
+  static constexpr size_t EXTENSION_HEADER_SIZE = 4;
+
+  bool parse(std::string_view data) {
+    data_ = data;
+    valid_ = false;
+    if (data_.size() < RTP_HEADER_SIZE || get_version() != 2) {
+      return false;
+    }
+    size_t offset = RTP_HEADER_SIZE + get_csrc_count() * 4;
+    if (get_extension()) {
+      if (data_.size() < offset + EXTENSION_HEADER_SIZE) {
+        return false;
+      }
+      extension_profile_ = read_u16(offset);
+      size_t extension_size = read_u16(offset + 2) * 4;
+      offset += EXTENSION_HEADER_SIZE;
+      if (data_.size() < offset + extension_size) {
+        return false;
+      }
+      extension_data_ = data_.substr(offset, extension_size);
+      offset += extension_size;
+    }
+    if (data_.size() < offset) {
+      return false;
+    }
+    header_size_ = offset;
+    size_t payload_size = data_.size() - offset;
+    if (get_padding()) {
+      // the last byte of the packet holds the number of padding bytes,
+      // including itself
+      padding_size_ = byte(data_.size() - 1);
+      if (padding_size_ == 0 || padding_size_ > payload_size) {
+        return false;
+      }
+      payload_size -= padding_size_;
+    }
+    payload_ = data_.substr(offset, payload_size);
+    valid_ = true;
+    return true;
+  }
+
+  uint8_t byte(size_t index) const {
+    return index < data_.size() ? static_cast<uint8_t>(data_[index]) : 0;
+  }
+
+  uint16_t read_u16(size_t index) const { return (byte(index) << 8) | byte(index + 1); }
+
+  uint32_t read_u32(size_t index) const {
+    return (static_cast<uint32_t>(read_u16(index)) << 16) | read_u16(index + 2);
+  }
+
+  std::string_view data_;
+  std::string_view payload_;
+  std::string_view extension_data_;
+  uint16_t extension_profile_{0};
+  size_t header_size_{0};
+  size_t padding_size_{0};
+  bool valid_{false};
+};
+} // namespace espp
@@ -0,0 +1,297 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <vector>
+
+namespace espp {
+/// Reads the RTSP responses a server sends over a connection, however the
+/// bytes are split across or coalesced into the reads.
+///
+/// The bytes are received straight into a growable buffer (with prepare()
+/// and commit()) and parsed incrementally: each line of the headers is
+/// parsed once, when its end arrives, so every byte is only looked at once
+/// however many reads the response takes. A response is complete once its
+/// headers and its Content-Length bytes of body have arrived. Any bytes after
+/// it are the start of the next response, so pipelined responses which
+/// arrive together come out of next() one by one, to be matched to their
+/// requests by CSeq. The responses refer to the buffer instead of being
+/// copied out of it.
+class RtspResponseReader {
+public:
+  /// A header of a response.
+  struct Header {
+    std::string_view name;  ///< The name of the header, e.g. "CSeq".
+    std::string_view value; ///< The value, without the whitespace around it.
+  };
+
+  /// A complete response. Its views are into the reader's buffer, so they are
+  /// only valid until the next call to prepare(), next() or reset().
+  struct Response {
+    std::string_view text;        ///< The whole response: status line, headers and body.
+    std::string_view status_line; ///< The status line, e.g. "RTSP/1.0 200 OK".
+    int status_code = 0;          ///< The status code, e.g. 200.
+    int cseq = -1;                ///< The CSeq header, or -1 if there isn't one.
+    std::string_view session;     ///< The Session header without its parameters (e.g. ";timeout=60").
+    std::string_view body;        ///< The Content-Length bytes after the headers, e.g. the SDP.
+    std::vector<Header> headers;  ///< Every header, in order.
+
+    /// Get the value of a header.
+    /// @param name The name of the header, which is matched ignoring case.
+    /// @return The value of the first header with that name, or an empty view
+    ///         if there isn't one.
+    std::string_view get_header(std::string_view name) const {
+      for (const auto &header : headers) {
+        if (equals_ignoring_case(header.name, name)) {
+          return header.value;
+        }
+      }
+      return {};
+    }
+  };
+
+  /// Make a reader for a connection.
+  /// @param max_response_size The most a response (headers and body) may be.
+  ///        Anything bigger is treated as an error rather than buffered.
+  explicit RtspResponseReader(size_t max_response_size = 1024 * 1024) : max_response_size_(max_response_size) {}
+
+  /// Get room for receiving more bytes into, at the end of the buffer.
+  /// Invalidates the last response returned by next().
+  /// @param size The most bytes which will be received.
+  /// @return Where to receive them. Call commit() with how many were.
+  uint8_t *prepare(size_t size) {
+    // drop the responses which have been read, keeping what's left of the
+    // next one. the parse state is relative to its start, so it still holds
+    if (begin_ > 0) {
+      std::memmove(buffer_.data(), buffer_.data() + begin_, end_ - begin_);
+      end_ -= begin_;
+      begin_ = 0;
+    }
+    if (buffer_.size() < end_ + size) {
+      buffer_.resize(std::max(end_ + size, buffer_.size() * 2));
+    }
+    return reinterpret_cast<uint8_t *>(buffer_.data() + end_);
+  }
+
+  /// Add the bytes received into the room prepare() returned.
+  /// @param size The number of bytes received.
+  void commit(size_t size) { end_ = std::min(end_ + size, buffer_.size()); }
+
+  /// Parse the next response, if all of it has arrived.
+  /// @return The response, or nullptr if it isn't complete yet (or the bytes
+  ///         aren't a valid response, see has_error()).
+  const Response *next() {
+    if (state_ == State::ERROR) {
+      return nullptr;
+    }
+    while (state_ != State::BODY) {
+      const char *data = buffer_.data() + begin_;
+      size_t size = end_ - begin_;
+      auto newline =
+          scan_ < size ? static_cast<const char *>(std::memchr(data + scan_, '\n', size - scan_)) : nullptr;
+      if (!newline) {
+        // wait for the rest of the line
+        scan_ = size;
+        if (size > max_response_size_) {
+          state_ = State::ERROR;
+        }
+        return nullptr;
+      }
+      size_t line_end = newline - data;
+      scan_ = line_end + 1;
+      // lines end with "\r\n", but be lenient about a bare "\n"
+      if (line_end > line_start_ && data[line_end - 1] == '\r') {
+        line_end--;
+      }
+      if (!parse_line(std::string_view(data + line_start_, line_end - line_start_))) {
+        state_ = State::ERROR;
+        return nullptr;
+      }
+      line_start_ = scan_;
+    }
+    size_t response_size = headers_size_ + content_length_;
+    if (response_size > max_response_size_) {
+      state_ = State::ERROR;
+      return nullptr;
+    }
+    if (end_ - begin_ < response_size) {
+      // wait for the rest of the body
+      return nullptr;
+    }
+    const char *data = buffer_.data() + begin_;
+    response_.text = std::string_view(data, response_size);
+    response_.status_line = slice(data, status_line_);
+    response_.status_code = status_code_;
+    response_.cseq = cseq_;
+    response_.session = slice(data, session_);
+    response_.body = std::string_view(data + headers_size_, content_length_);
+    response_.headers.clear();
+    for (const auto &field : fields_) {
+      response_.headers.push_back({slice(data, field.name), slice(data, field.value)});
+    }
+    // the next response starts right after it
+    begin_ += response_size;
+    start_response();
+    return &response_;
+  }
+
+  /// Check whether the bytes received aren't a valid response (or are one
+  /// which is too big), in which case the connection can't be read any more.
+  /// @return True if there was an error.
+  bool has_error() const { return state_ == State::ERROR; }
+
+  /// Drop everything received, e.g. for a new connection.
+  void reset() {
+    begin_ = 0;
+    end_ = 0;
+    start_response();
+  }
+
+protected:
+  enum class State { STATUS_LINE, HEADERS, BODY, ERROR };
+
+  // a range of the current response, relative to its start
+  struct Range {
+    size_t begin = 0;
+    size_t end = 0;
+  };
+
+  struct Field {
+    Range name;
+    Range value;
+  };
+
+  static bool equals_ignoring_case(std::string_view a, std::string_view b) {
+    return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+             return (x >= 'A' && x <= 'Z' ? x - 'A' + 'a' : x) == (y >= 'A' && y <= 'Z' ? y - 'A' + 'a' : y);
+           });
+  }
+
+  static bool is_space(char c) { return c == ' ' || c == '\t'; }
+
+  // parse a decimal number, which has to be the whole of the text
+  static bool parse_number(std::string_view text, size_t max_value, size_t &value) {
+    if (text.empty()) {
+      return false;
+    }
+    value = 0;
+    for (char c : text) {
+      if (c < '0' || c > '9') {
+        return false;
+      }
+      value = value * 10 + (c - '0');
+      if (value > max_value) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  std::string_view slice(const char *data, const Range &range) const {
+    return std::string_view(data + range.begin, range.end - range.begin);
+  }
+
+  Range get_range(std::string_view text) const {
+    size_t begin = text.data() - (buffer_.data() + begin_);
+    return {begin, begin + text.size()};
+  }
+
+  bool parse_line(std::string_view line) {
+    if (state_ == State::STATUS_LINE) {
+      if (line.empty()) {
+        // e.g. an extra "\r\n" after the last response, which isn't part of
+        // this one
+        begin_ += scan_;
+        scan_ = 0;
+        return true;
+      }
+      // "RTSP/1.0 200 OK"
+      auto code_start = line.find(' ');
+      size_t status_code = 0;
+      if (line.substr(0, 5) != "RTSP/" || code_start == std::string_view::npos ||
+          !parse_number(line.substr(code_start + 1, 3), 999, status_code)) {
+        return false;
+      }
+      status_code_ = static_cast<int>(status_code);
+      status_line_ = get_range(line);
+      state_ = State::HEADERS;
+      return true;
+    }
+    if (line.empty()) {
+      // the end of the headers
+      headers_size_ = scan_;
+      state_ = State::BODY;
+      return true;
+    }
+    if (is_space(line.front())) {
+      // the continuation of a folded header, which none of the headers used
+      // here need
+      return true;
+    }
+    auto colon = line.find(':');
+    if (colon == std::string_view::npos) {
+      return false;
+    }
+    auto name = line.substr(0, colon);
+    auto value = line.substr(colon + 1);
+    while (!value.empty() && is_space(value.front())) {
+      value.remove_prefix(1);
+    }
+    while (!value.empty() && is_space(value.back())) {
+      value.remove_suffix(1);
+    }
+    if (equals_ignoring_case(name, "Content-Length")) {
+      if (!parse_number(value, max_response_size_, content_length_)) {
+        return false;
+      }
+    } else if (equals_ignoring_case(name, "CSeq")) {
+      size_t cseq = 0;
+      if (!parse_number(value, INT32_MAX, cseq)) {
+        return false;
+      }
+      cseq_ = static_cast<int>(cseq);
+    } else if (equals_ignoring_case(name, "Session")) {
+      session_ = get_range(value.substr(0, value.find(';')));
+    }
+    fields_.push_back({get_range(name), get_range(value)});
+    return true;
+  }
+
+  void start_response() {
+    state_ = State::STATUS_LINE;
+    line_start_ = 0;
+    scan_ = 0;
+    headers_size_ = 0;
+    status_line_ = {};
+    status_code_ = 0;
+    cseq_ = -1;
+    content_length_ = 0;
+    session_ = {};
+    fields_.clear();
+  }
+
+  size_t max_response_size_;
+  std::vector<char> buffer_;
+  // the bytes received are [begin_, end_) of the buffer, and the response
+  // being parsed starts at begin_
+  size_t begin_ = 0;
+  size_t end_ = 0;
+
+  // how far the response has been parsed, relative to its start
+  State state_ = State::STATUS_LINE;
+  size_t line_start_ = 0;
+  size_t scan_ = 0;
+  size_t headers_size_ = 0;
+  Range status_line_;
+  int status_code_ = 0;
+  int cseq_ = -1;
+  size_t content_length_ = 0;
+  Range session_;
+  std::vector<Field> fields_;
+
+  Response response_;
+};
+} // namespace espp
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <utility>
+
+namespace espp {
+/// A bounded, lock-free, single-producer single-consumer ring buffer.
+///
+/// Exactly one thread may push and exactly one (other) thread may pop. Neither
+/// side ever blocks or allocates: push fails when the queue is full and pop
+/// fails when it is empty, so the caller decides whether to drop, retry or
+/// wait. The producer and consumer indices live on separate cache lines, and
+/// each side caches the other's index so that it only touches the shared
+/// cache line when the queue looks full (or empty).
+///
+/// @tparam T The (movable, default constructible) item type.
+template <typename T> class SpscQueue {
+public:
+  /// Construct a queue.
+  /// @param capacity The maximum number of items in the queue at once.
+  explicit SpscQueue(size_t capacity)
+      : capacity_(std::max<size_t>(capacity, 1)), slots_(new T[capacity_ + 1]) {}
+
+  SpscQueue(const SpscQueue &) = delete;
+  SpscQueue &operator=(const SpscQueue &) = delete;
+
+  /// Push an item onto the queue. Only call from the producer thread.
+  /// @param item The item. It is only moved from if the push succeeds.
+  /// @return False if the queue was full.
+  bool try_push(T &&item) {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    size_t next = increment(tail);
+    if (next == cached_head_) {
+      cached_head_ = head_.load(std::memory_order_acquire);
+      if (next == cached_head_) {
+        return false;
+      }
+    }
+    slots_[tail] = std::move(item);
+    tail_.store(next, std::memory_order_release);
+    // the producer is the only thread which can grow the queue, so it tracks
+    // the largest depth
+    size_t depth = distance(head_.load(std::memory_order_relaxed), next);
+    if (depth > max_size_.load(std::memory_order_relaxed)) {
+      max_size_.store(depth, std::memory_order_relaxed);
+    }
+    return true;
+  }
+
+  /// Pop an item from the queue. Only call from the consumer thread.
+  /// @return The item, or nullopt if the queue was empty.
+  std::optional<T> try_pop() {
+    size_t head = head_.load(std::memory_order_relaxed);
+    if (head == cached_tail_) {
+      cached_tail_ = tail_.load(std::memory_order_acquire);
+      if (head == cached_tail_) {
+        return std::nullopt;
+      }
+    }
+    std::optional<T> item(std::move(slots_[head]));
+    // leave a moved-from item behind; reset it so that any resources it held
+    // (e.g. a pooled buffer) are released now rather than when overwritten
+    slots_[head] = T();
+    head_.store(increment(head), std::memory_order_release);
+    return item;
+  }
+
+  /// Get the number of items in the queue. Safe to call from any thread, but
+  /// only a snapshot.
+  /// @return The number of items in the queue.
+  size_t size() const {
+    return distance(head_.load(std::memory_order_acquire), tail_.load(std::memory_order_acquire));
+  }
+
+  /// Check whether the queue is empty. Safe to call from any thread, but only
+  /// a snapshot.
+  /// @return True if the queue is empty.
+  bool empty() const { return size() == 0; }
+
+  /// Get the maximum number of items in the queue at once.
+  /// @return The capacity of the queue.
+  size_t capacity() const { return capacity_; }
+
+  /// Get the largest number of items that have been in the queue at once.
+  /// @return The largest depth of the queue.
+  size_t max_size() const { return max_size_.load(std::memory_order_relaxed); }
+
+protected:
+  static constexpr size_t CACHE_LINE_SIZE = 64;
+
+  size_t increment(size_t index) const { return index == capacity_ ? 0 : index + 1; }
+  size_t distance(size_t head, size_t tail) const { return tail >= head ? tail - head : tail + capacity_ + 1 - head; }
+
+  // one slot is always left empty to tell a full queue from an empty one
+  const size_t capacity_;
+  std::unique_ptr<T[]> slots_;
+
+  // consumer side
+  alignas(CACHE_LINE_SIZE) std::atomic<size_t> head_{0};
+  size_t cached_tail_{0};
+
+  // producer side
+  alignas(CACHE_LINE_SIZE) std::atomic<size_t> tail_{0};
+  size_t cached_head_{0};
+  std::atomic<size_t> max_size_{0};
+};
+} // namespace espp
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace espp {
+/// A lock-free triple buffer, which hands the newest value from one writer
+/// thread to one reader thread.
+///
+/// There are three preallocated buffers. The writer fills the back buffer in
+/// place and publishes it with a single atomic exchange, which makes it the
+/// middle buffer and gives the writer the old middle buffer as its new back
+/// buffer. The reader's update() swaps its front buffer with the middle buffer
+/// the same way, if a newer one has been published. Neither side ever waits,
+/// copies or allocates, and since the buffers are reused, anything they hold
+/// (e.g. a std::vector's capacity) is allocated once. If the writer publishes
+/// twice before the reader updates, the older value is overwritten: the reader
+/// always gets the newest value and never a stale one.
+///
+/// @tparam T The (default constructible) buffer type.
+template <typename T> class TripleBuffer {
+public:
+  TripleBuffer() = default;
+
+  TripleBuffer(const TripleBuffer &) = delete;
+  TripleBuffer &operator=(const TripleBuffer &) = delete;
+
+  /// Get the back buffer to fill. Only call from the writer thread.
+  /// @note It may hold a value which was published (and read) earlier.
+  /// @return The back buffer, which only the writer may access until it is
+  ///         published.
+  T &back() { return buffers_[back_]; }
+
+  /// Publish the back buffer to the reader. Only call from the writer thread.
+  /// Afterwards back() is a different buffer.
+  void publish() {
+    int previous = middle_.exchange(back_ | NEW_BIT, std::memory_order_acq_rel);
+    back_ = previous & INDEX_MASK;
+    published_.fetch_add(1, std::memory_order_relaxed);
+    if (previous & NEW_BIT) {
+      // the reader never saw the buffer we got back
+      overwritten_.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  /// Make the newest published buffer the front buffer, if one has been
+  /// published since the last update. Only call from the reader thread.
+  /// @return True if the front buffer changed.
+  bool update() {
+    if (!(middle_.load(std::memory_order_relaxed) & NEW_BIT)) {
+      return false;
+    }
+    int previous = middle_.exchange(front_, std::memory_order_acq_rel);
+    front_ = previous & INDEX_MASK;
+    return true;
+  }
+
+  /// Get the front buffer. Only call from the reader thread.
+  /// @return The newest buffer as of the last update(), which only the reader
+  ///         may access until the next update().
+  T &front() { return buffers_[front_]; }
+
+  /// Get the number of buffers that have been published. Safe to call from
+  /// any thread.
+  /// @return The number of published buffers.
+  uint64_t get_published() const { return published_.load(std::memory_order_relaxed); }
+
+  /// Get the number of published buffers that were overwritten by a newer one
+  /// before the reader got to them. Safe to call from any thread.
+  /// @return The number of overwritten buffers.
+  uint64_t get_overwritten() const { return overwritten_.load(std::memory_order_relaxed); }
+
+protected:
+  static constexpr size_t CACHE_LINE_SIZE = 64;
+  // the middle index carries a flag for whether it's been published since the
+  // reader last took it
+  static constexpr int INDEX_MASK = 0x3;
+  static constexpr int NEW_BIT = 0x4;
+
+  std::array<T, 3> buffers_;
+
+  // shared
+  alignas(CACHE_LINE_SIZE) std::atomic<int> middle_{1};
+
+  // writer side
+  alignas(CACHE_LINE_SIZE) int back_{0};
+  std::atomic<uint64_t> published_{0};
+  std::atomic<uint64_t> overwritten_{0};
+
+  // reader side
+  alignas(CACHE_LINE_SIZE) int front_{2};
+};
+} // namespace espp